@@ -0,0 +1,1659 @@
+//============================================================================
+// Name        : benchmark.cpp
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Micro-benchmarks of the Track-It-Yourself (TIY) library,
+//				 comparing optimized parts with their former implementation
+//				 (reimplemented here as reference):
+//				 - Epipolar correspondence candidate search (all pairs and
+//				   epipolar band)
+//				 - Lens undistortion of 2D points (lookup table)
+//				 - Segmentation of the marker blobs (fused BlobDetector),
+//				   validated on the stereo video files
+//				 - ROI segmentation (windows around the last 2D points)
+//				 - Centroid modes of the BlobDetector (binary, intensity
+//				   weighted, Gaussian fit)
+//				 - Marker template fitting (edge tables and buffers reused
+//				   per template), on the recorded 3D points of
+//				   "log_points_3D.dat" (or random point clouds)
+//				 - Least-squares fit of two point sets (cv::SVD vs.
+//				   fixed-size quaternion method)
+//				 - Kalman filters of the template poses (cv::KalmanFilter vs.
+//				   PoseFilter), filtered and predicted (latency) pose errors
+//				 - Multicast publishing of the poses at 100/500/1000 Hz: one
+//				   async_send_to() per message vs. sent as batch (same text
+//				   payload), and binary instead of text messages (batched)
+//				 Uses the camera/object parameters of the "config_*.xml" files
+//				 and "video_left.avi"/"video_right.avi" (NO camera needed).
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "multicastServer/MulticastServer.h" // FIRST TO INCLUDE
+#include "multicastServer/PoseMessage.h"
+#include "markerTracking/MarkerTracking.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+
+// Time per call [us] of the given number of repetitions
+static double time_per_call_us(const boost::posix_time::ptime& start_time, int num_repetitions)
+{
+	boost::posix_time::time_duration time_diff = boost::posix_time::microsec_clock::universal_time() - start_time;
+	return (double)time_diff.total_microseconds() / num_repetitions;
+}
+
+
+// -------------------------------------------------------------------------------------
+// Epipolar correspondence candidate search
+// -------------------------------------------------------------------------------------
+
+// Former candidate search of MarkerTracking::get3DPointsFrom2DPoints() (3x1 matrices per pair)
+static int epipolar_candidates_reference(const cv::Mat& points_left_undist, const cv::Mat& points_right_undist, const cv::Mat& E,
+											float max_err_dist_candidate, std::vector<int>& match_left, std::vector<int>& match_right)
+{
+	int num_matches = 0;
+	cv::Mat x_l(3, 1, CV_32F), x_r(3, 1, CV_32F), d(1, 1, CV_32F);
+
+	for(int row=0; row<(int)points_left_undist.total(); row++)
+	  {
+	    for(int col=0; col<(int)points_right_undist.total(); col++)
+	      {
+	        cv::Point2f point_l = points_left_undist.at<cv::Point2f>(0, row);
+	        cv::Point2f point_r = points_right_undist.at<cv::Point2f>(0, col);
+	        x_l = (cv::Mat_<float>(3,1) << point_l.x, point_l.y, 1);
+	        x_r = (cv::Mat_<float>(3,1) << point_r.x, point_r.y, 1);
+	        d = (x_r.t() * E * x_l);
+
+	        if(fabs(d.at<float>(0,0)) < max_err_dist_candidate)
+	          {
+	            match_left.push_back(row);
+	            match_right.push_back(col);
+	            num_matches++;
+	          }
+	      }
+	  }
+
+	return num_matches;
+}
+
+
+// Random marker positions seen by both cameras (undistorted 2D points of the left/right camera, 1xN CV_32FC2)
+static void random_stereo_points(const tiy::MarkerTracking& m_track, int num_points, cv::RNG& rng, cv::Mat& points_left_undist, cv::Mat& points_right_undist)
+{
+	points_left_undist.create(1, num_points, CV_32FC2);
+	points_right_undist.create(1, num_points, CV_32FC2);
+
+	cv::Mat R = m_track.RT_leftcam_to_rightcam(cv::Range(0,3), cv::Range(0,3));
+	cv::Mat T = m_track.RT_leftcam_to_rightcam(cv::Range(0,3), cv::Range(3,4));
+
+	for (int i = 0; i < num_points; i++)
+	{
+		float z = rng.uniform(1500.0f, 3500.0f);
+		cv::Mat X_left = (cv::Mat_<float>(3,1) << rng.uniform(-0.3f, 0.3f)*z, rng.uniform(-0.3f, 0.3f)*z, z);
+		cv::Mat X_right = R * X_left + T;
+
+		points_left_undist.at<cv::Point2f>(0, i) = cv::Point2f(X_left.at<float>(0,0) / X_left.at<float>(2,0), X_left.at<float>(1,0) / X_left.at<float>(2,0));
+		points_right_undist.at<cv::Point2f>(0, i) = cv::Point2f(X_right.at<float>(0,0) / X_right.at<float>(2,0), X_right.at<float>(1,0) / X_right.at<float>(2,0));
+	}
+
+	// Unordered detections in the right frame
+	for (int i = num_points - 1; i > 0; i--)
+		std::swap(points_right_undist.at<cv::Point2f>(0, i), points_right_undist.at<cv::Point2f>(0, rng.uniform(0, i + 1)));
+}
+
+
+static void benchmark_epipolar_matching(const tiy::MarkerTracking& m_track)
+{
+	std::cout << "--- Epipolar correspondence candidate search ---" << std::endl;
+
+	const float max_err_dist_candidate = 5.0f;
+	const int num_points[] = { 10, 50, 200 };
+	cv::RNG rng(42);
+
+	tiy::EpipolarMatcher epipolar_matcher;
+	epipolar_matcher.setEssentialMatrix(m_track.E_stereo_camera);
+	epipolar_matcher.setStereoGeometry(m_track.RT_leftcam_to_rightcam);
+
+	for (int n = 0; n < 3; n++)
+	{
+		cv::Mat points_left_undist, points_right_undist;
+		random_stereo_points(m_track, num_points[n], rng, points_left_undist, points_right_undist);
+
+		int num_repetitions = 200000 / (num_points[n] * num_points[n]) + 10;
+		std::vector<int> match_left_ref, match_right_ref, match_left, match_right, match_left_band, match_right_band;
+
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+		for (int r = 0; r < num_repetitions; r++)
+		{
+			match_left_ref.clear(); match_right_ref.clear();
+			epipolar_candidates_reference(points_left_undist, points_right_undist, m_track.E_stereo_camera, max_err_dist_candidate, match_left_ref, match_right_ref);
+		}
+		double time_reference = time_per_call_us(start_time, num_repetitions);
+
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		for (int r = 0; r < num_repetitions; r++)
+		{
+			match_left.clear(); match_right.clear();
+			epipolar_matcher.setPoints(points_left_undist, points_right_undist);
+			epipolar_matcher.findCandidates(max_err_dist_candidate, -1, match_left, match_right);
+		}
+		double time_matcher = time_per_call_us(start_time, num_repetitions);
+
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		for (int r = 0; r < num_repetitions; r++)
+		{
+			match_left_band.clear(); match_right_band.clear();
+			epipolar_matcher.setPoints(points_left_undist, points_right_undist);
+			epipolar_matcher.findCandidatesInBand(max_err_dist_candidate, m_track.epipolar_band_width, match_left_band, match_right_band);
+		}
+		double time_band = time_per_call_us(start_time, num_repetitions);
+
+		bool is_same = (match_left == match_left_ref) && (match_right == match_right_ref);
+
+		// Candidates of all pairs missed by the band (both lists are sorted left point major)
+		int num_missed = 0;
+		for (size_t i = 0, j = 0; i < match_left.size(); i++)
+		{
+			while (j < match_left_band.size() && (match_left_band[j] < match_left[i] || (match_left_band[j] == match_left[i] && match_right_band[j] < match_right[i])))
+				j++;
+			if (j == match_left_band.size() || match_left_band[j] != match_left[i] || match_right_band[j] != match_right[i])
+				num_missed++;
+		}
+
+		std::cout << num_points[n] << " points per side: reference " << time_reference << " us, EpipolarMatcher " << time_matcher
+				  << " us (x" << time_reference / time_matcher << "), " << match_left.size() << " candidates"
+				  << (is_same ? "" : " - CANDIDATES DIFFER!") << std::endl;
+		std::cout << "  epipolar band (" << m_track.epipolar_band_width << " rad): " << time_band << " us, " << match_left_band.size()
+				  << " candidates (" << num_missed << " missed), " << epipolar_matcher.getNumPrunedPairs() << " of "
+				  << num_points[n] * num_points[n] << " pairs pruned" << std::endl;
+	}
+}
+
+
+// -------------------------------------------------------------------------------------
+// Lens undistortion of 2D points
+// -------------------------------------------------------------------------------------
+
+static void benchmark_undistortion(const tiy::MarkerTracking& m_track)
+{
+	std::cout << "--- Lens undistortion (left camera) ---" << std::endl;
+
+	const int grid_steps[] = { 4, 8, 16 };
+	const int num_points = 200, num_repetitions = 200;
+	cv::RNG rng(42);
+
+	cv::Mat points_dist(1, num_points, CV_32FC2), points_undist_ref, points_undist;
+	for (int i = 0; i < num_points; i++)
+		points_dist.at<cv::Point2f>(0, i) = cv::Point2f(rng.uniform(0.0f, (float)m_track.frame_width - 1), rng.uniform(0.0f, (float)m_track.frame_height - 1));
+
+	boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int r = 0; r < num_repetitions; r++)
+		cv::undistortPoints(points_dist, points_undist_ref, m_track.KK_left, m_track.kc_left);
+	double time_reference = time_per_call_us(start_time, num_repetitions);
+
+	std::cout << num_points << " points: cv::undistortPoints() " << time_reference << " us" << std::endl;
+
+	for (int s = 0; s < 3; s++)
+	{
+		tiy::UndistortionMap undistortion_map;
+
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		undistortion_map.build(m_track.KK_left, m_track.kc_left, m_track.frame_width, m_track.frame_height, grid_steps[s]);
+		double time_build = time_per_call_us(start_time, 1);
+
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		for (int r = 0; r < num_repetitions; r++)
+			undistortion_map.undistortPoints(points_dist, points_undist);
+		double time_map = time_per_call_us(start_time, num_repetitions);
+
+		// Maximum error in pixels (normalized coordinates times focal length)
+		float max_error = 0.0f;
+		for (int i = 0; i < num_points; i++)
+		{
+			cv::Point2f diff = points_undist.at<cv::Point2f>(0, i) - points_undist_ref.at<cv::Point2f>(0, i);
+			max_error = std::max(max_error, (float)(sqrt(diff.x*diff.x + diff.y*diff.y) * m_track.KK_left.at<float>(0,0)));
+		}
+
+		std::cout << "  grid step " << grid_steps[s] << ": UndistortionMap " << time_map << " us (x" << time_reference / time_map << "), build "
+				  << time_build / 1000.0 << " ms, max. error " << max_error << " pixels" << std::endl;
+	}
+}
+
+
+// -------------------------------------------------------------------------------------
+// Segmentation of the marker blobs
+// -------------------------------------------------------------------------------------
+
+static void benchmark_segmentation(tiy::MarkerTracking& m_track, const char *video_file_names[2])
+{
+	std::cout << "--- Segmentation (contours vs. blobs) ---" << std::endl;
+
+	const float max_centroid_diff = 0.05f;
+	tiy::MarkerTracking::SegmentationMode segmentation_mode = m_track.segmentation_mode;
+	tiy::BlobDetector::CentroidMode centroid_mode = m_track.centroid_mode;
+	int roi_full_scan_interval = m_track.roi_full_scan_interval;
+	m_track.centroid_mode = tiy::BlobDetector::CENTROID_BINARY;
+	m_track.roi_full_scan_interval = 0;
+
+	for (int camera_id = 0; camera_id < 2; camera_id++)
+	{
+		cv::VideoCapture video(video_file_names[camera_id]);
+		if (!video.isOpened())
+		{
+			std::cerr << "benchmark_segmentation() - could not open " << video_file_names[camera_id] << std::endl;
+			continue;
+		}
+
+		cv::Mat frame, image;
+		std::vector<cv::Point2f> points_contours, points_blobs;
+		int num_frames = 0, num_centroids = 0, num_degenerated = 0, num_missing = 0, num_too_far = 0;
+		double time_contours = 0.0, time_blobs = 0.0;
+		float max_diff = 0.0f;
+
+		while (video.read(frame))
+		{
+			cv::cvtColor(frame, image, CV_RGB2GRAY, 0);
+			points_contours.clear();
+			points_blobs.clear();
+
+			m_track.segmentation_mode = tiy::MarkerTracking::SEGMENTATION_CONTOURS;
+			boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+			m_track.get2DPointsFromImage(image, &points_contours, camera_id);
+			time_contours += time_per_call_us(start_time, 1);
+
+			m_track.segmentation_mode = tiy::MarkerTracking::SEGMENTATION_BLOBS;
+			start_time = boost::posix_time::microsec_clock::universal_time();
+			m_track.get2DPointsFromImage(image, &points_blobs, camera_id);
+			time_blobs += time_per_call_us(start_time, 1);
+
+			// Nearest blob centroid of every contour centroid
+			for (size_t c = 0; c < points_contours.size(); c++)
+			{
+				// Contours of one pixel width have no area (m00 = 0)
+				if (!(points_contours[c].x == points_contours[c].x) || !(points_contours[c].y == points_contours[c].y))
+				{
+					num_degenerated++;
+					continue;
+				}
+
+				float min_diff = std::numeric_limits<float>::infinity();
+				for (size_t b = 0; b < points_blobs.size(); b++)
+				{
+					cv::Point2f diff = points_blobs[b] - points_contours[c];
+					min_diff = std::min(min_diff, (float)sqrt(diff.x*diff.x + diff.y*diff.y));
+				}
+
+				num_centroids++;
+				if (min_diff > 1.0f)
+					num_missing++;
+				else
+				{
+					max_diff = std::max(max_diff, min_diff);
+					if (min_diff > max_centroid_diff)
+						num_too_far++;
+				}
+			}
+
+			num_frames++;
+		}
+
+		if (num_frames == 0)
+			continue;
+
+		std::cout << video_file_names[camera_id] << ": " << num_frames << " frames, contours " << time_contours / num_frames << " us, blobs "
+				  << time_blobs / num_frames << " us (x" << time_contours / time_blobs << ")" << std::endl;
+		std::cout << "  " << num_centroids << " centroids: max. difference " << max_diff << " pixels, " << num_too_far << " more than "
+				  << max_centroid_diff << " pixels, " << num_missing << " missing (" << num_degenerated << " degenerated contours skipped)"
+				  << ((num_too_far == 0 && num_missing == 0) ? " - OK" : " - VALIDATION FAILED!") << std::endl;
+	}
+
+	m_track.segmentation_mode = segmentation_mode;
+	m_track.centroid_mode = centroid_mode;
+	m_track.roi_full_scan_interval = roi_full_scan_interval;
+}
+
+
+// -------------------------------------------------------------------------------------
+// ROI segmentation
+// -------------------------------------------------------------------------------------
+
+static void benchmark_roi_segmentation(tiy::MarkerTracking& m_track, const char *video_file_names[2])
+{
+	std::cout << "--- ROI segmentation (blobs, full frame scan every 30 frames) ---" << std::endl;
+
+	tiy::MarkerTracking::SegmentationMode segmentation_mode = m_track.segmentation_mode;
+	int roi_full_scan_interval = m_track.roi_full_scan_interval;
+	m_track.segmentation_mode = tiy::MarkerTracking::SEGMENTATION_BLOBS;
+
+	for (int camera_id = 0; camera_id < 2; camera_id++)
+	{
+		cv::VideoCapture video(video_file_names[camera_id]);
+		if (!video.isOpened())
+		{
+			std::cerr << "benchmark_roi_segmentation() - could not open " << video_file_names[camera_id] << std::endl;
+			continue;
+		}
+
+		cv::Mat frame, image;
+		std::vector<cv::Point2f> points_full, points_roi;
+		int num_frames = 0, num_different = 0;
+		double time_full = 0.0, time_roi = 0.0;
+		tiy::MarkerTracking::RoiStatistics statistics_before = m_track.roi_statistics[camera_id];
+
+		while (video.read(frame))
+		{
+			cv::cvtColor(frame, image, CV_RGB2GRAY, 0);
+			points_full.clear();
+			points_roi.clear();
+
+			m_track.roi_full_scan_interval = 0;
+			boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+			m_track.get2DPointsFromImage(image, &points_full, camera_id);
+			time_full += time_per_call_us(start_time, 1);
+
+			m_track.roi_full_scan_interval = 30;
+			start_time = boost::posix_time::microsec_clock::universal_time();
+			m_track.get2DPointsFromImage(image, &points_roi, camera_id);
+			time_roi += time_per_call_us(start_time, 1);
+
+			// New markers are only found by the next full frame scan
+			if (points_roi.size() != points_full.size())
+				num_different++;
+
+			num_frames++;
+		}
+
+		if (num_frames == 0)
+			continue;
+
+		const tiy::MarkerTracking::RoiStatistics& statistics = m_track.roi_statistics[camera_id];
+		std::cout << video_file_names[camera_id] << ": " << num_frames << " frames, full frame " << time_full / num_frames << " us, ROI "
+				  << time_roi / num_frames << " us (x" << time_full / time_roi << "), " << num_different << " frames with other number of points" << std::endl;
+		std::cout << "  " << statistics.num_full_scans - statistics_before.num_full_scans << " full frame scans, "
+				  << statistics.num_roi_scans - statistics_before.num_roi_scans << " ROI scans, "
+				  << statistics.num_hits - statistics_before.num_hits << " hits, " << statistics.num_misses - statistics_before.num_misses << " misses" << std::endl;
+	}
+
+	m_track.segmentation_mode = segmentation_mode;
+	m_track.roi_full_scan_interval = roi_full_scan_interval;
+}
+
+
+// -------------------------------------------------------------------------------------
+// Centroid modes
+// -------------------------------------------------------------------------------------
+
+static void benchmark_centroids(tiy::MarkerTracking& m_track, const char *video_file_name)
+{
+	std::cout << "--- Centroid modes (blobs, " << video_file_name << ") ---" << std::endl;
+
+	const tiy::BlobDetector::CentroidMode centroid_modes[3] = { tiy::BlobDetector::CENTROID_BINARY, tiy::BlobDetector::CENTROID_INTENSITY,
+																tiy::BlobDetector::CENTROID_GAUSSIAN };
+	const char *centroid_mode_names[3] = { "binary", "intensity", "gaussian" };
+
+	tiy::MarkerTracking::SegmentationMode segmentation_mode = m_track.segmentation_mode;
+	tiy::BlobDetector::CentroidMode centroid_mode = m_track.centroid_mode;
+	int roi_full_scan_interval = m_track.roi_full_scan_interval;
+	m_track.segmentation_mode = tiy::MarkerTracking::SEGMENTATION_BLOBS;
+	m_track.roi_full_scan_interval = 0;
+
+	cv::VideoCapture video(video_file_name);
+	if (!video.isOpened())
+	{
+		std::cerr << "benchmark_centroids() - could not open " << video_file_name << std::endl;
+		return;
+	}
+
+	cv::Mat frame, image;
+	std::vector<cv::Point2f> points_binary, points;
+	int num_frames = 0;
+	double time[3] = { 0.0, 0.0, 0.0 }, sum_shift[3] = { 0.0, 0.0, 0.0 };
+	long long num_points = 0;
+
+	while (video.read(frame))
+	{
+		cv::cvtColor(frame, image, CV_RGB2GRAY, 0);
+
+		for (int c = 0; c < 3; c++)
+		{
+			points.clear();
+			m_track.centroid_mode = centroid_modes[c];
+			boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+			m_track.get2DPointsFromImage(image, &points, 0);
+			time[c] += time_per_call_us(start_time, 1);
+
+			// Same blobs in the same order => shift to the binary centroid
+			if (c == 0)
+				points_binary = points;
+			else if (points.size() == points_binary.size())
+			{
+				for (size_t i = 0; i < points.size(); i++)
+				{
+					cv::Point2f diff = points[i] - points_binary[i];
+					sum_shift[c] += sqrt(diff.x*diff.x + diff.y*diff.y);
+				}
+			}
+		}
+
+		num_points += points_binary.size();
+		num_frames++;
+	}
+
+	for (int c = 0; c < 3 && num_frames > 0; c++)
+	{
+		std::cout << centroid_mode_names[c] << ": " << time[c] / num_frames << " us per frame (+" << (time[c] - time[0]) / num_frames
+				  << " us), mean shift to binary " << (num_points > 0 ? sum_shift[c] / num_points : 0.0) << " pixels" << std::endl;
+	}
+
+	m_track.segmentation_mode = segmentation_mode;
+	m_track.centroid_mode = centroid_mode;
+	m_track.roi_full_scan_interval = roi_full_scan_interval;
+}
+
+
+// -------------------------------------------------------------------------------------
+// Marker template fitting
+// -------------------------------------------------------------------------------------
+
+// Former MarkerTracking::fit3DPointsToObjectTemplate() (cv::Mat edge tables, nested vectors and a priority queue per call)
+static void fit_template_reference(const tiy::MarkerTracking& m_track, const cv::Mat &points_3D, int template_id, cv::Mat &RT, float *avg_deviation)
+{
+    // Template search
+
+	// Constraint:
+    const float max_distance = 20.0;
+    const int min_correspondences = 4;
+    cv::Mat marker_template = m_track.object_templates[template_id];
+    int num_temp = marker_template.cols;
+    int num_p = points_3D.cols;
+
+    // get edge lengths of Template
+    cv::Mat edges_template = cv::Mat::zeros(num_temp, num_temp, CV_32F);
+    float edges_template_max = 0;
+    float edges_template_min = std::numeric_limits<float>::infinity();
+    for(int a = 0; a < num_temp; a++)
+      {
+    	// compute complete matrix
+        for(int b = 0; b < num_temp; b++)
+          {
+            float dist = (float)norm( marker_template.col(a) - marker_template.col(b) );
+            edges_template.at<float>(a,b) = dist;
+            if(dist > edges_template_max)
+              edges_template_max = dist;
+            if((a!=b)&&(dist < edges_template_min))
+              edges_template_min = dist;
+          }
+      }
+
+	// Constraint:
+    edges_template_max += max_distance;
+
+	// Constraint:
+    edges_template_min -= max_distance;
+    if (edges_template_min < 0.0) 
+    	edges_template_min = 0.0;
+
+
+    // Find the best few edge matches and get edge lengths of ALL points (adjacency matrix)
+    cv::Mat edges_world = cv::Mat::zeros(num_p, num_p, CV_32F);
+    std::priority_queue<tiy::MarkerTracking::edge_match, std::vector<tiy::MarkerTracking::edge_match>, tiy::MarkerTracking::edge_match_comp> edge_matches;
+    for(int a = 0; a < num_p; a++)
+      {
+    	// Undirected graph => adjacency matrix symmetric => fill only upper triangular matrix
+        for(int b = a+1; b < num_p; b++)
+          {	     
+        	edges_world.at<float>(a,b) = (float)norm( points_3D.col(a) - points_3D.col(b) );
+            if ((edges_world.at<float>(a,b) > edges_template_max) || (edges_world.at<float>(a,b) < edges_template_min))
+              continue;
+
+            for(int x = 0; x < num_temp; x++)
+              {
+                for(int y = x+1; y < num_temp; y++)
+                  {
+                    float dist = abs(edges_world.at<float>(a,b) - edges_template.at<float>(x,y));
+                    // Constraint:
+                    if(dist < max_distance)
+                      {
+                        edge_matches.push(tiy::MarkerTracking::edge_match(dist, a, b, x, y));
+                      }
+                  }
+              }
+          }
+      }
+
+
+	// LIST of the best found template/world point indexes (i. column = values for i corresponding points)
+	std::vector<std::vector<int> > best_world_idx;
+	std::vector<std::vector<int> > best_template_idx;
+	// Best ASSIGNMENT between template points <-> world points (i. column = values for i corresponding points)
+	std::vector<std::vector<int> > best_template_to_world;
+	std::vector<std::vector<int> > best_world_to_template;
+
+	best_template_to_world.resize(num_temp);
+	best_template_idx.resize(num_temp);
+	best_world_to_template.resize(num_p);
+	best_world_idx.resize(num_p);
+
+	for (int i = 0; i < num_temp; i++)
+	{		
+		best_template_to_world[i].resize(num_temp);
+		best_template_idx[i].resize(num_temp);
+	}
+	for (int i = 0; i < num_p; i++)
+	{
+		best_world_to_template[i].resize(num_temp);
+		best_world_idx[i].resize(num_temp);
+	}
+
+	for (int i = 0; i < num_temp; i++)
+	{
+		for (int j = 0; j < num_temp; j++)
+		{
+			best_template_to_world[i][j] = -1;
+			best_template_idx[i][j] = -1;
+		}
+	}
+	for (int i = 0; i < num_p; i++)
+	{
+		for (int j = 0; j < num_temp; j++)
+		{
+			best_world_to_template[i][j] = -1;
+			best_world_idx[i][j] = -1;
+		}
+	}
+
+
+	float my_residuum=std::numeric_limits<float>::infinity();
+	std::vector<float> best_residuum, residuum_max;
+	for (int i = 0; i < num_temp; i++)
+	{
+		best_residuum.push_back(std::numeric_limits<float>::infinity());
+		// Constraint:
+		residuum_max.push_back((i+1)*max_distance);
+	}
+
+
+	// Constraint:
+	int num_test_edges = 15 + num_temp*(num_temp-1); // number of tested edges is 2*(number of edges in the object template)
+
+	cv::Mat my_template=cv::Mat::zeros(3,num_temp,CV_32F), my_points=cv::Mat::zeros(3,num_temp,CV_32F);
+
+// 2 correspondences (a,b) <-> (x,y)
+	for(int e = 0; e < (int)edge_matches.size() && e < num_test_edges; e++)
+	{
+        tiy::MarkerTracking::edge_match m = edge_matches.top();
+        int a=m.a, b=m.b, x=m.x, y=m.y;
+
+// 3 correspondences (a,b,c) <-> (x,y,z)
+        for(int c = 0; c < num_p; c++)
+        {
+            if(a==c || b==c)
+            	continue;
+
+            float edge_a_b = 0.0;
+            float edge_a_c = 0.0;
+            float edge_b_c = 0.0;
+
+			// Lower triangle matrix not filled (symmetric) -> take correspondent from upper matrix
+			if (a > b)
+				edge_a_b = edges_world.at<float>(b,a);
+			else
+				edge_a_b = edges_world.at<float>(a,b);
+
+			if (a > c)
+				edge_a_c = edges_world.at<float>(c,a);
+			else
+				edge_a_c = edges_world.at<float>(a,c);
+
+			if (b > c)
+				edge_b_c = edges_world.at<float>(c,b);
+			else
+				edge_b_c = edges_world.at<float>(b,c);
+	    
+			// Test if edges of new point in cv::Range
+            if(edge_a_c > edges_template_max || edge_a_c < edges_template_min  || edge_b_c > edges_template_max || edge_b_c < edges_template_min)
+            	continue;
+
+            for(int z = 0; z < num_temp; z++)
+            {
+				int my_num_corres = 3;
+
+				float dist_a_b = edge_a_b - edges_template.at<float>(x,y);
+				float dist_a_c = edge_a_c - edges_template.at<float>(x,z);
+				float dist_b_c = edge_b_c - edges_template.at<float>(y,z);
+
+				my_residuum = dist_a_b*dist_a_b + dist_a_c*dist_a_c + dist_b_c*dist_b_c;
+
+				// Test if triangle does match AND is better than best fit so far
+				if(x==z || y==z || my_residuum > residuum_max[my_num_corres-1] || my_residuum > best_residuum[my_num_corres-1])
+				   continue;
+
+				best_residuum[my_num_corres-1] = my_residuum;
+
+
+				for (int i = 0; i < num_temp; i++)
+				{
+					best_template_idx[i][my_num_corres-1] = -1;
+					best_template_to_world[i][my_num_corres-1] = -1;
+				}
+				for (int i = 0; i < num_p; i++)
+				{
+					best_world_idx[i][my_num_corres-1] = -1;
+					best_world_to_template[i][my_num_corres-1] = -1;
+				}
+
+				best_template_idx[0][my_num_corres-1] = x;
+				best_template_idx[1][my_num_corres-1] = y;
+				best_template_idx[2][my_num_corres-1] = z;
+				best_world_idx[0][my_num_corres-1] = a;
+				best_world_idx[1][my_num_corres-1] = b;
+				best_world_idx[2][my_num_corres-1] = c;
+
+				best_template_to_world[x][my_num_corres-1] = a;
+				best_template_to_world[y][my_num_corres-1] = b;
+				best_template_to_world[z][my_num_corres-1] = c;
+				best_world_to_template[a][my_num_corres-1] = x;
+				best_world_to_template[b][my_num_corres-1] = y;
+				best_world_to_template[c][my_num_corres-1] = z;
+
+// 4+ correspondences (a,b,c,...) ~ (x,y,z,...)
+				while(my_num_corres < num_temp)
+				{
+					// Find closest point
+					unsigned int best_world_idx_local=-1, best_template_idx_local=-1;
+					float new_residuum=std::numeric_limits<float>::infinity(); // only additional terms for residuum
+					float best_new_residuum=std::numeric_limits<float>::infinity();
+
+					// Go through ALL template points (that are NOT assigned yet) -> take template point with smallest residuum
+					for (int i=0; i<num_temp; i++)
+					{
+						// Test if already assigned
+						if(best_template_to_world[i][my_num_corres-1] >= 0)
+							continue;
+
+						// Go through ALL world points (that are NOT assigned yet) -> take world correspondent with smallest residuum
+						for (int j=0; j<num_p; j++)
+						{
+							// Test if already assigned
+							if(best_world_to_template[j][my_num_corres-1] >= 0)
+								continue;
+
+							new_residuum = 0.0;
+
+							// Go through ALL correspondences (world points, that ARE assigned yet)
+							// -> check if edges (corresp <-> ACTUAL world point) are in range and best residuum so far
+							for (int k=0; k<my_num_corres; k++)
+							{
+								float new_edge_world = 0.0;
+
+								// only upper triangle matrix filled
+								if (j > best_world_idx[k][my_num_corres-1])
+									new_edge_world = edges_world.at<float>(best_world_idx[k][my_num_corres-1],j);
+								else
+									new_edge_world = edges_world.at<float>(j,best_world_idx[k][my_num_corres-1]);
+
+								// edge in [min...max] range?
+								if ((new_edge_world > edges_template_max) || (new_edge_world < edges_template_min))
+								{
+									new_residuum = std::numeric_limits<float>::infinity();
+									break; // not in range => world point definitely NOT a correspondant => break
+								}
+
+								// Test if the edge from the actual (j.) world candidate to the other (k.) correspondants fit to
+								// the edges from the assigned object template points to the "next" template point
+								float new_edge_template = edges_template.at<float>(i,best_template_idx[k][my_num_corres-1]);
+								float new_dist = abs(new_edge_world - new_edge_template);
+								// Constraint:
+								if (new_dist > max_distance)
+								{
+									new_residuum = std::numeric_limits<float>::infinity();
+									break; // distance too big => world point definitely NOT a correspondant => break
+								}
+
+								new_residuum += new_dist*new_dist;
+							}
+
+							if (new_residuum > best_new_residuum)
+								continue;
+
+							best_new_residuum = new_residuum;
+							best_template_idx_local=i;
+							best_world_idx_local=j;
+						}
+					}
+
+					my_residuum = best_residuum[my_num_corres-1] + best_new_residuum;
+
+					if ((my_residuum > residuum_max[my_num_corres]) || (my_residuum > best_residuum[my_num_corres]))
+						break;
+					
+					best_residuum[my_num_corres] = my_residuum;
+					
+					for (int i= 0; i<my_num_corres; i++)
+					{
+						best_template_idx[i][my_num_corres] = best_template_idx[i][my_num_corres-1];
+						best_world_idx[i][my_num_corres] = best_world_idx[i][my_num_corres-1];
+					}
+					best_template_idx[my_num_corres][my_num_corres] = best_template_idx_local;
+					best_world_idx[my_num_corres][my_num_corres] = best_world_idx_local;
+
+
+					for (int i=0; i<num_temp;i++)
+						best_template_to_world[i][my_num_corres] = best_template_to_world[i][my_num_corres-1];
+					for (int i=0; i<num_p;i++)
+						best_world_to_template[i][my_num_corres] = best_world_to_template[i][my_num_corres-1];
+					best_template_to_world[best_template_idx_local][my_num_corres] = best_world_idx_local;
+					best_world_to_template[best_world_idx_local][my_num_corres] = best_template_idx_local;
+
+					my_num_corres++;
+				}
+		
+            }
+        }
+
+        edge_matches.pop();
+	}
+
+	if (best_residuum[min_correspondences-1] == std::numeric_limits<float>::infinity())
+	{
+		RT = cv::Mat::zeros(4, 4, CV_32F);
+		*avg_deviation = std::numeric_limits<float>::infinity();
+		return;
+	}
+
+	// Decide which result with which number of correspondances to take
+	// (the smaller the residuum the better but also the more correspondants the better)
+	unsigned int best_num_corres = 4;
+
+	int num_edges=0;
+	std::vector<float>avg_edge_residuum;
+	for(int i=0; i<num_temp; i++)
+		avg_edge_residuum.push_back(0);
+	avg_edge_residuum[0] = std::numeric_limits<float>::infinity();
+	for (int i=1; i<num_temp; i++)
+	{
+		// Compute average edge residuum by dividing the residuum by the number of quadratic terms (= number of edges)
+		num_edges += i;
+		avg_edge_residuum[i] = best_residuum[i]/num_edges;
+
+		float factor_ = 1.0;
+		// Always better to have more points, when the avg_edg_residuums are nearly the same
+		for (int j = i+1; j<num_temp; j++)
+			factor_ = factor_*1.65f;
+		avg_edge_residuum[i] = factor_*avg_edge_residuum[i];
+
+	}
+
+	for (int i=4; i<num_temp; i++)
+	{
+		if (avg_edge_residuum[i] <= avg_edge_residuum[best_num_corres-1])
+			best_num_corres = i+1;
+	}
+
+
+	for(unsigned int i = 0; i<best_num_corres; i++)
+	{
+		my_points.at<float>(0,i) = points_3D.at<float>(0,best_world_idx[i][best_num_corres-1]);
+		my_points.at<float>(1,i) = points_3D.at<float>(1,best_world_idx[i][best_num_corres-1]);
+		my_points.at<float>(2,i) = points_3D.at<float>(2,best_world_idx[i][best_num_corres-1]);
+		my_template.at<float>(0,i) = marker_template.at<float>(0,best_template_idx[i][best_num_corres-1]);
+		my_template.at<float>(1,i) = marker_template.at<float>(1,best_template_idx[i][best_num_corres-1]);
+		my_template.at<float>(2,i) = marker_template.at<float>(2,best_template_idx[i][best_num_corres-1]);
+	}
+		
+	
+	tiy::MarkerTracking::fitTwoPointSets(my_template.colRange(0,best_num_corres), my_points.colRange(0,best_num_corres), best_num_corres, RT, avg_deviation);
+
+	*avg_deviation = avg_edge_residuum[best_num_corres-1];
+}
+
+
+// 3D point clouds (4xN, CV_32F, homogeneous) of a 3D point log file of the server (do_log_3D: one frame per line,
+// "timestamp[TAB]x(0)[TAB]y(0)[TAB]z(0)..."); returns FALSE if the file could not be read
+static bool read_points_3D_log(const char *file_name, std::vector<cv::Mat>& point_clouds)
+{
+	std::ifstream input_file(file_name);
+	if (!input_file.is_open())
+		return false;
+
+	std::string line;
+	while (std::getline(input_file, line))
+	{
+		std::stringstream line_stream(line);
+		long long timestamp;
+		if (!(line_stream >> timestamp))
+			continue;
+
+		std::vector<float> coordinates;
+		float value;
+		while (line_stream >> value)
+			coordinates.push_back(value);
+
+		int num_points = (int)coordinates.size() / 3;
+		cv::Mat points_3D = cv::Mat::ones(4, num_points, CV_32F);
+		for (int p = 0; p < num_points; p++)
+			for (int j = 0; j < 3; j++)
+				points_3D.at<float>(j, p) = coordinates[3*p + j];
+		point_clouds.push_back(points_3D);
+	}
+
+	return !point_clouds.empty();
+}
+
+
+// Random point clouds: all templates at random poses (with noise) plus clutter points
+static void random_point_clouds(const tiy::MarkerTracking& m_track, int num_clouds, int num_clutter_points, cv::RNG& rng, std::vector<cv::Mat>& point_clouds)
+{
+	std::vector<cv::Point3f> points;
+	for (int f = 0; f < num_clouds; f++)
+	{
+		points.clear();
+		for (int t = 0; t < m_track.num_templates; t++)
+		{
+			cv::Mat rotation_vector = (cv::Mat_<float>(3,1) << rng.uniform(-3.1f, 3.1f), rng.uniform(-3.1f, 3.1f), rng.uniform(-3.1f, 3.1f));
+			cv::Mat RT = cv::Mat::eye(4, 4, CV_32F);
+			cv::Mat R = RT(cv::Range(0,3), cv::Range(0,3));
+			cv::Rodrigues(rotation_vector, R);
+			RT.at<float>(0,3) = rng.uniform(-800.0f, 800.0f);
+			RT.at<float>(1,3) = rng.uniform(-800.0f, 800.0f);
+			RT.at<float>(2,3) = rng.uniform(1500.0f, 3500.0f);
+
+			cv::Mat template_points = RT * m_track.object_templates[t];
+			for (int p = 0; p < template_points.cols; p++)
+				points.push_back(cv::Point3f(template_points.at<float>(0, p) + (float)rng.gaussian(0.5),
+											 template_points.at<float>(1, p) + (float)rng.gaussian(0.5),
+											 template_points.at<float>(2, p) + (float)rng.gaussian(0.5)));
+		}
+
+		for (int p = 0; p < num_clutter_points; p++)
+			points.push_back(cv::Point3f(rng.uniform(-1000.0f, 1000.0f), rng.uniform(-1000.0f, 1000.0f), rng.uniform(1500.0f, 3500.0f)));
+
+		// Unordered detections
+		for (int i = (int)points.size() - 1; i > 0; i--)
+			std::swap(points[i], points[rng.uniform(0, i + 1)]);
+
+		cv::Mat points_3D = cv::Mat::ones(4, (int)points.size(), CV_32F);
+		for (int p = 0; p < (int)points.size(); p++)
+		{
+			points_3D.at<float>(0, p) = points[p].x;
+			points_3D.at<float>(1, p) = points[p].y;
+			points_3D.at<float>(2, p) = points[p].z;
+		}
+
+		point_clouds.push_back(points_3D);
+	}
+}
+
+
+static void benchmark_template_fitting(tiy::MarkerTracking& m_track, const char *points_3D_file_name)
+{
+	std::cout << "--- Marker template fitting ---" << std::endl;
+
+	const int num_repetitions = 20;
+	const float max_pose_diff = 1e-3f;
+
+	std::vector<cv::Mat> point_clouds;
+	if (read_points_3D_log(points_3D_file_name, point_clouds))
+		std::cout << point_clouds.size() << " recorded point clouds of " << points_3D_file_name << std::endl;
+	else
+	{
+		cv::RNG rng(42);
+		random_point_clouds(m_track, 200, 5, rng, point_clouds);
+		std::cout << "could not read " << points_3D_file_name << " (do_log_3D of the server) => " << point_clouds.size() << " random point clouds" << std::endl;
+	}
+
+	for (int t = 0; t < m_track.num_templates; t++)
+	{
+		std::vector<cv::Mat> RT_reference(point_clouds.size()), RT(point_clouds.size());
+		std::vector<float> avg_dev_reference(point_clouds.size()), avg_dev(point_clouds.size());
+
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+		for (int r = 0; r < num_repetitions; r++)
+			for (size_t f = 0; f < point_clouds.size(); f++)
+				fit_template_reference(m_track, point_clouds[f], t, RT_reference[f], &avg_dev_reference[f]);
+		double time_reference = time_per_call_us(start_time, num_repetitions * (int)point_clouds.size());
+
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		for (int r = 0; r < num_repetitions; r++)
+			for (size_t f = 0; f < point_clouds.size(); f++)
+				m_track.fit3DPointsToObjectTemplate(point_clouds[f], t, RT[f], &avg_dev[f]);
+		double time_workspace = time_per_call_us(start_time, num_repetitions * (int)point_clouds.size());
+
+		// Same poses found?
+		int num_found = 0, num_different = 0;
+		for (size_t f = 0; f < point_clouds.size(); f++)
+		{
+			if (countNonZero(RT_reference[f]))
+				num_found++;
+			if (cv::norm(RT[f] - RT_reference[f], cv::NORM_INF) > max_pose_diff * std::max(1.0, cv::norm(RT_reference[f], cv::NORM_INF)) ||
+				fabs(avg_dev[f] - avg_dev_reference[f]) > max_pose_diff * avg_dev_reference[f])
+				num_different++;
+		}
+
+		std::cout << "Template_" << t + 1 << " (" << m_track.object_templates[t].cols << " points): reference " << time_reference
+				  << " us, workspace " << time_workspace << " us (x" << time_reference / time_workspace << "), found "
+				  << num_found << "/" << point_clouds.size() << ", " << num_different << " different" << std::endl;
+	}
+
+	// All templates per frame: one call per template vs fit3DPointsToObjectTemplates() (shared sorted edges, parallel)
+	int num_templates = std::max(m_track.num_templates, 0);
+	std::vector<std::vector<cv::Mat> > RT_single(point_clouds.size(), std::vector<cv::Mat>(num_templates)), RT_all(point_clouds.size());
+	std::vector<std::vector<float> > avg_dev_single(point_clouds.size(), std::vector<float>(num_templates)), avg_dev_all(point_clouds.size());
+
+	boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int r = 0; r < num_repetitions; r++)
+		for (size_t f = 0; f < point_clouds.size(); f++)
+			for (int t = 0; t < num_templates; t++)
+				m_track.fit3DPointsToObjectTemplate(point_clouds[f], t, RT_single[f][t], &avg_dev_single[f][t]);
+	double time_single = time_per_call_us(start_time, num_repetitions * (int)point_clouds.size());
+
+	start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int r = 0; r < num_repetitions; r++)
+		for (size_t f = 0; f < point_clouds.size(); f++)
+			m_track.fit3DPointsToObjectTemplates(point_clouds[f], RT_all[f], avg_dev_all[f]);
+	double time_all = time_per_call_us(start_time, num_repetitions * (int)point_clouds.size());
+
+	// (matches of equal edge distance may be tested in an other order => rarely an other pose of equal residuum)
+	int num_different = 0;
+	for (size_t f = 0; f < point_clouds.size(); f++)
+		for (int t = 0; t < num_templates; t++)
+			if (cv::norm(RT_all[f][t] - RT_single[f][t], cv::NORM_INF) > max_pose_diff * std::max(1.0, cv::norm(RT_single[f][t], cv::NORM_INF)))
+				num_different++;
+
+	std::cout << "All " << num_templates << " templates per frame: one call per template " << time_single
+			  << " us, fit3DPointsToObjectTemplates " << time_all << " us (x" << time_single / time_all << "), "
+			  << num_different << " different poses" << std::endl;
+}
+
+
+// Random moving point clouds: all templates moving at constant (random) velocities (with noise) plus clutter points
+static void moving_point_clouds(const tiy::MarkerTracking& m_track, int num_clouds, int num_clutter_points, cv::RNG& rng, std::vector<cv::Mat>& point_clouds)
+{
+	std::vector<cv::Mat> RT_templates, RT_velocities;
+	for (int t = 0; t < m_track.num_templates; t++)
+	{
+		cv::Mat RT = cv::Mat::eye(4, 4, CV_32F), RT_velocity = cv::Mat::eye(4, 4, CV_32F);
+		cv::Mat rotation_vector = (cv::Mat_<float>(3,1) << rng.uniform(-3.1f, 3.1f), rng.uniform(-3.1f, 3.1f), rng.uniform(-3.1f, 3.1f));
+		cv::Mat R = RT(cv::Range(0,3), cv::Range(0,3));
+		cv::Rodrigues(rotation_vector, R);
+		RT.at<float>(0,3) = rng.uniform(-800.0f, 800.0f);
+		RT.at<float>(1,3) = rng.uniform(-800.0f, 800.0f);
+		RT.at<float>(2,3) = rng.uniform(1500.0f, 3500.0f);
+
+		// (up to 0.03 rad and 15 mm per frame)
+		cv::Mat rotation_velocity = (cv::Mat_<float>(3,1) << rng.uniform(-0.017f, 0.017f), rng.uniform(-0.017f, 0.017f), rng.uniform(-0.017f, 0.017f));
+		cv::Mat R_velocity = RT_velocity(cv::Range(0,3), cv::Range(0,3));
+		cv::Rodrigues(rotation_velocity, R_velocity);
+		for (int j = 0; j < 3; j++)
+			RT_velocity.at<float>(j,3) = rng.uniform(-8.6f, 8.6f);
+
+		RT_templates.push_back(RT);
+		RT_velocities.push_back(RT_velocity);
+	}
+
+	std::vector<cv::Point3f> points;
+	for (int f = 0; f < num_clouds; f++)
+	{
+		points.clear();
+		for (int t = 0; t < m_track.num_templates; t++)
+		{
+			// (rotation about the template origin)
+			cv::Mat RT_next = RT_velocities[t] * RT_templates[t];
+			for (int j = 0; j < 3; j++)
+				RT_next.at<float>(j,3) = RT_templates[t].at<float>(j,3) + RT_velocities[t].at<float>(j,3);
+			RT_templates[t] = RT_next;
+
+			cv::Mat template_points = RT_templates[t] * m_track.object_templates[t];
+			for (int p = 0; p < template_points.cols; p++)
+				points.push_back(cv::Point3f(template_points.at<float>(0, p) + (float)rng.gaussian(0.5),
+											 template_points.at<float>(1, p) + (float)rng.gaussian(0.5),
+											 template_points.at<float>(2, p) + (float)rng.gaussian(0.5)));
+		}
+
+		for (int p = 0; p < num_clutter_points; p++)
+			points.push_back(cv::Point3f(rng.uniform(-1000.0f, 1000.0f), rng.uniform(-1000.0f, 1000.0f), rng.uniform(1500.0f, 3500.0f)));
+
+		// Unordered detections
+		for (int i = (int)points.size() - 1; i > 0; i--)
+			std::swap(points[i], points[rng.uniform(0, i + 1)]);
+
+		cv::Mat points_3D = cv::Mat::ones(4, (int)points.size(), CV_32F);
+		for (int p = 0; p < (int)points.size(); p++)
+		{
+			points_3D.at<float>(0, p) = points[p].x;
+			points_3D.at<float>(1, p) = points[p].y;
+			points_3D.at<float>(2, p) = points[p].z;
+		}
+
+		point_clouds.push_back(points_3D);
+	}
+}
+
+
+static void benchmark_template_tracking(tiy::MarkerTracking& m_track, const char *points_3D_file_name)
+{
+	std::cout << "--- Template tracking (template_tracking_gate 30 mm) ---" << std::endl;
+
+	float template_tracking_gate = m_track.template_tracking_gate;
+	const float max_pose_diff = 1e-2f;
+
+	// (a recorded sequence, as the tracking needs continuous motion)
+	std::vector<cv::Mat> point_clouds;
+	if (read_points_3D_log(points_3D_file_name, point_clouds))
+		std::cout << point_clouds.size() << " recorded point clouds of " << points_3D_file_name << std::endl;
+	else
+	{
+		cv::RNG rng(42);
+		moving_point_clouds(m_track, 1000, 5, rng, point_clouds);
+		std::cout << "could not read " << points_3D_file_name << " (do_log_3D of the server) => " << point_clouds.size() << " moving point clouds" << std::endl;
+	}
+
+	int num_templates = std::max(m_track.num_templates, 0);
+	std::vector<tiy::MarkerTracking::TemplateTrackingStatistics> statistics_before(num_templates);
+	for (int t = 0; t < num_templates; t++)
+		statistics_before[t] = m_track.getTemplateTrackingStatistics(t);
+
+	std::vector<cv::Mat> RT_search, RT_tracking;
+	std::vector<float> avg_dev_search, avg_dev_tracking;
+	std::vector<int> num_found_search(num_templates, 0), num_found_tracking(num_templates, 0), num_different(num_templates, 0);
+	double time_search = 0.0, time_tracking = 0.0;
+
+	for (size_t f = 0; f < point_clouds.size(); f++)
+	{
+		m_track.template_tracking_gate = 0.0f;
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+		m_track.fit3DPointsToObjectTemplates(point_clouds[f], RT_search, avg_dev_search);
+		time_search += time_per_call_us(start_time, 1);
+
+		m_track.template_tracking_gate = 30.0f;
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		m_track.fit3DPointsToObjectTemplates(point_clouds[f], RT_tracking, avg_dev_tracking);
+		time_tracking += time_per_call_us(start_time, 1);
+
+		for (int t = 0; t < num_templates; t++)
+		{
+			bool is_found_search = (avg_dev_search[t] != std::numeric_limits<float>::infinity());
+			bool is_found_tracking = (avg_dev_tracking[t] != std::numeric_limits<float>::infinity());
+			if (is_found_search)
+				num_found_search[t]++;
+			if (is_found_tracking)
+				num_found_tracking[t]++;
+			if (is_found_search != is_found_tracking || (is_found_search &&
+					cv::norm(RT_tracking[t] - RT_search[t], cv::NORM_INF) > max_pose_diff * std::max(1.0, cv::norm(RT_search[t], cv::NORM_INF))))
+				num_different[t]++;
+		}
+	}
+
+	if (point_clouds.empty())
+		return;
+
+	std::cout << "full search " << time_search / point_clouds.size() << " us, tracking " << time_tracking / point_clouds.size()
+			  << " us (x" << time_search / time_tracking << ") per frame" << std::endl;
+	for (int t = 0; t < num_templates; t++)
+	{
+		tiy::MarkerTracking::TemplateTrackingStatistics statistics = m_track.getTemplateTrackingStatistics(t);
+		std::cout << "  Template_" << t + 1 << ": found " << num_found_search[t] << " (full search) / " << num_found_tracking[t]
+				  << " (tracking), " << num_different[t] << " different, " << statistics.num_tracked - statistics_before[t].num_tracked << " tracked, "
+				  << statistics.num_full_searches - statistics_before[t].num_full_searches << " full searches, "
+				  << statistics.num_losses - statistics_before[t].num_losses << " losses" << std::endl;
+	}
+
+	m_track.template_tracking_gate = template_tracking_gate;
+}
+
+
+// -------------------------------------------------------------------------------------
+// Least-squares fit of two point sets
+// -------------------------------------------------------------------------------------
+
+// Former MarkerTracking::fitTwoPointSets() (cv::Mat, cv::SVD)
+static void fit_two_point_sets_reference(const cv::Mat &point_set_0, const cv::Mat &point_set_1, int num_points, cv::Mat &RT, float *avg_deviation)
+{
+    // Minimizes point_set_1 - RT*point_set_0 in the least-squares sense. Fast implementation.
+    //
+    // Arun, Huang & Blostein 1987: Least-Squares Fittig of Two 3-D Point Sets
+    // see http://www.math.ltu.se/courses/c0002m/least_squares.pdf page 11
+    // http://portal.acm.org/citation.cfm?id=28821
+    // http://portal.acm.org/citation.cfm?id=105525
+    //
+    // Andre Gaschler, 2010
+
+    assert(num_points<=point_set_0.cols && num_points<=point_set_1.cols);
+
+    cv::Scalar centroid[2][3];
+    cv::Mat point_set_0_c(3,num_points,CV_32F), point_set_1_c(3,num_points,CV_32F), C(num_points,num_points,CV_32F), t(3,1,CV_32F);
+
+    for(int j = 0; j<3; j++)
+      {
+        centroid[0][j] = mean(point_set_0.row(j));
+        centroid[1][j] = mean(point_set_1.row(j));
+        point_set_0_c.row(j) = point_set_0.row(j) - centroid[0][j][0];
+        point_set_1_c.row(j) = point_set_1.row(j) - centroid[1][j][0];
+      }
+
+    C = point_set_1_c * point_set_0_c.t();
+    cv::SVD C_svd(C);
+
+    //det(U*V') Umeyama correction
+    float det_U_Vt = (float)cv::determinant(C_svd.u * C_svd.vt);
+    cv::Mat Det_U_Vt = cv::Mat::eye(3,3,CV_32F);
+    Det_U_Vt.at<float>(2,2) = det_U_Vt;
+
+    RT = cv::Mat::eye(4,4,CV_32F);
+
+    cv::Mat R = RT(cv::Range(0,3),cv::Range(0,3));
+    R = C_svd.u * Det_U_Vt * C_svd.vt;
+
+    cv::Mat point_set_0_centroid(3,1,CV_32F), point_set_1_centroid(3,1,CV_32F);
+    for(int j = 0; j<3; j++)
+      {
+        point_set_0_centroid.at<float>(j,0) = (float)centroid[0][j][0];
+        point_set_1_centroid.at<float>(j,0) = (float)centroid[1][j][0];
+      }
+
+    t = RT(cv::Range(0,3),cv::Range(3,4));
+    t = point_set_1_centroid - (R * point_set_0_centroid);
+
+    // calculate average deviation
+    cv::Mat point_set_1_t(3,num_points,CV_32F), dev(3,num_points,CV_32F);
+    point_set_1_t.row(0) = point_set_1.row(0) - t.at<float>(0,0);
+    point_set_1_t.row(1) = point_set_1.row(1) - t.at<float>(1,0);
+    point_set_1_t.row(2) = point_set_1.row(2) - t.at<float>(2,0);
+
+    dev = point_set_1_t - (R * point_set_0);
+    float dev_point, dev_sum=0;
+    for(int i = 0; i<num_points; i++)
+      {
+        dev_point = (float)norm(dev.col(i));
+        dev_sum += dev_point;
+      }
+
+    *avg_deviation = dev_sum / num_points;
+}
+
+
+// Fit of random point sets (a random rigid transformation of NUM_POINTS points plus noise)
+template <int NUM_POINTS>
+static void benchmark_point_set_fit_size(cv::RNG& rng)
+{
+	const int num_sets = 1000, num_repetitions = 20;
+
+	std::vector<cv::Mat> point_sets_0(num_sets), point_sets_1(num_sets);
+	for (int s = 0; s < num_sets; s++)
+	{
+		cv::Mat rotation_vector = (cv::Mat_<float>(3,1) << rng.uniform(-3.1f, 3.1f), rng.uniform(-3.1f, 3.1f), rng.uniform(-3.1f, 3.1f));
+		cv::Mat R;
+		cv::Rodrigues(rotation_vector, R);
+
+		point_sets_0[s].create(3, NUM_POINTS, CV_32F);
+		for (int i = 0; i < NUM_POINTS; i++)
+		{
+			point_sets_0[s].at<float>(0, i) = rng.uniform(-500.0f, 500.0f);
+			point_sets_0[s].at<float>(1, i) = rng.uniform(-500.0f, 500.0f);
+			point_sets_0[s].at<float>(2, i) = rng.uniform(-50.0f, 50.0f);
+		}
+		float t[3] = { rng.uniform(-800.0f, 800.0f), rng.uniform(-800.0f, 800.0f), rng.uniform(1500.0f, 3500.0f) };
+
+		point_sets_1[s] = R * point_sets_0[s];
+		for (int i = 0; i < NUM_POINTS; i++)
+			for (int j = 0; j < 3; j++)
+				point_sets_1[s].at<float>(j, i) += t[j] + (float)rng.gaussian(0.5);
+	}
+
+	std::vector<cv::Mat> RT_reference(num_sets), RT(num_sets);
+	std::vector<float> avg_dev_reference(num_sets), avg_dev(num_sets);
+
+	boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int r = 0; r < num_repetitions; r++)
+		for (int s = 0; s < num_sets; s++)
+			fit_two_point_sets_reference(point_sets_0[s], point_sets_1[s], NUM_POINTS, RT_reference[s], &avg_dev_reference[s]);
+	double time_reference = time_per_call_us(start_time, num_repetitions * num_sets);
+
+	start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int r = 0; r < num_repetitions; r++)
+		for (int s = 0; s < num_sets; s++)
+			tiy::MarkerTracking::fitTwoPointSets(point_sets_0[s], point_sets_1[s], NUM_POINTS, RT[s], &avg_dev[s]);
+	double time_mat = time_per_call_us(start_time, num_repetitions * num_sets);
+
+	// Point sets already on the stack (templated point count)
+	std::vector<float> points(num_sets * 2 * 3 * NUM_POINTS);
+	for (int s = 0; s < num_sets; s++)
+		for (int j = 0; j < 3; j++)
+			for (int i = 0; i < NUM_POINTS; i++)
+			{
+				points[((s*2 + 0)*3 + j)*NUM_POINTS + i] = point_sets_0[s].at<float>(j, i);
+				points[((s*2 + 1)*3 + j)*NUM_POINTS + i] = point_sets_1[s].at<float>(j, i);
+			}
+
+	std::vector<float> RT_fixed(num_sets * 16), avg_dev_fixed(num_sets);
+	start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int r = 0; r < num_repetitions; r++)
+		for (int s = 0; s < num_sets; s++)
+		{
+			float point_set_0[3][NUM_POINTS], point_set_1[3][NUM_POINTS];
+			memcpy(point_set_0, &points[(s*2 + 0)*3*NUM_POINTS], sizeof(point_set_0));
+			memcpy(point_set_1, &points[(s*2 + 1)*3*NUM_POINTS], sizeof(point_set_1));
+			avg_dev_fixed[s] = tiy::fitPointSets<NUM_POINTS>(point_set_0, point_set_1, &RT_fixed[16*s]);
+		}
+	double time_fixed = time_per_call_us(start_time, num_repetitions * num_sets);
+
+	// Maximum difference of the rotation and translation [mm] and of the average deviation [mm]
+	double max_rotation_diff = 0, max_translation_diff = 0, max_avg_dev_diff = 0;
+	for (int s = 0; s < num_sets; s++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			for (int k = 0; k < 3; k++)
+				max_rotation_diff = std::max(max_rotation_diff, std::max(fabs(RT[s].at<float>(j, k) - RT_reference[s].at<float>(j, k)),
+																		 fabs(RT_fixed[16*s + 4*j + k] - RT_reference[s].at<float>(j, k))));
+			max_translation_diff = std::max(max_translation_diff, std::max(fabs(RT[s].at<float>(j, 3) - RT_reference[s].at<float>(j, 3)),
+																		   fabs(RT_fixed[16*s + 4*j + 3] - RT_reference[s].at<float>(j, 3))));
+		}
+		max_avg_dev_diff = std::max(max_avg_dev_diff, std::max(fabs(avg_dev[s] - avg_dev_reference[s]), fabs(avg_dev_fixed[s] - avg_dev_reference[s])));
+	}
+
+	std::cout << NUM_POINTS << " points: cv::SVD " << time_reference << " us, fitTwoPointSets() " << time_mat << " us (x" << time_reference / time_mat
+			  << "), fitPointSets<" << NUM_POINTS << ">() " << time_fixed << " us (x" << time_reference / time_fixed << "), max. diff. rotation "
+			  << max_rotation_diff << ", translation " << max_translation_diff << " mm, avg. deviation " << max_avg_dev_diff << " mm" << std::endl;
+}
+
+
+static void benchmark_point_set_fit()
+{
+	std::cout << "--- Least-squares fit of two point sets ---" << std::endl;
+
+	cv::RNG rng(42);
+	benchmark_point_set_fit_size<4>(rng);
+	benchmark_point_set_fit_size<7>(rng);
+	benchmark_point_set_fit_size<20>(rng);
+}
+
+
+// -------------------------------------------------------------------------------------
+// Pose filters (Kalman filter per template)
+// -------------------------------------------------------------------------------------
+
+// True pose of the "s"th template at "t" [s]: moving on an ellipse, rotating around a fixed axis
+static void true_pose(int s, double t, float RT[16])
+{
+	const double phase = 0.3 * s;
+	cv::Mat rotation_vector = (cv::Mat_<float>(3,1) << (float)(0.5 + 0.6 * t), (float)(0.2 * s - 0.8 * t), (float)(0.3 * sin(2.0 * t + phase)));
+	cv::Mat R;
+	cv::Rodrigues(rotation_vector, R);
+	const float T[3] = { (float)(-200.0 + 20.0 * s + 150.0 * cos(1.5 * t + phase)), (float)(100.0 + 100.0 * sin(1.5 * t + phase)), (float)(2000.0 + 10.0 * s) };
+	for (int j = 0; j < 3; j++)
+	{
+		for (int k = 0; k < 3; k++)
+			RT[4*j + k] = R.at<float>(j, k);
+		RT[4*j + 3] = T[j];
+	}
+	RT[12] = RT[13] = RT[14] = 0; RT[15] = 1;
+}
+
+
+// Position [mm] and orientation [rad] difference of two poses (4x4, row major)
+static void pose_difference(const float RT_0[16], const float RT_1[16], double *position_diff, double *orientation_diff)
+{
+	double trace = 0;
+	for (int j = 0; j < 3; j++)
+		for (int k = 0; k < 3; k++)
+			trace += RT_0[4*k + j] * RT_1[4*k + j];
+	*orientation_diff = acos(std::max(-1.0, std::min(1.0, (trace - 1.0) / 2.0)));
+	*position_diff = sqrt((RT_0[3] - RT_1[3])*(RT_0[3] - RT_1[3]) + (RT_0[7] - RT_1[7])*(RT_0[7] - RT_1[7]) + (RT_0[11] - RT_1[11])*(RT_0[11] - RT_1[11]));
+}
+
+
+static void benchmark_pose_filters(const tiy::MarkerTracking& m_track)
+{
+	std::cout << "--- Pose filters ---" << std::endl;
+
+	// 20 templates at about 60 Hz (jitter, dropped frames), measured with the configured noise
+	const int num_templates = 20, num_frames = 2000;
+	const long long latency_us = 20000;
+	cv::RNG rng(42);
+
+	std::vector<long long> timestamps;
+	long long timestamp_us = 0;
+	for (int f = 0; f < num_frames; f++)
+	{
+		timestamp_us += 16667 + rng.uniform(-2000, 2000);
+		if (rng.uniform(0.0f, 1.0f) < 0.05f)
+			continue;
+		timestamps.push_back(timestamp_us);
+	}
+
+	const int num_used_frames = (int)timestamps.size();
+	std::vector<float> poses_true(num_used_frames * num_templates * 16), poses_measured(num_used_frames * num_templates * 16);
+	for (int f = 0; f < num_used_frames; f++)
+		for (int s = 0; s < num_templates; s++)
+		{
+			float *RT_true = &poses_true[16*(f*num_templates + s)], *RT_measured = &poses_measured[16*(f*num_templates + s)];
+			true_pose(s, 1e-6 * timestamps[f], RT_true);
+
+			cv::Mat rotation_noise = (cv::Mat_<float>(3,1) << (float)rng.gaussian(m_track.pose_filter_orientation_noise),
+					(float)rng.gaussian(m_track.pose_filter_orientation_noise), (float)rng.gaussian(m_track.pose_filter_orientation_noise));
+			cv::Mat R_noise;
+			cv::Rodrigues(rotation_noise, R_noise);
+			for (int j = 0; j < 3; j++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					RT_measured[4*j + k] = 0;
+					for (int l = 0; l < 3; l++)
+						RT_measured[4*j + k] += R_noise.at<float>(j, l) * RT_true[4*l + k];
+				}
+				RT_measured[4*j + 3] = RT_true[4*j + 3] + (float)rng.gaussian(m_track.pose_filter_position_noise);
+			}
+			RT_measured[12] = RT_measured[13] = RT_measured[14] = 0; RT_measured[15] = 1;
+		}
+
+	std::vector<tiy::PoseFilter> pose_filters(num_templates);
+	for (int s = 0; s < num_templates; s++)
+		pose_filters[s].setNoise(m_track.pose_filter_position_noise, m_track.pose_filter_orientation_noise,
+				m_track.pose_filter_acceleration_noise, m_track.pose_filter_angular_acceleration_noise);
+
+	// Former filter: cv::KalmanFilter (cv::Mat matrices) of position and Rodrigues vector with their velocities
+	std::vector<cv::KalmanFilter> kalman_filters(num_templates);
+	for (int s = 0; s < num_templates; s++)
+	{
+		kalman_filters[s] = cv::KalmanFilter(12, 6, 0);
+		setIdentity(kalman_filters[s].measurementMatrix);
+		setIdentity(kalman_filters[s].processNoiseCov, cv::Scalar::all(1e-2));
+		setIdentity(kalman_filters[s].measurementNoiseCov, cv::Scalar::all(1e-1));
+		setIdentity(kalman_filters[s].errorCovPost, cv::Scalar::all(1));
+	}
+
+	boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+	cv::Mat measurement(6, 1, CV_32F), rotation_vector;
+	for (int f = 0; f < num_used_frames; f++)
+	{
+		const float delta_t = f > 0 ? 1e-6f * (timestamps[f] - timestamps[f-1]) : 0.0f;
+		for (int s = 0; s < num_templates; s++)
+		{
+			const float *RT_measured = &poses_measured[16*(f*num_templates + s)];
+			cv::Mat R(3, 3, CV_32F);
+			for (int j = 0; j < 3; j++)
+				for (int k = 0; k < 3; k++)
+					R.at<float>(j, k) = RT_measured[4*j + k];
+			cv::Rodrigues(R, rotation_vector);
+			for (int j = 0; j < 3; j++)
+			{
+				measurement.at<float>(j) = RT_measured[4*j + 3];
+				measurement.at<float>(3 + j) = rotation_vector.at<float>(j);
+			}
+			setIdentity(kalman_filters[s].transitionMatrix);
+			for (int j = 0; j < 6; j++)
+				kalman_filters[s].transitionMatrix.at<float>(j, 6 + j) = delta_t;
+			kalman_filters[s].predict();
+			kalman_filters[s].correct(measurement);
+		}
+	}
+	double time_reference = time_per_call_us(start_time, num_used_frames);
+
+	// Errors after the first second (filters settled)
+	double position_error_raw = 0, orientation_error_raw = 0, position_error = 0, orientation_error = 0;
+	double position_error_hold = 0, orientation_error_hold = 0, position_error_predicted = 0, orientation_error_predicted = 0;
+	int num_errors = 0;
+	double time_filter = 0;
+	for (int f = 0; f < num_used_frames; f++)
+	{
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		for (int s = 0; s < num_templates; s++)
+			pose_filters[s].update(timestamps[f], &poses_measured[16*(f*num_templates + s)]);
+		time_filter += time_per_call_us(start_time, 1);
+
+		if (timestamps[f] < 1000000)
+			continue;
+
+		for (int s = 0; s < num_templates; s++)
+		{
+			const float *RT_true = &poses_true[16*(f*num_templates + s)], *RT_measured = &poses_measured[16*(f*num_templates + s)];
+			float RT_filtered[16], RT_predicted[16], RT_true_later[16];
+			double position_diff, orientation_diff;
+
+			pose_filters[s].getPose(RT_filtered);
+			pose_difference(RT_measured, RT_true, &position_diff, &orientation_diff);
+			position_error_raw += position_diff; orientation_error_raw += orientation_diff;
+			pose_difference(RT_filtered, RT_true, &position_diff, &orientation_diff);
+			position_error += position_diff; orientation_error += orientation_diff;
+
+			// Latency compensation: pose used "latency_us" after the frame (last measured pose vs. predicted pose)
+			true_pose(s, 1e-6 * (timestamps[f] + latency_us), RT_true_later);
+			pose_filters[s].predictPose(timestamps[f] + latency_us, RT_predicted);
+			pose_difference(RT_measured, RT_true_later, &position_diff, &orientation_diff);
+			position_error_hold += position_diff; orientation_error_hold += orientation_diff;
+			pose_difference(RT_predicted, RT_true_later, &position_diff, &orientation_diff);
+			position_error_predicted += position_diff; orientation_error_predicted += orientation_diff;
+			num_errors++;
+		}
+	}
+	time_filter /= num_used_frames;
+
+	std::cout << num_templates << " templates, " << num_used_frames << " frames: cv::KalmanFilter " << time_reference << " us, PoseFilter "
+			  << time_filter << " us per frame (x" << time_reference / time_filter << ")" << std::endl;
+	std::cout << "Mean error measured " << position_error_raw / num_errors << " mm " << orientation_error_raw / num_errors << " rad, filtered "
+			  << position_error / num_errors << " mm " << orientation_error / num_errors << " rad" << std::endl;
+	std::cout << "Mean error " << latency_us / 1000 << " ms later: last measured " << position_error_hold / num_errors << " mm "
+			  << orientation_error_hold / num_errors << " rad, predicted " << position_error_predicted / num_errors << " mm "
+			  << orientation_error_predicted / num_errors << " rad" << std::endl;
+}
+
+
+// -------------------------------------------------------------------------------------
+// Multicast publishing of the poses
+// -------------------------------------------------------------------------------------
+
+// Former MulticastServer::sendString(): string by value, a mutex and one async_send_to() per message
+// (here with the payload kept alive until the completion, which the former one did not)
+class MulticastSenderReference
+{
+public:
+	MulticastSenderReference(boost::asio::io_service& io_service, const boost::asio::ip::udp::endpoint& endpoint)
+		: endpoint_(endpoint), socket_(io_service, endpoint.protocol()), go_on(true) {};
+
+	void sendString(std::string send_string)
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			if (!go_on)
+				return;
+		}
+		boost::shared_ptr<std::string> send_buffer(new std::string(send_string));
+		socket_.async_send_to(boost::asio::buffer(*send_buffer), endpoint_,
+								boost::bind(&MulticastSenderReference::handleSend, this, boost::asio::placeholders::error, send_buffer));
+	}
+
+private:
+	void handleSend(const boost::system::error_code& error, boost::shared_ptr<std::string> send_buffer)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if (error)
+			go_on = false;
+	}
+
+	boost::asio::ip::udp::endpoint endpoint_;
+	boost::asio::ip::udp::socket socket_;
+	bool go_on;
+	boost::mutex mutex_;
+};
+
+
+// Text message of the server (object poses: timestamp, template, position, Rodrigues vector)
+static std::string pose_text_message(long long frame_timestamp, const std::vector<cv::Mat>& RT_templates)
+{
+	std::string send_string;
+	for (int r = 0; r < (int)RT_templates.size(); r++)
+	{
+		cv::Mat rodrigues_orientation = cv::Mat::zeros(3, 1, CV_32F);
+		Rodrigues(RT_templates[r](cv::Range(0,3),cv::Range(0,3)), rodrigues_orientation);
+
+		std::stringstream frame_timestamp_ss;
+		frame_timestamp_ss << frame_timestamp;
+		send_string += (boost::format("%s\t%d\t%.4f\t%.4f\t%.4f\t%.4f\t%.4f\t%.4f\t") % frame_timestamp_ss.str() % r
+						% RT_templates[r].at<float>(0,3) % RT_templates[r].at<float>(1,3) % RT_templates[r].at<float>(2,3)
+						% rodrigues_orientation.at<float>(0,0) % rodrigues_orientation.at<float>(1,0) % rodrigues_orientation.at<float>(2,0) ).str();
+	}
+	return send_string;
+}
+
+
+static void pose_binary_message(long long frame_timestamp, const std::vector<cv::Mat>& RT_templates, tiy::PoseMessage& message, std::vector<char>& buffer)
+{
+	message.timestamp_us = frame_timestamp;
+	message.sequence_number++;
+	message.poses.resize(RT_templates.size());
+	for (int r = 0; r < (int)RT_templates.size(); r++)
+		message.poses[r].setTransformation(r, RT_templates[r].ptr<float>(0), 0.1f);
+	tiy::encodePoseMessage(message, buffer);
+}
+
+
+static void benchmark_multicast()
+{
+	std::cout << "--- Multicast publishing (object and virtual point poses, 10 templates, 239.255.0.1:30001) ---" << std::endl;
+
+	const int num_templates = 10, num_repetitions = 2000;
+	const int frame_rates[3] = { 100, 500, 1000 };
+
+	cv::RNG rng(42);
+	std::vector<cv::Mat> RT_templates(num_templates);
+	for (int r = 0; r < num_templates; r++)
+	{
+		cv::Mat rodrigues_orientation = (cv::Mat_<float>(3,1) << rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f), rng.uniform(-1.0f, 1.0f));
+		cv::Mat R;
+		Rodrigues(rodrigues_orientation, R);
+		RT_templates[r] = cv::Mat::eye(4, 4, CV_32F);
+		cv::Mat RT_rotation = RT_templates[r](cv::Range(0,3),cv::Range(0,3));
+		R.copyTo(RT_rotation);
+		RT_templates[r].at<float>(0,3) = rng.uniform(-500.0f, 500.0f);
+		RT_templates[r].at<float>(1,3) = rng.uniform(-500.0f, 500.0f);
+		RT_templates[r].at<float>(2,3) = rng.uniform(1500.0f, 3500.0f);
+	}
+
+	// Encoding
+	std::string send_string;
+	boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int i = 0; i < num_repetitions; i++)
+		send_string = pose_text_message(i, RT_templates);
+	double time_text = time_per_call_us(start_time, num_repetitions);
+
+	tiy::PoseMessage message;
+	std::vector<char> send_data;
+	start_time = boost::posix_time::microsec_clock::universal_time();
+	for (int i = 0; i < num_repetitions; i++)
+		pose_binary_message(i, RT_templates, message, send_data);
+	double time_binary = time_per_call_us(start_time, num_repetitions);
+
+	std::cout << "encoding: text " << time_text << " us (" << send_string.size() << " bytes), binary " << time_binary << " us ("
+			  << send_data.size() << " bytes, x" << time_text / time_binary << ")" << std::endl;
+
+	// Sending 2 messages per frame at the given frame rates for 1 s each
+	boost::asio::io_service io_service;
+	boost::asio::io_service::work io_service_work(io_service);
+	boost::thread io_service_thread(boost::bind(&boost::asio::io_service::run, &io_service));
+
+	int multicast_port = 30001;
+	boost::asio::ip::address multicast_address = boost::asio::ip::address::from_string("239.255.0.1");
+	MulticastSenderReference sender_reference(io_service, boost::asio::ip::udp::endpoint(multicast_address, multicast_port));
+	tiy::MulticastServer multicast_server(io_service, multicast_address, multicast_port, false);
+
+	// Modes: reference and batched with the same text payload (send path only), batched with the binary payload (encoding)
+	const char *mode_names[3] = { "reference (text, async_send_to())", "batched (text, sendmmsg())", "batched (binary, sendmmsg())" };
+	for (int f = 0; f < 3; f++)
+	{
+		double mean_times[3];
+		for (int mode = 0; mode < 3; mode++)
+		{
+			boost::chrono::steady_clock::time_point next_frame_time = boost::chrono::steady_clock::now();
+			double sum_time = 0.0, max_time = 0.0;
+			int num_late = 0;
+
+			boost::posix_time::ptime run_start_time = boost::posix_time::microsec_clock::universal_time();
+			for (int i = 0; i < frame_rates[f]; i++)
+			{
+				start_time = boost::posix_time::microsec_clock::universal_time();
+				if (mode == 0)
+				{
+					sender_reference.sendString(send_string);
+					sender_reference.sendString(send_string);
+				}
+				else if (mode == 1)
+				{
+					multicast_server.addToBatch(send_string);
+					multicast_server.addToBatch(send_string);
+					multicast_server.sendBatch();
+				}
+				else
+				{
+					multicast_server.addToBatch(send_data);
+					multicast_server.addToBatch(send_data);
+					multicast_server.sendBatch();
+				}
+				double time_send = time_per_call_us(start_time, 1);
+				sum_time += time_send;
+				max_time = std::max(max_time, time_send);
+
+				next_frame_time += boost::chrono::microseconds(1000000 / frame_rates[f]);
+				if (boost::chrono::steady_clock::now() > next_frame_time)
+					num_late++;
+				else
+					boost::this_thread::sleep_until(next_frame_time);
+			}
+			double time_run = time_per_call_us(run_start_time, 1) / 1e6;
+			mean_times[mode] = sum_time / frame_rates[f];
+
+			std::cout << frame_rates[f] << " Hz " << mode_names[mode] << ": " << mean_times[mode] << " us per frame (max. " << max_time
+					  << " us), " << frame_rates[f] / time_run << " frames/s, " << num_late << " late" << std::endl;
+		}
+		std::cout << frame_rates[f] << " Hz send path (same text payload): x" << mean_times[0] / mean_times[1]
+				  << ", binary instead of text payload (batched): x" << mean_times[1] / mean_times[2] << std::endl;
+	}
+	std::cout << "dropped messages (batched): " << multicast_server.getNumDroppedMessages() << std::endl;
+
+	io_service.stop();
+	io_service_thread.join();
+}
+
+
+int main(int argc, char* argv[])
+{
+	char *arg_camera_config_file = (char *)"config_camera.xml";
+	char *arg_object_config_file = (char *)"config_object.xml";
+
+	if (argc == 3)
+	{
+		arg_camera_config_file = argv[1];
+		arg_object_config_file = argv[2];
+	}
+	else if (argc != 1)
+	{
+		std::cerr << "Usage: 	benchmark <camera_config_file> <object_config_file>" << std::endl;
+		std::cerr << "default:  benchmark config_camera.xml config_object.xml" << std::endl;
+		return 0;
+	}
+
+	tiy::MarkerTracking m_track(false);
+
+	if (!m_track.readConfigFiles(arg_camera_config_file, arg_object_config_file))
+		return 0;
+
+	benchmark_epipolar_matching(m_track);
+	benchmark_undistortion(m_track);
+
+	const char *video_file_names[2] = { "video_left.avi", "video_right.avi" };
+	benchmark_segmentation(m_track, video_file_names);
+	benchmark_roi_segmentation(m_track, video_file_names);
+	benchmark_centroids(m_track, video_file_names[0]);
+
+	benchmark_template_fitting(m_track, "log_points_3D.dat");
+	benchmark_template_tracking(m_track, "log_points_3D.dat");
+	benchmark_point_set_fit();
+	benchmark_pose_filters(m_track);
+
+	benchmark_multicast();
+
+	return 0;
+}
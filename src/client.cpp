@@ -2,15 +2,19 @@
 // Name        : client.cpp
 // Author      : Andreas Pflaum
 // Description : Multicast client program, using the MulticastClient class
-//				 of the Track-It-Yourself (TIY) library (cross-platform).
-//				 Checking for new data in a loop with an update interval of
-//				 client_update_intervall_ms [ms] and displaying it.
+//				 of the Track-It-Yourself (TIY) library (cross-platform),
+//				 or the SharedMemoryClient class if do_use_shared_memory
+//				 (server on the same host).
+//				 Waiting for new data in a loop (at most
+//				 client_update_intervall_ms [ms] per cycle) and displaying
+//				 every received packet.
 //				 Connection parameters are read from a xml file without
 //				 explicit XML parser.
 // Licence	   : see LICENCE.txt
 //============================================================================
 
 #include "multicastClient/MulticastClient.h"
+#include "sharedMemoryClient/SharedMemoryClient.h"
 
 #include <fstream>
 
@@ -19,6 +23,10 @@
 // (If the value is a string ("value"), the quotation marks will be cut off)
 bool extract_param_from_xml_line(std::string& line, const std::string param_name, std::string& value_str);
 
+// Update loop, displaying every received packet (same for the MulticastClient and the SharedMemoryClient)
+template <class Client>
+void run_update_loop(Client& client, int client_update_intervall_ms);
+
 int main(int argc, char* argv[])
 {
   try
@@ -50,6 +58,9 @@ int main(int argc, char* argv[])
 	int do_output_debug=-1, client_update_intervall_ms=-1;
 	short multicast_port_short=-1;
 	std::string multicast_adress, listen_address;
+	// Optional
+	int do_use_shared_memory = 0;
+	std::string shared_memory_name = SHARED_POSE_RING_NAME;
 
 	std::ifstream xml_file(arg_run_parameter_config_file);
 	std::string line;
@@ -68,6 +79,11 @@ int main(int argc, char* argv[])
 			multicast_adress = value_str;
 		if (extract_param_from_xml_line(line, "listen_address", value_str))
 			listen_address = value_str;
+
+		if (extract_param_from_xml_line(line, "do_use_shared_memory", value_str))
+			do_use_shared_memory = atoi(value_str.c_str());
+		if (extract_param_from_xml_line(line, "shared_memory_name", value_str))
+			shared_memory_name = value_str;
 	}
 
 	if (multicast_port_short==-1 || do_output_debug==-1 || client_update_intervall_ms==-1 ||
@@ -86,42 +102,37 @@ int main(int argc, char* argv[])
 				  << "do_output_debug = " << do_output_debug << std::endl
 				  << "client_update_intervall_ms = " << client_update_intervall_ms << std::endl
 				  << "multicast_adress = " << multicast_adress << std::endl
-				  << "listen_address = " << listen_address << std::endl;
+				  << "listen_address = " << listen_address << std::endl
+				  << "do_use_shared_memory = " << do_use_shared_memory << std::endl
+				  << "shared_memory_name = " << shared_memory_name << std::endl;
 	}
 
 	
 	// -------------------------------------------------------------------------------------
-	// Start Client
+	// Start Client and Run Update Loop
 	// -------------------------------------------------------------------------------------
-    boost::asio::io_service io_service;
-	
-    tiy::MulticastClient multicast_client(io_service,
-        boost::asio::ip::address::from_string(listen_address),
-        boost::asio::ip::address::from_string(multicast_adress),
-        multicast_port_short,
-        do_debugging);
-		
-	// NONBLOCKING service
-    boost::system::error_code error_c;
-	boost::thread io_service_thread(boost::bind(&boost::asio::io_service::run, &io_service, error_c));
+	if (do_use_shared_memory)
+	{
+		// NOT blocking, connects as soon as the server is started
+		tiy::SharedMemoryClient shared_memory_client(shared_memory_name, do_debugging);
 
+		run_update_loop(shared_memory_client, client_update_intervall_ms);
+	}
+	else
+	{
+		boost::asio::io_service io_service;
 
-	// -------------------------------------------------------------------------------------
-	// Run Update Loop
-	// -------------------------------------------------------------------------------------
-	std::string data_string;
+		tiy::MulticastClient multicast_client(io_service,
+			boost::asio::ip::address::from_string(listen_address),
+			boost::asio::ip::address::from_string(multicast_adress),
+			multicast_port_short,
+			do_debugging);
 
-	for(int i = 0; true; i++)
-	{			
-		if (multicast_client.getReceivedString(data_string))
-		{
-			  //////////////////////////////////////////////////
-			 //////////////// DO WHAT YOU WANT ////////////////
-			//////////////////////////////////////////////////
-			std::cout << "Received: " << data_string << std::endl;			
-		}
-		
-		boost::this_thread::sleep(boost::posix_time::milliseconds(client_update_intervall_ms)); 
+		// NONBLOCKING service
+		boost::system::error_code error_c;
+		boost::thread io_service_thread(boost::bind(&boost::asio::io_service::run, &io_service, error_c));
+
+		run_update_loop(multicast_client, client_update_intervall_ms);
 	}
   }
   // -------------------------------------------------------------------------------------
@@ -136,6 +147,54 @@ int main(int argc, char* argv[])
 }
 
 
+template <class Client>
+void run_update_loop(Client& client, int client_update_intervall_ms)
+{
+	std::vector<std::string> data_strings;
+	tiy::PoseMessage pose_message;
+	long long num_dropped_packets = 0;
+
+	for(int i = 0; true; i++)
+	{			
+		// Blocks until data is received (at most client_update_intervall_ms)
+		if (!client.waitForData(client_update_intervall_ms / 1000.0))
+			continue;
+
+		client.getReceivedStrings(data_strings);
+		for (size_t k = 0; k < data_strings.size(); k++)
+		{
+			const std::string& data_string = data_strings[k];
+
+			  //////////////////////////////////////////////////
+			 //////////////// DO WHAT YOU WANT ////////////////
+			//////////////////////////////////////////////////
+			if (tiy::decodePoseMessage(data_string.data(), data_string.size(), pose_message))
+			{
+				// Binary (do_send_binary)
+				std::cout << "Received: " << pose_message.sequence_number << "\t" << pose_message.timestamp_us;
+				for (size_t r = 0; r < pose_message.poses.size(); r++)
+				{
+					const tiy::TemplatePose& pose = pose_message.poses[r];
+					std::cout << "\t" << pose.template_id << "\t" << pose.is_valid
+							  << "\t" << pose.position[0] << "\t" << pose.position[1] << "\t" << pose.position[2]
+							  << "\t" << pose.orientation[0] << "\t" << pose.orientation[1] << "\t" << pose.orientation[2] << "\t" << pose.orientation[3]
+							  << "\t" << pose.residual;
+				}
+				std::cout << std::endl;
+			}
+			else
+				std::cout << "Received: " << data_string << std::endl;			
+		}
+
+		if (client.getNumDroppedPackets() != num_dropped_packets)
+		{
+			num_dropped_packets = client.getNumDroppedPackets();
+			std::cerr << "Dropped packets: " << num_dropped_packets << std::endl;
+		}
+	}
+}
+
+
 bool extract_param_from_xml_line(std::string& line, const std::string param_name, std::string& value_str)
 {
 	value_str = "";
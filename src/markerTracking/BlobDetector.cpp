@@ -0,0 +1,353 @@
+//============================================================================
+// Name        : BlobDetector.cpp
+// Author      : Andre Gaschler, Andreas Pflaum
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "BlobDetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BLOB_DETECTOR_SSE2
+#endif
+
+namespace tiy
+{
+
+BlobDetector::BlobDetector() :
+	centroid_mode(CENTROID_BINARY)
+{
+}
+
+
+void
+BlobDetector::findRuns(const unsigned char *row, int width, unsigned char threshold, std::vector<Run>& runs)
+{
+	Run run;
+	run.label = -1;
+	bool is_in_run = false;
+	int x = 0;
+
+#ifdef BLOB_DETECTOR_SSE2
+	// Unsigned compare (pixel > threshold) as signed compare with flipped sign bits
+	const __m128i sign16 = _mm_set1_epi8((char)0x80);
+	const __m128i threshold16 = _mm_set1_epi8((char)(threshold ^ 0x80));
+
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i pixels = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row + x)), sign16);
+		int mask = _mm_movemask_epi8(_mm_cmpgt_epi8(pixels, threshold16));
+
+		// Nothing changes within these 16 pixels (the usual case: dark background)
+		if ((!is_in_run && mask == 0) || (is_in_run && mask == 0xFFFF))
+			continue;
+
+		for (int i = 0; i < 16; i++)
+		{
+			bool is_bright = ((mask >> i) & 1) != 0;
+			if (is_bright && !is_in_run)
+			{
+				run.x_start = x + i;
+				is_in_run = true;
+			}
+			else if (!is_bright && is_in_run)
+			{
+				run.x_end = x + i - 1;
+				runs.push_back(run);
+				is_in_run = false;
+			}
+		}
+	}
+#endif
+
+	// Scalar fallback (and remaining pixels)
+	for (; x < width; x++)
+	{
+		bool is_bright = row[x] > threshold;
+		if (is_bright && !is_in_run)
+		{
+			run.x_start = x;
+			is_in_run = true;
+		}
+		else if (!is_bright && is_in_run)
+		{
+			run.x_end = x - 1;
+			runs.push_back(run);
+			is_in_run = false;
+		}
+	}
+
+	if (is_in_run)
+	{
+		run.x_end = width - 1;
+		runs.push_back(run);
+	}
+}
+
+
+void
+BlobDetector::sumRowIntensities(const unsigned char *row, int x_start, int x_end, long long& sum_i, long long& sum_ix)
+{
+	int x = x_start;
+	sum_i = 0;
+	sum_ix = 0;
+
+#ifdef BLOB_DETECTOR_SSE2
+	// Per 16 pixels: sum I by _mm_sad_epu8, sum I*(x - x_chunk) by _mm_madd_epi16 with the offsets 0..15
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i offsets_lo = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m128i offsets_hi = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+
+	for (; x + 16 <= x_end + 1; x += 16)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i *)(row + x));
+
+		__m128i sad = _mm_sad_epu8(pixels, zero);
+		int chunk_i = _mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+
+		__m128i weighted = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), offsets_lo),
+										 _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), offsets_hi));
+		weighted = _mm_add_epi32(weighted, _mm_srli_si128(weighted, 8));
+		weighted = _mm_add_epi32(weighted, _mm_srli_si128(weighted, 4));
+		int chunk_ix = _mm_cvtsi128_si32(weighted);
+
+		sum_i += chunk_i;
+		sum_ix += (long long)x * chunk_i + chunk_ix;
+	}
+#endif
+
+	// Scalar fallback (and remaining pixels)
+	for (; x <= x_end; x++)
+	{
+		sum_i += row[x];
+		sum_ix += (long long)x * row[x];
+	}
+}
+
+
+bool
+BlobDetector::fitGaussian(const cv::Mat& image, unsigned char threshold, const cv::Rect& bounding_box, cv::Point2f& center)
+{
+	// ln(I) = a + b*x + c*y + d*x^2 + e*y^2 (coordinates relative to the bounding box center)
+	// => center = (-b/(2d), -c/(2e)), normal equations weighted by I^2
+	double A[5][5] = { { 0.0 } }, B[5] = { 0.0 };
+	double x_center = bounding_box.x + 0.5*(bounding_box.width - 1), y_center = bounding_box.y + 0.5*(bounding_box.height - 1);
+	int num_pixels = 0;
+
+	for (int y = bounding_box.y; y < bounding_box.y + bounding_box.height; y++)
+	{
+		const unsigned char *row = image.ptr<unsigned char>(y);
+		double dy = y - y_center;
+
+		for (int x = bounding_box.x; x < bounding_box.x + bounding_box.width; x++)
+		{
+			if (row[x] <= threshold)
+				continue;
+
+			double dx = x - x_center;
+			double f[5] = { 1.0, dx, dy, dx*dx, dy*dy };
+			double w = (double)row[x] * row[x];
+			double log_i = log((double)row[x]);
+
+			for (int i = 0; i < 5; i++)
+			{
+				for (int j = i; j < 5; j++)
+					A[i][j] += w * f[i] * f[j];
+				B[i] += w * f[i] * log_i;
+			}
+			num_pixels++;
+		}
+	}
+
+	if (num_pixels < 5)
+		return false;
+
+	for (int i = 0; i < 5; i++)
+		for (int j = 0; j < i; j++)
+			A[i][j] = A[j][i];
+
+	// Gaussian elimination with partial pivoting
+	for (int col = 0; col < 5; col++)
+	{
+		int pivot = col;
+		for (int row = col + 1; row < 5; row++)
+			if (fabs(A[row][col]) > fabs(A[pivot][col]))
+				pivot = row;
+
+		if (fabs(A[pivot][col]) < 1e-9 * A[0][0])
+			return false;
+
+		if (pivot != col)
+		{
+			for (int j = 0; j < 5; j++)
+				std::swap(A[col][j], A[pivot][j]);
+			std::swap(B[col], B[pivot]);
+		}
+
+		for (int row = col + 1; row < 5; row++)
+		{
+			double factor = A[row][col] / A[col][col];
+			for (int j = col; j < 5; j++)
+				A[row][j] -= factor * A[col][j];
+			B[row] -= factor * B[col];
+		}
+	}
+
+	double p[5];
+	for (int row = 4; row >= 0; row--)
+	{
+		double sum = B[row];
+		for (int j = row + 1; j < 5; j++)
+			sum -= A[row][j] * p[j];
+		p[row] = sum / A[row][row];
+	}
+
+	// No maximum (d, e >= 0) or center outside the bounding box => no Gaussian
+	if (p[3] >= 0.0 || p[4] >= 0.0)
+		return false;
+
+	double dx0 = -p[1] / (2.0*p[3]), dy0 = -p[2] / (2.0*p[4]);
+	if (fabs(dx0) > 0.5*bounding_box.width || fabs(dy0) > 0.5*bounding_box.height)
+		return false;
+
+	center.x = (float)(x_center + dx0);
+	center.y = (float)(y_center + dy0);
+
+	return true;
+}
+
+
+int
+BlobDetector::findRoot(int label)
+{
+	while (parent[label] != label)
+	{
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
+}
+
+
+int
+BlobDetector::detect(const cv::Mat& image, unsigned char threshold, std::vector<cv::Point2f> *points_2D, std::vector<cv::Rect> *bounding_boxes)
+{
+	runs_prev.clear();
+	parent.clear();
+	moments.clear();
+
+	for (int y = 0; y < image.rows; y++)
+	{
+		runs_curr.clear();
+		findRuns(image.ptr<unsigned char>(y), image.cols, threshold, runs_curr);
+
+		// Connect the runs to the (8-connected) overlapping runs of the previous row
+		size_t p_first = 0;
+		for (size_t c = 0; c < runs_curr.size(); c++)
+		{
+			Run& run = runs_curr[c];
+
+			while (p_first < runs_prev.size() && runs_prev[p_first].x_end < run.x_start - 1)
+				p_first++;
+
+			for (size_t p = p_first; p < runs_prev.size() && runs_prev[p].x_start <= run.x_end + 1; p++)
+			{
+				int root_prev = findRoot(runs_prev[p].label);
+				if (run.label < 0)
+					run.label = root_prev;
+				else
+				{
+					// Merge two blobs (the older label stays root)
+					int root = findRoot(run.label);
+					if (root < root_prev)
+						parent[root_prev] = root;
+					else if (root_prev < root)
+						parent[root] = root_prev;
+				}
+			}
+
+			// New blob
+			if (run.label < 0)
+			{
+				run.label = (int)parent.size();
+				parent.push_back(run.label);
+				BlobMoments new_moments = { 0, 0, 0, 0, 0, 0, run.x_start, run.x_end, y, y };
+				moments.push_back(new_moments);
+			}
+
+			// Moments of the run (sum of x over [x_start, x_end] is (x_start + x_end) * length / 2)
+			long long length = run.x_end - run.x_start + 1;
+			BlobMoments& m = moments[run.label];
+			m.m00 += length;
+			m.m10 += (long long)(run.x_start + run.x_end) * length / 2;
+			m.m01 += (long long)y * length;
+
+			// Weights: grey value above the threshold (sum of (I - t)*x is sum of I*x minus t times sum of x)
+			if (centroid_mode != CENTROID_BINARY)
+			{
+				long long sum_i, sum_ix;
+				sumRowIntensities(image.ptr<unsigned char>(y), run.x_start, run.x_end, sum_i, sum_ix);
+				long long sum_w = sum_i - (long long)threshold * length;
+				m.i00 += sum_w;
+				m.i10 += sum_ix - (long long)threshold * (run.x_start + run.x_end) * length / 2;
+				m.i01 += (long long)y * sum_w;
+			}
+			m.x_min = std::min(m.x_min, run.x_start);
+			m.x_max = std::max(m.x_max, run.x_end);
+			m.y_max = y;
+		}
+
+		runs_prev.swap(runs_curr);
+	}
+
+	// Sum up the moments of merged labels in their root (roots are always smaller than their children)
+	int num_blobs = 0;
+	for (int label = (int)parent.size() - 1; label >= 0; label--)
+	{
+		int root = findRoot(label);
+		if (root != label)
+		{
+			moments[root].m00 += moments[label].m00;
+			moments[root].m10 += moments[label].m10;
+			moments[root].m01 += moments[label].m01;
+			moments[root].i00 += moments[label].i00;
+			moments[root].i10 += moments[label].i10;
+			moments[root].i01 += moments[label].i01;
+			moments[root].x_min = std::min(moments[root].x_min, moments[label].x_min);
+			moments[root].x_max = std::max(moments[root].x_max, moments[label].x_max);
+			moments[root].y_min = std::min(moments[root].y_min, moments[label].y_min);
+			moments[root].y_max = std::max(moments[root].y_max, moments[label].y_max);
+		}
+	}
+
+	for (int label = 0; label < (int)parent.size(); label++)
+	{
+		if (parent[label] != label)
+			continue;
+
+		const BlobMoments& m = moments[label];
+		cv::Rect bounding_box(m.x_min, m.y_min, m.x_max - m.x_min + 1, m.y_max - m.y_min + 1);
+		cv::Point2f centroid((float)((double)m.m10 / m.m00), (float)((double)m.m01 / m.m00));
+
+		if (centroid_mode != CENTROID_BINARY && m.i00 > 0)
+		{
+			centroid = cv::Point2f((float)((double)m.i10 / m.i00), (float)((double)m.i01 / m.i00));
+
+			// Gaussian fit (intensity weighted centroid if ill-conditioned)
+			if (centroid_mode == CENTROID_GAUSSIAN)
+				fitGaussian(image, threshold, bounding_box, centroid);
+		}
+
+		points_2D->push_back(centroid);
+		if (bounding_boxes)
+			bounding_boxes->push_back(bounding_box);
+		num_blobs++;
+	}
+
+	return num_blobs;
+}
+
+}
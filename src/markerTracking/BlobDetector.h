@@ -0,0 +1,93 @@
+//============================================================================
+// Name        : BlobDetector.h
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Fused segmentation of bright marker blobs in a greyscale
+//				 camera frame (alternative to threshold + findContours +
+//				 moments) in one raster pass:
+//				 - Runs of pixels above the threshold are found per row
+//				   (SSE2: 16 pixels tested at once)
+//				 - Runs are labeled (8-connected to the runs of the
+//				   previous row, union-find) and their moments m00, m10, m01
+//				   accumulated as integers
+//				 - Centroids: binary (m10/m00, m01/m00), intensity weighted
+//				   (grey value above the threshold as weight, integer row
+//				   sums, SSE2) or 2D Gaussian fit (weighted least squares of
+//				   the log intensities in the bounding box of the blob)
+//				 - All buffers are reused, i.e. no allocation per frame
+//				   (once grown to the needed size)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef BLOB_DETECTOR_H_
+#define BLOB_DETECTOR_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+namespace tiy
+{
+
+class BlobDetector
+{
+
+public:
+
+	enum CentroidMode { CENTROID_BINARY, CENTROID_INTENSITY, CENTROID_GAUSSIAN };
+
+private:
+
+	CentroidMode centroid_mode;
+
+	// Run of pixels above the threshold in one row: [x_start, x_end] with its blob label
+	struct Run
+	{
+		int x_start, x_end, label;
+	};
+
+	// Moments, intensity weighted moments and bounding box of the pixels of one label
+	struct BlobMoments
+	{
+		long long m00, m10, m01;
+		long long i00, i10, i01;
+		int x_min, x_max, y_min, y_max;
+	};
+
+	// Runs of the previous and the actual row
+	std::vector<Run> runs_prev, runs_curr;
+
+	// Union-find parent of every label and the moments accumulated per label
+	std::vector<int> parent;
+	std::vector<BlobMoments> moments;
+
+public:
+
+	BlobDetector();
+
+	void setCentroidMode(CentroidMode centroid_mode_) { centroid_mode = centroid_mode_; }
+	CentroidMode getCentroidMode() const { return centroid_mode; }
+
+	// Segment all pixels brighter than "threshold" of the greyscale image (CV_8UC1) into 8-connected blobs and append
+	// the centroids (see CentroidMode) of all blobs to the "points_2D" vector (in order of their first row)
+	// and (if given) their bounding boxes to "bounding_boxes". Returns the number of found blobs.
+	int detect(const cv::Mat& image, unsigned char threshold, std::vector<cv::Point2f> *points_2D, std::vector<cv::Rect> *bounding_boxes = NULL);
+
+private:
+
+	// Append the runs of pixels > threshold of one row to "runs"
+	static void findRuns(const unsigned char *row, int width, unsigned char threshold, std::vector<Run>& runs);
+
+	// Root label (path halving)
+	int findRoot(int label);
+
+	// Sum of the grey values (sum_i) and of the grey values times x (sum_ix) of the pixels [x_start, x_end] of one row
+	static void sumRowIntensities(const unsigned char *row, int x_start, int x_end, long long& sum_i, long long& sum_ix);
+
+	// Fit an (axis aligned) 2D Gaussian to the pixels > threshold in the bounding box (weighted least squares of the
+	// log intensities, weights I^2). Returns FALSE (and leaves "center" unchanged) if the fit is ill-conditioned.
+	static bool fitGaussian(const cv::Mat& image, unsigned char threshold, const cv::Rect& bounding_box, cv::Point2f& center);
+};
+
+}
+
+#endif // BLOB_DETECTOR_H_
@@ -0,0 +1,291 @@
+//============================================================================
+// Name        : EpipolarMatcher.cpp
+// Author      : Andre Gaschler, Andreas Pflaum
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "EpipolarMatcher.h"
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#include <xmmintrin.h>
+	#define EPIPOLAR_MATCHER_SSE
+#endif
+
+#include <cmath>
+#include <algorithm>
+
+namespace tiy
+{
+
+EpipolarMatcher::EpipolarMatcher() :
+	num_tested_pairs(0)
+{
+	for (int i = 0; i < 9; i++)
+	{
+		E[i] = 0.0f;
+		R_rect_left[i] = R_rect_right[i] = (i % 4 == 0) ? 1.0f : 0.0f;
+	}
+}
+
+
+void
+EpipolarMatcher::setEssentialMatrix(const cv::Mat& E_)
+{
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			E[3*r + c] = E_.at<float>(r, c);
+}
+
+
+void
+EpipolarMatcher::setPoints(const cv::Mat& points_left_undist, const cv::Mat& points_right_undist)
+{
+	int num_points_left = (int)points_left_undist.total(), num_points_right = (int)points_right_undist.total();
+
+	left_x.resize(num_points_left);
+	left_y.resize(num_points_left);
+	right_x.resize(num_points_right);
+	right_y.resize(num_points_right);
+	line_matches.resize(num_points_right);
+
+	const cv::Point2f *points_left = points_left_undist.ptr<cv::Point2f>(0);
+	for (int i = 0; i < num_points_left; i++)
+	{
+		left_x[i] = points_left[i].x;
+		left_y[i] = points_left[i].y;
+	}
+
+	const cv::Point2f *points_right = points_right_undist.ptr<cv::Point2f>(0);
+	for (int i = 0; i < num_points_right; i++)
+	{
+		right_x[i] = points_right[i].x;
+		right_y[i] = points_right[i].y;
+	}
+}
+
+
+void
+EpipolarMatcher::setStereoGeometry(const cv::Mat& RT_leftcam_to_rightcam)
+{
+	float R[9], T[3];
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+			R[3*r + c] = RT_leftcam_to_rightcam.at<float>(r, c);
+		T[r] = RT_leftcam_to_rightcam.at<float>(r, 3);
+	}
+
+	// e1: direction of the baseline (right camera center -R^T*T in the left camera KoSy)
+	float e1[3];
+	for (int i = 0; i < 3; i++)
+		e1[i] = -(R[i]*T[0] + R[3+i]*T[1] + R[6+i]*T[2]);
+	float norm_e1 = sqrt(e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2]);
+	for (int i = 0; i < 3; i++)
+		e1[i] /= norm_e1;
+
+	// e2: perpendicular to e1 (and to the optical axis, if possible), e3 = e1 x e2
+	float e2[3] = { -e1[1], e1[0], 0.0f };
+	if (fabs(e1[2]) > 0.99f)
+	{
+		e2[0] = 0.0f; e2[1] = -e1[2]; e2[2] = e1[1];
+	}
+	float norm_e2 = sqrt(e2[0]*e2[0] + e2[1]*e2[1] + e2[2]*e2[2]);
+	for (int i = 0; i < 3; i++)
+		e2[i] /= norm_e2;
+
+	float e3[3] = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0] };
+
+	for (int i = 0; i < 3; i++)
+	{
+		R_rect_left[i] = e1[i];
+		R_rect_left[3+i] = e2[i];
+		R_rect_left[6+i] = e3[i];
+	}
+
+	// R_rect_right = R_rect_left * R^T
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			R_rect_right[3*r + c] = R_rect_left[3*r]*R[3*c] + R_rect_left[3*r + 1]*R[3*c + 1] + R_rect_left[3*r + 2]*R[3*c + 2];
+}
+
+
+float
+EpipolarMatcher::getEpipolarAngle(const float R_rect[9], float x, float y)
+{
+	// All rays in the same epipolar plane have the same direction perpendicular to the baseline (rectified y/z)
+	float y_rect = R_rect[3]*x + R_rect[4]*y + R_rect[5];
+	float z_rect = R_rect[6]*x + R_rect[7]*y + R_rect[8];
+
+	return atan2(y_rect, z_rect);
+}
+
+
+void
+EpipolarMatcher::getEpipolarLine(float x, float y, float line[3]) const
+{
+	line[0] = E[0]*x + E[1]*y + E[2];
+	line[1] = E[3]*x + E[4]*y + E[5];
+	line[2] = E[6]*x + E[7]*y + E[8];
+}
+
+
+int
+EpipolarMatcher::findCandidates(float max_err_dist, int num_max_matches, std::vector<int>& match_left, std::vector<int>& match_right)
+{
+	int num_points_left = (int)left_x.size(), num_points_right = (int)right_x.size();
+	int num_matches = 0;
+
+	num_tested_pairs = num_points_left * num_points_right;
+
+	if (num_points_right == 0)
+		return 0;
+
+	for (int l = 0; l < num_points_left; l++)
+	{
+		float line[3];
+		getEpipolarLine(left_x[l], left_y[l], line);
+
+		int num_line_matches = matchLine(&right_x[0], &right_y[0], num_points_right, line, max_err_dist, &line_matches[0]);
+
+		for (int m = 0; m < num_line_matches; m++)
+		{
+			if (num_max_matches >= 0 && num_matches >= num_max_matches)
+				return num_matches;
+
+			match_left.push_back(l);
+			match_right.push_back(line_matches[m]);
+			num_matches++;
+		}
+	}
+
+	return num_matches;
+}
+
+
+int
+EpipolarMatcher::findCandidatesInBand(float max_err_dist, float band_width, std::vector<int>& match_left, std::vector<int>& match_right)
+{
+	const float pi = 3.14159265358979f;
+	int num_points_left = (int)left_x.size(), num_points_right = (int)right_x.size();
+	int num_matches = 0;
+
+	num_tested_pairs = 0;
+
+	if (num_points_right == 0)
+		return 0;
+
+	// The band covers all planes => test all pairs
+	if (band_width >= pi)
+		return findCandidates(max_err_dist, -1, match_left, match_right);
+
+	// Index: right points sorted by epipolar plane angle
+	right_angle_sorted.resize(num_points_right);
+	for (int i = 0; i < num_points_right; i++)
+		right_angle_sorted[i] = std::make_pair(getEpipolarAngle(R_rect_right, right_x[i], right_y[i]), i);
+	std::sort(right_angle_sorted.begin(), right_angle_sorted.end());
+
+	left_angle.resize(num_points_left);
+	for (int l = 0; l < num_points_left; l++)
+		left_angle[l] = getEpipolarAngle(R_rect_left, left_x[l], left_y[l]);
+
+	for (int l = 0; l < num_points_left; l++)
+	{
+		// Right points in the band (wrapped around at +-pi)
+		int num_found = 0;
+		float angle_min = left_angle[l] - band_width, angle_max = left_angle[l] + band_width;
+
+		addRightPointsInRange(angle_min, angle_max, num_found);
+		if (angle_min < -pi)
+			addRightPointsInRange(angle_min + 2*pi, pi, num_found);
+		if (angle_max > pi)
+			addRightPointsInRange(-pi, angle_max - 2*pi, num_found);
+
+		num_tested_pairs += num_found;
+
+		// Exact test x_r^T * E * x_l (in index order like findCandidates())
+		std::sort(line_matches.begin(), line_matches.begin() + num_found);
+
+		float line[3];
+		getEpipolarLine(left_x[l], left_y[l], line);
+
+		for (int m = 0; m < num_found; m++)
+		{
+			int r = line_matches[m];
+			if (fabs(line[0]*right_x[r] + line[1]*right_y[r] + line[2]) < max_err_dist)
+			{
+				match_left.push_back(l);
+				match_right.push_back(r);
+				num_matches++;
+			}
+		}
+	}
+
+	return num_matches;
+}
+
+
+void
+EpipolarMatcher::addRightPointsInRange(float angle_min, float angle_max, int& num_found)
+{
+	std::vector< std::pair<float, int> >::const_iterator it =
+			std::lower_bound(right_angle_sorted.begin(), right_angle_sorted.end(), std::make_pair(angle_min, -1));
+
+	for (; it != right_angle_sorted.end() && it->first <= angle_max; ++it)
+		line_matches[num_found++] = it->second;
+}
+
+
+int
+EpipolarMatcher::matchLine(const float *x, const float *y, int n, const float line[3], float max_err_dist, int *indices)
+{
+	int num_found = 0;
+	int i = 0;
+
+#if defined(__AVX__)
+	// (AVX float instructions suffice, no FMA: same rounding as the scalar test)
+	const __m256 a8 = _mm256_set1_ps(line[0]), b8 = _mm256_set1_ps(line[1]), c8 = _mm256_set1_ps(line[2]);
+	const __m256 max8 = _mm256_set1_ps(max_err_dist);
+	const __m256 abs_mask8 = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a8, _mm256_loadu_ps(x + i)), _mm256_mul_ps(b8, _mm256_loadu_ps(y + i))), c8);
+		int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_and_ps(d, abs_mask8), max8, _CMP_LT_OQ));
+		for (; mask; mask &= mask - 1)
+		{
+			int bit = 0;
+			while (!((mask >> bit) & 1))
+				bit++;
+			indices[num_found++] = i + bit;
+		}
+	}
+#elif defined(EPIPOLAR_MATCHER_SSE)
+	const __m128 a4 = _mm_set1_ps(line[0]), b4 = _mm_set1_ps(line[1]), c4 = _mm_set1_ps(line[2]);
+	const __m128 max4 = _mm_set1_ps(max_err_dist);
+	const __m128 sign4 = _mm_set1_ps(-0.0f);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a4, _mm_loadu_ps(x + i)), _mm_mul_ps(b4, _mm_loadu_ps(y + i))), c4);
+		int mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_andnot_ps(sign4, d), max4));
+		if (mask & 1) indices[num_found++] = i;
+		if (mask & 2) indices[num_found++] = i + 1;
+		if (mask & 4) indices[num_found++] = i + 2;
+		if (mask & 8) indices[num_found++] = i + 3;
+	}
+#endif
+
+	// Scalar fallback (and remaining points)
+	for (; i < n; i++)
+	{
+		float d = line[0]*x[i] + line[1]*y[i] + line[2];
+		if (fabs(d) < max_err_dist)
+			indices[num_found++] = i;
+	}
+
+	return num_found;
+}
+
+}
@@ -0,0 +1,99 @@
+//============================================================================
+// Name        : EpipolarMatcher.h
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Epipolar correspondence candidate search between the
+//				 undistorted 2D points of the left and right camera frame:
+//				 - The epipolar line E*x_l is computed once per left point
+//				 - The right points are stored as SoA float arrays and
+//				   tested against the line with SIMD (8 wide with AVX, i.e.
+//				   CMake option USE_AVX2, else SSE, scalar fallback),
+//				   giving |x_r^T * E * x_l| per pair
+//				 - Candidates are returned in the same order as the
+//				   former all-pairs loop (left point major)
+//				 - Alternatively, the right points are indexed by their
+//				   epipolar plane (angle around the baseline, i.e. the
+//				   rectified y direction), so every left point only tests
+//				   the right points in a narrow band around its epipolar
+//				   line (for many markers)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef EPIPOLAR_MATCHER_H_
+#define EPIPOLAR_MATCHER_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+#include <utility>
+
+namespace tiy
+{
+
+class EpipolarMatcher
+{
+
+private:
+
+	// Essential matrix (row major)
+	float E[9];
+
+	// Undistorted points (SoA)
+	std::vector<float> left_x, left_y, right_x, right_y;
+
+	// Indices of the right points matching the actual epipolar line
+	std::vector<int> line_matches;
+
+	// Rotations from the left/right camera KoSy to the rectified KoSy (x-axis along the baseline, row major)
+	float R_rect_left[9], R_rect_right[9];
+
+	// Epipolar plane angles of the left points and the (angle sorted) right points
+	std::vector<float> left_angle;
+	std::vector< std::pair<float, int> > right_angle_sorted;
+
+	// Number of tested left/right pairs of the last candidate search
+	int num_tested_pairs;
+
+public:
+
+	EpipolarMatcher();
+
+	// Set the essential matrix E (3x3, CV_32F) with x_r^T * E * x_l = 0 for corresponding undistorted points
+	void setEssentialMatrix(const cv::Mat& E_);
+
+	// Copy the undistorted left and right points (1xN, CV_32FC2) into the SoA arrays
+	void setPoints(const cv::Mat& points_left_undist, const cv::Mat& points_right_undist);
+
+	// Find all pairs (left, right) with |x_r^T * E * x_l| < max_err_dist (at most num_max_matches, if >= 0)
+	// and append their indices to match_left/match_right. Returns the number of found candidates.
+	int findCandidates(float max_err_dist, int num_max_matches, std::vector<int>& match_left, std::vector<int>& match_right);
+
+	// Set the stereo geometry (transformation matrix (4x4, CV_32F) from the left to the right camera KoSy),
+	// needed for findCandidatesInBand()
+	void setStereoGeometry(const cv::Mat& RT_leftcam_to_rightcam);
+
+	// Like findCandidates() without limit, but only testing the right points with an epipolar plane angle
+	// within +-band_width [rad] of the left point (right points sorted by angle, binary search)
+	int findCandidatesInBand(float max_err_dist, float band_width, std::vector<int>& match_left, std::vector<int>& match_right);
+
+	// Number of left/right pairs not tested (pruned by the band) in the last candidate search
+	int getNumPrunedPairs() const { return (int)(left_x.size()*right_x.size()) - num_tested_pairs; }
+
+	// Compute the epipolar line (a,b,c) = E*x_l of the left point x_l = (x,y,1)
+	void getEpipolarLine(float x, float y, float line[3]) const;
+
+	// Kernel: write the indices of all n points (x,y) with |a*x + b*y + c| < max_err_dist to "indices"
+	// (ascending order, "indices" needs space for n values). Returns the number of found points.
+	static int matchLine(const float *x, const float *y, int n, const float line[3], float max_err_dist, int *indices);
+
+private:
+
+	// Angle of the epipolar plane (around the baseline) through the undistorted point (x,y,1) of the camera with rotation R_rect
+	static float getEpipolarAngle(const float R_rect[9], float x, float y);
+
+	// Append the indices of all angle sorted right points with angle in [angle_min, angle_max] to "line_matches"
+	void addRightPointsInRange(float angle_min, float angle_max, int& num_found);
+};
+
+}
+
+#endif // EPIPOLAR_MATCHER_H_
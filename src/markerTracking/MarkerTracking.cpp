@@ -6,6 +6,12 @@
 
 #include "MarkerTracking.h"
 
+// Constraints of the template search: maximum difference of corresponding edge lengths, minimum number of correspondences
+#define TEMPLATE_MAX_EDGE_DISTANCE 20.0f
+#define TEMPLATE_MIN_CORRESPONDENCES 4
+// Time [us] after which the pose filter of a template not found any more is reset
+#define POSE_FILTER_TIMEOUT_US 500000
+
 namespace tiy
 {
 
@@ -17,8 +23,22 @@ MarkerTracking::MarkerTracking(bool do_debugging_) :
     camera_gain(-1),
     frame_width(-1),
     frame_height(-1),
+    sync_tolerance_us(0),
     min_segmentation_area(-1.0f),
     max_segmentation_area(-1.0f),
+    segmentation_mode(SEGMENTATION_CONTOURS),
+    centroid_mode(BlobDetector::CENTROID_BINARY),
+    do_use_epipolar_band(false),
+    epipolar_band_width(0.01f),
+    num_pruned_pairs(0),
+    undistortion_map_step(0),
+    roi_full_scan_interval(0),
+    roi_window_radius(20),
+    template_tracking_gate(0.0f),
+    pose_filter_position_noise(0.5f),
+    pose_filter_orientation_noise(0.005f),
+    pose_filter_acceleration_noise(300.0f),
+    pose_filter_angular_acceleration_noise(3.0f),
     num_templates(-1)
 {
     // Kalman filter initialization
@@ -38,6 +58,14 @@ MarkerTracking::MarkerTracking(bool do_debugging_) :
     setIdentity(kalman_filter.processNoiseCov, cv::Scalar::all(1e-4));
     setIdentity(kalman_filter.measurementNoiseCov, cv::Scalar::all(1e-1));
     setIdentity(kalman_filter.errorCovPost, cv::Scalar::all(.1));
+
+    for (int i = 0; i < 2; i++)
+    {
+    	RoiStatistics no_statistics = { 0, 0, 0, 0 };
+    	roi_statistics[i] = no_statistics;
+    	roi_frames_since_full_scan[i] = 0;
+    	roi_threshold[i] = 255;
+    }
 }
 
 
@@ -82,6 +110,8 @@ MarkerTracking::readCameraConfigFile(const char *camera_config_file_name)
 		std::cerr << "WARNING: Value of camera_gain set to 300 ( Range is [300;850] )" << std::endl;
 		camera_gain = 300;
 	}
+	if (!input_file_storage["sync_tolerance_us"].empty())
+		sync_tolerance_us = (int)input_file_storage["sync_tolerance_us"];
     frame_width = (int)input_file_storage["frame_width"];
     frame_height = (int)input_file_storage["frame_height"];
 
@@ -89,6 +119,69 @@ MarkerTracking::readCameraConfigFile(const char *camera_config_file_name)
     min_segmentation_area = (float)input_file_storage["min_segmentation_area"];
     max_segmentation_area = (float)input_file_storage["max_segmentation_area"];
 
+    // Segmentation mode (optional)
+    std::string segmentation_mode_str = (std::string)input_file_storage["segmentation_mode"];
+    if (segmentation_mode_str.empty() || segmentation_mode_str == "contours")
+    	segmentation_mode = SEGMENTATION_CONTOURS;
+    else if (segmentation_mode_str == "blobs")
+    	segmentation_mode = SEGMENTATION_BLOBS;
+    else
+    {
+    	std::cerr << "MarkerTracking: readCameraConfigFile() - unknown segmentation_mode " << segmentation_mode_str << " (contours or blobs)" << std::endl;
+    	return false;
+    }
+
+    std::string centroid_mode_str = (std::string)input_file_storage["centroid_mode"];
+    if (centroid_mode_str.empty() || centroid_mode_str == "binary")
+    	centroid_mode = BlobDetector::CENTROID_BINARY;
+    else if (centroid_mode_str == "intensity")
+    	centroid_mode = BlobDetector::CENTROID_INTENSITY;
+    else if (centroid_mode_str == "gaussian")
+    	centroid_mode = BlobDetector::CENTROID_GAUSSIAN;
+    else
+    {
+    	std::cerr << "MarkerTracking: readCameraConfigFile() - unknown centroid_mode " << centroid_mode_str << " (binary, intensity or gaussian)" << std::endl;
+    	return false;
+    }
+    if (centroid_mode != BlobDetector::CENTROID_BINARY && segmentation_mode == SEGMENTATION_CONTOURS)
+    	std::cerr << "WARNING: centroid_mode " << centroid_mode_str << " only used with segmentation_mode blobs" << std::endl;
+
+    // Stereo correspondence configuration (optional)
+    std::string stereo_matcher_str = (std::string)input_file_storage["stereo_matcher"];
+    if (stereo_matcher_str.empty() || stereo_matcher_str == "all_pairs")
+    	do_use_epipolar_band = false;
+    else if (stereo_matcher_str == "epipolar_band")
+    	do_use_epipolar_band = true;
+    else
+    {
+    	std::cerr << "MarkerTracking: readCameraConfigFile() - unknown stereo_matcher " << stereo_matcher_str << " (all_pairs or epipolar_band)" << std::endl;
+    	return false;
+    }
+    if (!input_file_storage["epipolar_band_width"].empty())
+    	epipolar_band_width = (float)input_file_storage["epipolar_band_width"];
+    if (!input_file_storage["undistortion_map_step"].empty())
+    	undistortion_map_step = (int)input_file_storage["undistortion_map_step"];
+
+    // ROI segmentation configuration (optional)
+    if (!input_file_storage["roi_full_scan_interval"].empty())
+    	roi_full_scan_interval = (int)input_file_storage["roi_full_scan_interval"];
+    if (!input_file_storage["roi_window_radius"].empty())
+    	roi_window_radius = (int)input_file_storage["roi_window_radius"];
+
+    // Template tracking configuration (optional)
+    if (!input_file_storage["template_tracking_gate"].empty())
+    	template_tracking_gate = (float)input_file_storage["template_tracking_gate"];
+
+    // Pose filter configuration (optional)
+    if (!input_file_storage["pose_filter_position_noise"].empty())
+    	pose_filter_position_noise = (float)input_file_storage["pose_filter_position_noise"];
+    if (!input_file_storage["pose_filter_orientation_noise"].empty())
+    	pose_filter_orientation_noise = (float)input_file_storage["pose_filter_orientation_noise"];
+    if (!input_file_storage["pose_filter_acceleration_noise"].empty())
+    	pose_filter_acceleration_noise = (float)input_file_storage["pose_filter_acceleration_noise"];
+    if (!input_file_storage["pose_filter_angular_acceleration_noise"].empty())
+    	pose_filter_angular_acceleration_noise = (float)input_file_storage["pose_filter_angular_acceleration_noise"];
+
     // Camera Calibration Parameters
     input_file_storage["T"] >> T_leftcam_to_rightcam;
     input_file_storage["om"] >> om_leftcam_to_rightcam;
@@ -114,6 +207,32 @@ MarkerTracking::readCameraConfigFile(const char *camera_config_file_name)
 		return false;
 	}
 
+	// Essential matrix for the undistorted (normalized) 2D points
+	E_stereo_camera = KK_right.t() * F_stereo_camera * KK_left;
+	epipolar_matcher.setEssentialMatrix(E_stereo_camera);
+	epipolar_matcher.setStereoGeometry(RT_leftcam_to_rightcam);
+
+	// Undistortion lookup tables (loaded from the cache files, if built with the same calibration)
+	if (undistortion_map_step > 0)
+	{
+		std::string map_file_name = camera_config_file_name;
+		std::string::size_type extension_pos = map_file_name.rfind(".xml");
+		if (extension_pos != std::string::npos)
+			map_file_name.erase(extension_pos);
+
+		if (!undistortion_map_left.loadOrBuild(map_file_name + "_left.undistortion_map", KK_left, kc_left, frame_width, frame_height, undistortion_map_step) ||
+				!undistortion_map_right.loadOrBuild(map_file_name + "_right.undistortion_map", KK_right, kc_right, frame_width, frame_height, undistortion_map_step))
+		{
+			std::cerr << "MarkerTracking: readCameraConfigFile() - undistortion maps could NOT be built" << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		undistortion_map_left = UndistortionMap();
+		undistortion_map_right = UndistortionMap();
+	}
+
     return true;
 }
 
@@ -154,6 +273,8 @@ MarkerTracking::readObjectConfigFile(const char *object_config_file_name)
 
     input_file_storage.release();
 
+    RT_template_leftcam_last.assign(std::max(num_templates, 0), cv::Mat());
+
     // Check if all parameters correctly read
 	if (num_templates==-1)
 	{
@@ -169,6 +290,32 @@ MarkerTracking::readObjectConfigFile(const char *object_config_file_name)
     	}
 	}
 
+    // Template edge lengths and fitting buffers
+    fit_workspaces.clear();
+    for(int i = 0; i < num_templates; i++)
+	{
+    	fit_workspaces.push_back(boost::shared_ptr<TemplateFitWorkspace>(new TemplateFitWorkspace));
+    	fit_workspaces.back()->setTemplate(object_templates[i]);
+	}
+
+    // Order of fit3DPointsToObjectTemplates(): most template points (longest search) first
+    std::vector<std::pair<int, int> > template_sizes;
+    for(int i = 0; i < num_templates; i++)
+    	template_sizes.push_back(std::make_pair(-object_templates[i].cols, i));
+    std::sort(template_sizes.begin(), template_sizes.end());
+    fit_order.clear();
+    for(int i = 0; i < num_templates; i++)
+    	fit_order.push_back(template_sizes[i].second);
+
+    // Pose filters (camera parameters read before, see readConfigFiles())
+    {
+    	boost::mutex::scoped_lock lock(pose_filter_mutex);
+    	pose_filters.assign(num_templates, PoseFilter());
+    	for(int i = 0; i < num_templates; i++)
+    		pose_filters[i].setNoise(pose_filter_position_noise, pose_filter_orientation_noise,
+    				pose_filter_acceleration_noise, pose_filter_angular_acceleration_noise);
+    }
+
     return true;
 }
 
@@ -211,58 +358,27 @@ MarkerTracking::fitTwoPointSets(const cv::Mat &point_set_0, const cv::Mat &point
     // http://portal.acm.org/citation.cfm?id=105525
     //
     // Andre Gaschler, 2010
+    //
+    // The SVD solution (with Umeyama correction) is now computed as the equivalent unit quaternion of
+    // Horn's method with fixed-size matrices on the stack (see PointSetFit.h)
 
     assert(num_points<=point_set_0.cols && num_points<=point_set_1.cols);
+    assert(point_set_0.type() == CV_32F && point_set_1.type() == CV_32F);
 
-    cv::Scalar centroid[2][3];
-    cv::Mat point_set_0_c(3,num_points,CV_32F), point_set_1_c(3,num_points,CV_32F), C(num_points,num_points,CV_32F), t(3,1,CV_32F);
-
-    for(int j = 0; j<3; j++)
-      {
-        centroid[0][j] = mean(point_set_0.row(j));
-        centroid[1][j] = mean(point_set_1.row(j));
-        point_set_0_c.row(j) = point_set_0.row(j) - centroid[0][j][0];
-        point_set_1_c.row(j) = point_set_1.row(j) - centroid[1][j][0];
-      }
-
-    C = point_set_1_c * point_set_0_c.t();
-    cv::SVD C_svd(C);
-
-    //det(U*V') Umeyama correction
-    float det_U_Vt = (float)cv::determinant(C_svd.u * C_svd.vt);
-    cv::Mat Det_U_Vt = cv::Mat::eye(3,3,CV_32F);
-    Det_U_Vt.at<float>(2,2) = det_U_Vt;
-
-    RT = cv::Mat::eye(4,4,CV_32F);
-
-    cv::Mat R = RT(cv::Range(0,3),cv::Range(0,3));
-    R = C_svd.u * Det_U_Vt * C_svd.vt;
-
-    cv::Mat point_set_0_centroid(3,1,CV_32F), point_set_1_centroid(3,1,CV_32F);
-    for(int j = 0; j<3; j++)
-      {
-        point_set_0_centroid.at<float>(j,0) = (float)centroid[0][j][0];
-        point_set_1_centroid.at<float>(j,0) = (float)centroid[1][j][0];
-      }
-
-    t = RT(cv::Range(0,3),cv::Range(3,4));
-    t = point_set_1_centroid - (R * point_set_0_centroid);
+    const float *const rows_0[3] = { point_set_0.ptr<float>(0), point_set_0.ptr<float>(1), point_set_0.ptr<float>(2) };
+    const float *const rows_1[3] = { point_set_1.ptr<float>(0), point_set_1.ptr<float>(1), point_set_1.ptr<float>(2) };
 
-    // calculate average deviation
-    cv::Mat point_set_1_t(3,num_points,CV_32F), dev(3,num_points,CV_32F);
-    point_set_1_t.row(0) = point_set_1.row(0) - t.at<float>(0,0);
-    point_set_1_t.row(1) = point_set_1.row(1) - t.at<float>(1,0);
-    point_set_1_t.row(2) = point_set_1.row(2) - t.at<float>(2,0);
+    float RT_data[16];
+    *avg_deviation = fitPointSets(rows_0, rows_1, num_points, RT_data);
 
-    dev = point_set_1_t - (R * point_set_0);
-    float dev_point, dev_sum=0;
-    for(int i = 0; i<num_points; i++)
+    // (only allocated if RT is not yet 4x4)
+    RT.create(4, 4, CV_32F);
+    for(int j = 0; j<4; j++)
       {
-        dev_point = (float)norm(dev.col(i));
-        dev_sum += dev_point;
+        float *RT_row = RT.ptr<float>(j);
+        for(int k = 0; k<4; k++)
+          RT_row[k] = RT_data[4*j + k];
       }
-
-    *avg_deviation = dev_sum / num_points;
 }
 
 
@@ -306,7 +422,45 @@ MarkerTracking::get2DPointsFromFile(const char *file_name, std::vector< ::cv::Po
 
 
 void
-MarkerTracking::get2DPointsFromImage(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D)
+MarkerTracking::get2DPointsFromImage(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D, int camera_id)
+{
+	if (camera_id < 0 || camera_id > 1)
+	{
+		std::cerr << "MarkerTracking: get2DPointsFromImage() - camera_id " << camera_id << " NOT 0 (left) or 1 (right)" << std::endl;
+		return;
+	}
+
+	if (roi_full_scan_interval <= 0)
+	{
+		segmentFullImage(camera_image, points_2D, camera_id);
+		return;
+	}
+
+	// ROI segmentation: full frame scan every roi_full_scan_interval frames or if points were lost
+	size_t num_points_before = points_2D->size();
+	bool is_roi_segmented = false;
+
+	if (roi_frames_since_full_scan[camera_id] < roi_full_scan_interval && !roi_last_points[camera_id].empty())
+		is_roi_segmented = segmentRoiWindows(camera_image, points_2D, camera_id);
+
+	if (is_roi_segmented)
+	{
+		roi_frames_since_full_scan[camera_id]++;
+		roi_statistics[camera_id].num_roi_scans++;
+	}
+	else
+	{
+		segmentFullImage(camera_image, points_2D, camera_id);
+		roi_frames_since_full_scan[camera_id] = 0;
+		roi_statistics[camera_id].num_full_scans++;
+	}
+
+	roi_last_points[camera_id].assign(points_2D->begin() + num_points_before, points_2D->end());
+}
+
+
+unsigned char
+MarkerTracking::getSegmentationThreshold(const ::cv::Mat &camera_image)
 {
 	// Create histogram and set thresholds automatically (1,5ms)
 	unsigned int hist[256];
@@ -344,11 +498,37 @@ MarkerTracking::get2DPointsFromImage(const ::cv::Mat &camera_image, std::vector<
 	if ((recognition_quality < 25.0f) && (recognition_quality != 0.0f))
 		  std::cerr << "MarkerTracking: get2DPointsFromImage() - Recognition quality bad (= " << recognition_quality << "). Perhaps the IR-LEDs are OFF or camera/marker balls hidden?" << std::endl;
 
+	return (unsigned char)((t_high+t_low)/2);
+}
+
+
+void
+MarkerTracking::segmentFullImage(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D, int camera_id)
+{
+	unsigned char threshold = getSegmentationThreshold(camera_image);
+	roi_threshold[camera_id] = threshold;
+
+	segmentImage(camera_image, threshold, points_2D, NULL, camera_id);
+}
+
+
+void
+MarkerTracking::segmentImage(const ::cv::Mat &camera_image, unsigned char threshold, std::vector< ::cv::Point2f > *points_2D,
+							 std::vector< ::cv::Rect > *bounding_boxes, int camera_id)
+{
+	// Fused threshold, blob labeling and moments (no allocation per frame)
+	if (segmentation_mode == SEGMENTATION_BLOBS)
+	{
+		blob_detector[camera_id].setCentroidMode(centroid_mode);
+		blob_detector[camera_id].detect(camera_image, threshold, points_2D, bounding_boxes);
+		return;
+	}
+
 
 	// Binary threshold and find contours
 	::cv::vector< ::cv::vector< ::cv::Point > > contours;
 	::cv::Mat image_thresh(camera_image.rows, camera_image.cols, camera_image.type());
-	::cv::threshold(camera_image, image_thresh, (t_high+t_low)/2, 255.0, ::cv::THRESH_BINARY);
+	::cv::threshold(camera_image, image_thresh, threshold, 255.0, ::cv::THRESH_BINARY);
 	::cv::findContours(image_thresh, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE); // changes image_thresh
 
 
@@ -364,10 +544,151 @@ MarkerTracking::get2DPointsFromImage(const ::cv::Mat &camera_image, std::vector<
         circle.y = (float)(moment.m01 / moment.m00);
 
         points_2D->push_back(circle);
+        if (bounding_boxes)
+        	bounding_boxes->push_back(::cv::boundingRect(contours[j]));
     }
 }
 
 
+bool
+MarkerTracking::segmentRoiWindows(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D, int camera_id)
+{
+	const std::vector< ::cv::Point2f >& last_points = roi_last_points[camera_id];
+	std::vector< ::cv::Rect >& windows = roi_windows[camera_id];
+	std::vector< ::cv::Point2f >& roi_points = roi_found_points[camera_id];
+	std::vector< ::cv::Rect >& bounding_boxes = roi_bounding_boxes[camera_id];
+	const ::cv::Rect image_rect(0, 0, camera_image.cols, camera_image.rows);
+
+	// Search windows around the last 2D points and the reprojected marker points of the last found poses
+	windows.clear();
+	for (size_t i = 0; i < last_points.size(); i++)
+		windows.push_back(::cv::Rect(cvRound(last_points[i].x) - roi_window_radius, cvRound(last_points[i].y) - roi_window_radius,
+									 2*roi_window_radius + 1, 2*roi_window_radius + 1) & image_rect);
+
+	const ::cv::Mat& KK = (camera_id == 0) ? KK_left : KK_right;
+	const ::cv::Mat& kc = (camera_id == 0) ? kc_left : kc_right;
+
+	std::vector< ::cv::Mat >& last_poses = roi_last_poses[camera_id];
+	{
+		boost::mutex::scoped_lock lock(last_pose_mutex);
+		last_poses = RT_template_leftcam_last;
+	}
+
+	for (size_t t = 0; t < last_poses.size() && t < object_templates.size(); t++)
+	{
+		if (last_poses[t].empty() || last_poses[t].at<float>(3,3) == 0.0f)
+			continue;
+
+		::cv::Mat RT_template_cam = last_poses[t];
+		if (camera_id == 1)
+			RT_template_cam = RT_leftcam_to_rightcam * RT_template_cam;
+
+		::cv::Mat points_cam = RT_template_cam * object_templates[t];
+		for (int p = 0; p < points_cam.cols; p++)
+		{
+			::cv::Point2f point;
+			if (!projectPoint(KK, kc, points_cam.at<float>(0,p), points_cam.at<float>(1,p), points_cam.at<float>(2,p), point))
+				continue;
+
+			::cv::Rect window = ::cv::Rect(cvRound(point.x) - roi_window_radius, cvRound(point.y) - roi_window_radius,
+										   2*roi_window_radius + 1, 2*roi_window_radius + 1) & image_rect;
+			if (window.area() > 0)
+				windows.push_back(window);
+		}
+	}
+
+	// Merge overlapping windows (no blob found twice)
+	for (bool has_merged = true; has_merged; )
+	{
+		has_merged = false;
+		for (size_t a = 0; a < windows.size(); a++)
+		{
+			for (size_t b = a + 1; b < windows.size(); b++)
+			{
+				if ((windows[a] & windows[b]).area() > 0)
+				{
+					windows[a] = windows[a] | windows[b];
+					windows[b] = windows.back();
+					windows.pop_back();
+					b--;
+					has_merged = true;
+				}
+			}
+		}
+	}
+
+	// Segment the windows with the threshold of the last full frame scan (same segmentation_mode => same centroids)
+	// (cv::findContours() ignores the 1 pixel border of the window => a contour there touches the window border)
+	const int window_border = (segmentation_mode == SEGMENTATION_CONTOURS) ? 1 : 0;
+	roi_points.clear();
+	for (size_t w = 0; w < windows.size(); w++)
+	{
+		if (windows[w].area() <= 0)
+			continue;
+
+		size_t num_points_before = roi_points.size();
+		bounding_boxes.clear();
+		segmentImage(camera_image(windows[w]), roi_threshold[camera_id], &roi_points, &bounding_boxes, camera_id);
+
+		for (size_t i = 0; i < bounding_boxes.size(); i++)
+		{
+			// Blob cut by the window border (not the image border) => centroid wrong => full frame scan
+			const ::cv::Rect& box = bounding_boxes[i];
+			if ((box.x <= window_border && windows[w].x > 0) || (box.y <= window_border && windows[w].y > 0) ||
+					(box.x + box.width >= windows[w].width - window_border && windows[w].x + windows[w].width < camera_image.cols) ||
+						(box.y + box.height >= windows[w].height - window_border && windows[w].y + windows[w].height < camera_image.rows))
+				return false;
+
+			roi_points[num_points_before + i].x += windows[w].x;
+			roi_points[num_points_before + i].y += windows[w].y;
+		}
+	}
+
+	// Hit: a blob found near the last 2D point, miss: point lost => full frame scan
+	bool is_point_lost = false;
+	for (size_t i = 0; i < last_points.size(); i++)
+	{
+		bool is_hit = false;
+		for (size_t j = 0; j < roi_points.size() && !is_hit; j++)
+			is_hit = (fabs(roi_points[j].x - last_points[i].x) <= roi_window_radius) && (fabs(roi_points[j].y - last_points[i].y) <= roi_window_radius);
+
+		if (is_hit)
+			roi_statistics[camera_id].num_hits++;
+		else
+		{
+			roi_statistics[camera_id].num_misses++;
+			is_point_lost = true;
+		}
+	}
+	if (is_point_lost)
+		return false;
+
+	points_2D->insert(points_2D->end(), roi_points.begin(), roi_points.end());
+	return true;
+}
+
+
+bool
+MarkerTracking::projectPoint(const ::cv::Mat &KK, const ::cv::Mat &kc, float X, float Y, float Z, ::cv::Point2f &point)
+{
+	if (Z <= 0.0f)
+		return false;
+
+	// Pinhole camera with radial (k1, k2, k3) and tangential (p1, p2) distortion (like cv::projectPoints())
+	float x = X / Z, y = Y / Z;
+	float r2 = x*x + y*y;
+	float k1 = kc.at<float>(0,0), k2 = kc.at<float>(1,0), p1 = kc.at<float>(2,0), p2 = kc.at<float>(3,0), k3 = kc.at<float>(4,0);
+	float radial = 1.0f + r2*(k1 + r2*(k2 + r2*k3));
+	float x_dist = x*radial + 2.0f*p1*x*y + p2*(r2 + 2.0f*x*x);
+	float y_dist = y*radial + p1*(r2 + 2.0f*y*y) + 2.0f*p2*x*y;
+
+	point.x = KK.at<float>(0,0)*x_dist + KK.at<float>(0,1)*y_dist + KK.at<float>(0,2);
+	point.y = KK.at<float>(1,1)*y_dist + KK.at<float>(1,2);
+
+	return true;
+}
+
+
 cv::Mat
 MarkerTracking::get3DPointsFrom2DPoints(std::vector<cv::Point2f> points_2D_left, std::vector<cv::Point2f> points_2D_right)
 {
@@ -413,21 +734,21 @@ MarkerTracking::get3DPointsFrom2DPoints(std::vector<cv::Point2f> points_2D_left,
 
     // Lens undistortion
 
-    undistortPoints(points_left_dist, points_left_undist, KK_left, kc_left);
-    undistortPoints(points_right_dist, points_right_undist, KK_right, kc_right);
+    if (undistortion_map_left.isBuilt() && undistortion_map_right.isBuilt())
+      {
+        undistortion_map_left.undistortPoints(points_left_dist, points_left_undist);
+        undistortion_map_right.undistortPoints(points_right_dist, points_right_undist);
+      }
+    else
+      {
+        undistortPoints(points_left_dist, points_left_undist, KK_left, kc_left);
+        undistortPoints(points_right_dist, points_right_undist, KK_right, kc_right);
+      }
 
 
-    cv::Mat dist_F(num_points_left, num_points_right, CV_32F);
-    cv::Mat x_l(3, 1, CV_32F), x_r(3, 1, CV_32F), d(1, 1, CV_32F);
-    cv::Point2f point_l, point_r;
-    cv::Mat E(3, 3, CV_32F);
-    E = KK_right.t() * F_stereo_camera * KK_left;
     const float max_err_dist_candidate = 5.0f;
     const int num_max_matches = 200;
     int num_matches = 0;
-    cv::Mat points_match_left(2,num_max_matches,CV_32F), points_match_right(2,num_max_matches,CV_32F);
-    cv::Mat points_match_left2(1,num_max_matches,CV_32FC2), points_match_right2(1,num_max_matches,CV_32FC2);
-    float dist;
 
 	end_time = boost::posix_time::microsec_clock::universal_time();
 	time_diff = end_time - start_time;
@@ -436,39 +757,32 @@ MarkerTracking::get3DPointsFrom2DPoints(std::vector<cv::Point2f> points_2D_left,
     start_time = boost::posix_time::microsec_clock::universal_time();
 
 
-    // 3D correspondence candidates
+    // 3D correspondence candidates (|x_r^T * E * x_l| small, see EpipolarMatcher)
+
+    match_left.clear();
+    match_right.clear();
+    epipolar_matcher.setPoints(points_left_undist, points_right_undist);
+    if (do_use_epipolar_band)
+    	num_matches = epipolar_matcher.findCandidatesInBand(max_err_dist_candidate, epipolar_band_width, match_left, match_right);
+    else
+    	num_matches = epipolar_matcher.findCandidates(max_err_dist_candidate, num_max_matches, match_left, match_right);
+    num_pruned_pairs = epipolar_matcher.getNumPrunedPairs();
 
-    for(int row=0; row<num_points_left; row++)
+    cv::Mat points_match_left2(1, std::max(num_matches, 1), CV_32FC2), points_match_right2(1, std::max(num_matches, 1), CV_32FC2);
+    for(int m = 0; m < num_matches; m++)
       {
-        for(int col=0; col<num_points_right; col++)
-          {
-            point_l = points_left_undist.at<cv::Point2f>(0, row);
-            point_r = points_right_undist.at<cv::Point2f>(0, col);
-            x_l = (cv::Mat_<float>(3,1) << point_l.x, point_l.y, 1);
-            x_r = (cv::Mat_<float>(3,1) << point_r.x, point_r.y, 1);
-            d = (x_r.t() * E * x_l);
-            dist = d.at<float>(0,0);
-            dist_F.at<float>(row,col) = dist;
-
-            if(abs(dist) < max_err_dist_candidate && num_matches < num_max_matches)
-              {
-                points_match_left.at<float>(0, num_matches) = point_l.x;
-                points_match_left.at<float>(1, num_matches) = point_l.y;
-                points_match_right.at<float>(0, num_matches) = point_r.x;
-                points_match_right.at<float>(1, num_matches) = point_r.y;
-                points_match_left2.at<cv::Point2f>(0, num_matches) = point_l;
-                points_match_right2.at<cv::Point2f>(0, num_matches) = point_r;
-                num_matches++;
-              }
-          }
+        points_match_left2.at<cv::Point2f>(0, m) = points_left_undist.at<cv::Point2f>(0, match_left[m]);
+        points_match_right2.at<cv::Point2f>(0, m) = points_right_undist.at<cv::Point2f>(0, match_right[m]);
       }
 
+    cv::Mat E = E_stereo_camera.clone(); // cvCorrectMatches() needs a non-const matrix
     CvMat E_c = E;
 
 	end_time = boost::posix_time::microsec_clock::universal_time();
 	time_diff = end_time - start_time;
     if(do_profiling)
-      std::cout << std::endl << "x^T E x took " << time_diff.total_microseconds() << " us." << std::endl;
+      std::cout << std::endl << "x^T E x took " << time_diff.total_microseconds() << " us (" << num_matches << " candidates, "
+    		    << num_pruned_pairs << " pairs pruned)." << std::endl;
     start_time = boost::posix_time::microsec_clock::universal_time();
 
     if(num_matches == 0)
@@ -523,6 +837,179 @@ MarkerTracking::get3DPointsFrom2DPoints(std::vector<cv::Point2f> points_2D_left,
 }
 
 
+// Euclidean distance of two points of "dimension" coordinates (accumulated in double like cv::norm())
+static inline float
+pointDistance(const float *point_a, const float *point_b, int dimension)
+{
+	double sum = 0;
+	for (int i = 0; i < dimension; i++)
+	{
+		double diff = point_a[i] - point_b[i];
+		sum += diff*diff;
+	}
+	return (float)sqrt(sum);
+}
+
+
+// C = A*B of two poses (4x4, row major, last row 0 0 0 1)
+static inline void
+multiplyPoses(const float A[16], const float B[16], float C[16])
+{
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 4; c++)
+			C[4*r + c] = A[4*r]*B[c] + A[4*r + 1]*B[4 + c] + A[4*r + 2]*B[8 + c];
+		C[4*r + 3] += A[4*r + 3];
+	}
+	C[12] = 0; C[13] = 0; C[14] = 0; C[15] = 1;
+}
+
+
+// A_inv = inverse of the pose A (R^T, -R^T*t)
+static inline void
+invertPose(const float A[16], float A_inv[16])
+{
+	for (int r = 0; r < 3; r++)
+	{
+		for (int c = 0; c < 3; c++)
+			A_inv[4*r + c] = A[4*c + r];
+		A_inv[4*r + 3] = -(A[r]*A[3] + A[4 + r]*A[7] + A[8 + r]*A[11]);
+	}
+	A_inv[12] = 0; A_inv[13] = 0; A_inv[14] = 0; A_inv[15] = 1;
+}
+
+
+void
+MarkerTracking::TemplateFitWorkspace::setTemplate(const cv::Mat &marker_template)
+{
+	int num_temp = marker_template.cols;
+	int dimension = marker_template.rows;
+
+	std::vector<float> template_points(num_temp*dimension);
+	for (int a = 0; a < num_temp; a++)
+		for (int r = 0; r < dimension; r++)
+			template_points[a*dimension + r] = marker_template.at<float>(r,a);
+
+	// get edge lengths of Template (complete matrix)
+	num_template_points = num_temp;
+	edges_template.assign(num_temp*num_temp, 0.0f);
+	edges_template_max = 0;
+	edges_template_min = std::numeric_limits<float>::infinity();
+	for (int a = 0; a < num_temp; a++)
+	{
+		for (int b = 0; b < num_temp; b++)
+		{
+			float dist = pointDistance(&template_points[a*dimension], &template_points[b*dimension], dimension);
+			edges_template[a*num_temp + b] = dist;
+			if (dist > edges_template_max)
+				edges_template_max = dist;
+			if ((a!=b) && (dist < edges_template_min))
+				edges_template_min = dist;
+		}
+	}
+
+	sorted_edges_template.clear();
+	for (int a = 0; a < num_temp; a++)
+		for (int b = a+1; b < num_temp; b++)
+			sorted_edges_template.push_back(Edge(edges_template[a*num_temp + b], a, b));
+	std::sort(sorted_edges_template.begin(), sorted_edges_template.end(), EdgeLengthComp());
+
+	// Constraint:
+	num_test_edges = 15 + num_temp*(num_temp-1); // number of tested edges is 2*(number of edges in the object template)
+	edge_matches.reserve(num_test_edges);
+	num_edge_matches = 0;
+
+	TemplateTrackingStatistics no_tracking = { TEMPLATE_LOST, 0, 0, 0 };
+	tracking = no_tracking;
+	tracked_template_idx.assign(num_temp, -1);
+	tracked_world_idx.assign(num_temp, -1);
+
+	best_template_idx.assign(num_temp*num_temp, -1);
+	best_world_idx.assign(num_temp*num_temp, -1);
+	best_template_to_world.assign(num_temp*num_temp, -1);
+	best_residuum.assign(num_temp, 0.0f);
+	residuum_max.assign(num_temp, 0.0f);
+	avg_edge_residuum.assign(num_temp, 0.0f);
+	my_template = cv::Mat::zeros(3, num_temp, CV_32F);
+	my_points = cv::Mat::zeros(3, num_temp, CV_32F);
+}
+
+
+void
+MarkerTracking::TemplateFitWorkspace::clearEdgeMatches()
+{
+	edge_matches.clear();
+	num_edge_matches = 0;
+}
+
+
+void
+MarkerTracking::TemplateFitWorkspace::addEdgeMatch(float dist, int a, int b, int x, int y)
+{
+	num_edge_matches++;
+
+	if ((int)edge_matches.size() < num_test_edges)
+	{
+		edge_matches.push_back(edge_match(dist, a, b, x, y));
+		std::push_heap(edge_matches.begin(), edge_matches.end(), edge_match_worst_comp());
+	}
+	else if (num_test_edges > 0 && dist < edge_matches.front().dist)
+	{
+		// Replace the worst kept match
+		std::pop_heap(edge_matches.begin(), edge_matches.end(), edge_match_worst_comp());
+		edge_matches.back() = edge_match(dist, a, b, x, y);
+		std::push_heap(edge_matches.begin(), edge_matches.end(), edge_match_worst_comp());
+	}
+}
+
+
+void
+MarkerTracking::TemplateFitWorkspace::sortEdgeMatches()
+{
+	std::sort_heap(edge_matches.begin(), edge_matches.end(), edge_match_worst_comp());
+
+	// The search tests at most half of all found matches (rounded up)
+	int num_tested = std::min((int)edge_matches.size(), (num_edge_matches+1)/2);
+	edge_matches.resize(num_tested, edge_match(0, 0, 0, 0, 0));
+}
+
+
+void
+MarkerTracking::WorldEdges::set(const cv::Mat &points_3D, bool do_sort)
+{
+	int num_p = points_3D.cols;
+	int dimension = points_3D.rows;
+
+	num_points = num_p;
+	points.resize(num_p*dimension);
+	for (int r = 0; r < dimension; r++)
+	{
+		const float *row = points_3D.ptr<float>(r);
+		for (int a = 0; a < num_p; a++)
+			points[a*dimension + r] = row[a];
+	}
+
+	// Undirected graph => adjacency matrix symmetric => compute only the upper triangular matrix and mirror it
+	edges.resize(num_p*num_p);
+	sorted_edges.clear();
+	for (int a = 0; a < num_p; a++)
+	{
+		edges[a*num_p + a] = 0.0f;
+		for (int b = a+1; b < num_p; b++)
+		{
+			float dist = pointDistance(&points[a*dimension], &points[b*dimension], dimension);
+			edges[a*num_p + b] = dist;
+			edges[b*num_p + a] = dist;
+			if (do_sort)
+				sorted_edges.push_back(Edge(dist, a, b));
+		}
+	}
+
+	if (do_sort)
+		std::sort(sorted_edges.begin(), sorted_edges.end(), EdgeLengthComp());
+}
+
+
 void
 MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int template_id, cv::Mat &RT, float *avg_deviation)
 {
@@ -531,6 +1018,11 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 		std::cerr << "MarkerTracking: fit3DPointsToObjectTemplate() - motion capture system NOT configured yet" << std::endl;
 		return;
 	}
+	if (template_id < 0 || template_id >= (int)fit_workspaces.size())
+	{
+		std::cerr << "MarkerTracking: fit3DPointsToObjectTemplate() - no template " << template_id << std::endl;
+		return;
+	}
 
 	boost::posix_time::ptime start_time, end_time;
 	boost::posix_time::time_duration time_diff;
@@ -539,127 +1031,213 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
     // Template search
 
 	// Constraint:
-    const float max_distance = 20.0;
-    const int min_correspondences = 4;
-    cv::Mat marker_template = object_templates[template_id];
-    int num_temp = marker_template.cols;
+    const float max_distance = TEMPLATE_MAX_EDGE_DISTANCE;
+
+    // Buffers of this template (reused => no allocation once big enough)
+    TemplateFitWorkspace& workspace = *fit_workspaces[template_id];
+    boost::mutex::scoped_lock workspace_lock(workspace.mutex);
+
+    // Tracked => no full search
+    if (template_tracking_gate > 0 && trackTemplate(points_3D, template_id, workspace, RT, avg_deviation))
+    {
+    	end_time = boost::posix_time::microsec_clock::universal_time();
+    	time_diff = end_time - start_time;
+        if(do_profiling)
+          std::cout << std::endl << "Template Tracking took " << time_diff.total_microseconds() << " us." << std::endl;
+    	return;
+    }
+
     int num_p = points_3D.cols;
 
-    // get edge lengths of Template
-    cv::Mat edges_template = cv::Mat::zeros(num_temp, num_temp, CV_32F);
-    float edges_template_max = 0;
-    float edges_template_min = std::numeric_limits<float>::infinity();
-    for(int a = 0; a < num_temp; a++)
-      {
-    	// compute complete matrix
-        for(int b = 0; b < num_temp; b++)
-          {
-            float dist = (float)norm( marker_template.col(a) - marker_template.col(b) );
-            edges_template.at<float>(a,b) = dist;
-            if(dist > edges_template_max)
-              edges_template_max = dist;
-            if((a!=b)&&(dist < edges_template_min))
-              edges_template_min = dist;
-          }
-      }
+    // Edge lengths of the template (computed by readObjectConfigFile()) and of ALL points (adjacency matrix)
+    workspace.world_edges.set(points_3D, false);
+    const std::vector<float>& edges_world = workspace.world_edges.edges;
 
 	// Constraint:
-    edges_template_max += max_distance;
+    float edges_template_max = workspace.edges_template_max + max_distance;
 
 	// Constraint:
-    edges_template_min -= max_distance;
+    float edges_template_min = workspace.edges_template_min - max_distance;
     if (edges_template_min < 0.0) 
     	edges_template_min = 0.0;
 
 
-    // Find the best few edge matches and get edge lengths of ALL points (adjacency matrix)
-    cv::Mat edges_world = cv::Mat::zeros(num_p, num_p, CV_32F);
-    std::priority_queue<edge_match, std::vector<edge_match>, edge_match_comp> edge_matches;
+    // Find the best few edge matches: for every 3D point edge, the template edges of length +-max_distance
+    // (binary search in the sorted template edges)
+    const std::vector<Edge>& sorted_edges_template = workspace.sorted_edges_template;
+    workspace.clearEdgeMatches();
     for(int a = 0; a < num_p; a++)
       {
-    	// Undirected graph => adjacency matrix symmetric => fill only upper triangular matrix
+    	// Undirected graph => adjacency matrix symmetric => test only the upper triangular matrix
         for(int b = a+1; b < num_p; b++)
           {	     
-        	edges_world.at<float>(a,b) = (float)norm( points_3D.col(a) - points_3D.col(b) );
-            if ((edges_world.at<float>(a,b) > edges_template_max) || (edges_world.at<float>(a,b) < edges_template_min))
+        	float edge_a_b = edges_world[a*num_p + b];
+            if ((edge_a_b > edges_template_max) || (edge_a_b < edges_template_min))
               continue;
 
-            for(int x = 0; x < num_temp; x++)
+            std::vector<Edge>::const_iterator it = std::upper_bound(sorted_edges_template.begin(), sorted_edges_template.end(),
+            														edge_a_b - max_distance, EdgeLengthComp());
+            for (; it != sorted_edges_template.end() && it->length < edge_a_b + max_distance; ++it)
               {
-                for(int y = x+1; y < num_temp; y++)
-                  {
-                    float dist = abs(edges_world.at<float>(a,b) - edges_template.at<float>(x,y));
-                    // Constraint:
-                    if(dist < max_distance)
-                      {
-                        edge_matches.push(edge_match(dist, a, b, x, y));
-                      }
-                  }
+                float dist = fabs(edge_a_b - it->length);
+                // Constraint:
+                if(dist < max_distance)
+                  workspace.addEdgeMatch(dist, a, b, it->a, it->b);
               }
           }
       }
 
+    fitEdgeMatches(points_3D, template_id, workspace, workspace.world_edges, RT, avg_deviation);
+    if (template_tracking_gate > 0)
+    	updateTemplateTracking(workspace, RT, *avg_deviation);
 
-	// LIST of the best found template/world point indexes (i. column = values for i corresponding points)
-	std::vector<std::vector<int> > best_world_idx;
-	std::vector<std::vector<int> > best_template_idx;
-	// Best ASSIGNMENT between template points <-> world points (i. column = values for i corresponding points)
-	std::vector<std::vector<int> > best_template_to_world;
-	std::vector<std::vector<int> > best_world_to_template;
+	end_time = boost::posix_time::microsec_clock::universal_time();
+	time_diff = end_time - start_time;
+    if(do_profiling)
+      std::cout << std::endl << "Template Search (residuum) took " << time_diff.total_microseconds() << " us." << std::endl;
+}
 
-	best_template_to_world.resize(num_temp);
-	best_template_idx.resize(num_temp);
-	best_world_to_template.resize(num_p);
-	best_world_idx.resize(num_p);
 
-	for (int i = 0; i < num_temp; i++)
-	{		
-		best_template_to_world[i].resize(num_temp);
-		best_template_idx[i].resize(num_temp);
-	}
-	for (int i = 0; i < num_p; i++)
+void
+MarkerTracking::fit3DPointsToObjectTemplates(const cv::Mat &points_3D, std::vector<cv::Mat> &RT, std::vector<float> &avg_deviations)
+{
+	if (!is_configured)
 	{
-		best_world_to_template[i].resize(num_temp);
-		best_world_idx[i].resize(num_temp);
+		std::cerr << "MarkerTracking: fit3DPointsToObjectTemplates() - motion capture system NOT configured yet" << std::endl;
+		return;
 	}
 
-	for (int i = 0; i < num_temp; i++)
+	boost::posix_time::ptime start_time, end_time;
+	boost::posix_time::time_duration time_diff;
+	start_time = boost::posix_time::microsec_clock::universal_time();
+
+	int num_fit_templates = (int)fit_workspaces.size();
+	RT.resize(num_fit_templates);
+	avg_deviations.resize(num_fit_templates);
+
+	boost::mutex::scoped_lock frame_edges_lock(frame_edges_mutex);
+
+	// Tracked templates first (cheap), only the others need the full search
+	search_order.clear();
+	for (int i = 0; i < num_fit_templates; i++)
 	{
-		for (int j = 0; j < num_temp; j++)
-		{
-			best_template_to_world[i][j] = -1;
-			best_template_idx[i][j] = -1;
-		}
+		int template_id = fit_order[i];
+		TemplateFitWorkspace& workspace = *fit_workspaces[template_id];
+		boost::mutex::scoped_lock workspace_lock(workspace.mutex);
+		if (template_tracking_gate <= 0 || !trackTemplate(points_3D, template_id, workspace, RT[template_id], &avg_deviations[template_id]))
+			search_order.push_back(template_id);
 	}
-	for (int i = 0; i < num_p; i++)
+	int num_search_templates = (int)search_order.size();
+
+	// Edge lengths of ALL points once for all templates (sorted => edge matches by binary search)
+	if (num_search_templates > 0)
+		frame_edges.set(points_3D, true);
+
+	// Dynamic scheduling, templates with the most points (most expensive search) first
+	// => a thread that finished its template takes the next one, while an expensive template is still searched
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < num_search_templates; i++)
 	{
-		for (int j = 0; j < num_temp; j++)
+		int template_id = search_order[i];
+		const float max_distance = TEMPLATE_MAX_EDGE_DISTANCE;
+
+		TemplateFitWorkspace& workspace = *fit_workspaces[template_id];
+		boost::mutex::scoped_lock workspace_lock(workspace.mutex);
+
+		int num_temp = workspace.num_template_points;
+		const std::vector<float>& edges_template = workspace.edges_template;
+
+		// Find the best few edge matches: for every template edge, the world edges of length +-max_distance
+		// (these are also in the [min...max] range of fit3DPointsToObjectTemplate())
+		workspace.clearEdgeMatches();
+		for(int x = 0; x < num_temp; x++)
 		{
-			best_world_to_template[i][j] = -1;
-			best_world_idx[i][j] = -1;
+			for(int y = x+1; y < num_temp; y++)
+			{
+				float edge_x_y = edges_template[x*num_temp + y];
+				std::vector<Edge>::const_iterator it = std::upper_bound(frame_edges.sorted_edges.begin(), frame_edges.sorted_edges.end(),
+																			 edge_x_y - max_distance, EdgeLengthComp());
+				for (; it != frame_edges.sorted_edges.end() && it->length < edge_x_y + max_distance; ++it)
+				{
+					float dist = fabs(it->length - edge_x_y);
+					// Constraint:
+					if(dist < max_distance)
+						workspace.addEdgeMatch(dist, it->a, it->b, x, y);
+				}
+			}
 		}
+
+		fitEdgeMatches(points_3D, template_id, workspace, frame_edges, RT[template_id], &avg_deviations[template_id]);
+		if (template_tracking_gate > 0)
+			updateTemplateTracking(workspace, RT[template_id], avg_deviations[template_id]);
 	}
 
+	end_time = boost::posix_time::microsec_clock::universal_time();
+	time_diff = end_time - start_time;
+    if(do_profiling)
+      std::cout << std::endl << "Template Search (residuum) of " << num_search_templates << " of " << num_fit_templates << " templates took " << time_diff.total_microseconds() << " us." << std::endl;
+}
+
+
+void
+MarkerTracking::fitEdgeMatches(const cv::Mat &points_3D, int template_id, TemplateFitWorkspace &workspace, const WorldEdges &world_edges,
+								cv::Mat &RT, float *avg_deviation)
+{
+	// Constraint:
+    const float max_distance = TEMPLATE_MAX_EDGE_DISTANCE;
+    const int min_correspondences = TEMPLATE_MIN_CORRESPONDENCES;
+    const cv::Mat& marker_template = object_templates[template_id];
+
+    int num_temp = workspace.num_template_points;
+    int num_p = world_edges.num_points;
+    const std::vector<float>& edges_template = workspace.edges_template;
+    const std::vector<float>& edges_world = world_edges.edges;
+
+    // Best edge matches first (at most num_test_edges)
+    workspace.sortEdgeMatches();
+    const std::vector<edge_match>& edge_matches = workspace.edge_matches;
+
+	// Constraint:
+    float edges_template_max = workspace.edges_template_max + max_distance;
+
+	// Constraint:
+    float edges_template_min = workspace.edges_template_min - max_distance;
+    if (edges_template_min < 0.0) 
+    	edges_template_min = 0.0;
+
+
+	// LIST of the best found template/world point indexes and best ASSIGNMENT between template points <-> world points
+	// (row c = values for c+1 corresponding points, e.g. best_template_idx[c*num_temp + i])
+	std::vector<int>& best_world_idx = workspace.best_world_idx;
+	std::vector<int>& best_template_idx = workspace.best_template_idx;
+	std::vector<int>& best_template_to_world = workspace.best_template_to_world;
+	std::vector<int>& best_world_to_template = workspace.best_world_to_template;
+
+	std::fill(best_world_idx.begin(), best_world_idx.end(), -1);
+	std::fill(best_template_idx.begin(), best_template_idx.end(), -1);
+	std::fill(best_template_to_world.begin(), best_template_to_world.end(), -1);
+	best_world_to_template.resize(num_temp*num_p);
+	std::fill(best_world_to_template.begin(), best_world_to_template.end(), -1);
+
 
 	float my_residuum=std::numeric_limits<float>::infinity();
-	std::vector<float> best_residuum, residuum_max;
+	std::vector<float>& best_residuum = workspace.best_residuum;
+	std::vector<float>& residuum_max = workspace.residuum_max;
 	for (int i = 0; i < num_temp; i++)
 	{
-		best_residuum.push_back(std::numeric_limits<float>::infinity());
+		best_residuum[i] = std::numeric_limits<float>::infinity();
 		// Constraint:
-		residuum_max.push_back((i+1)*max_distance);
+		residuum_max[i] = (i+1)*max_distance;
 	}
 
 
-	// Constraint:
-	int num_test_edges = 15 + num_temp*(num_temp-1); // number of tested edges is 2*(number of edges in the object template)
-
-	cv::Mat my_template=cv::Mat::zeros(3,num_temp,CV_32F), my_points=cv::Mat::zeros(3,num_temp,CV_32F);
+	cv::Mat& my_template = workspace.my_template;
+	cv::Mat& my_points = workspace.my_points;
 
 // 2 correspondences (a,b) <-> (x,y)
-	for(int e = 0; e < (int)edge_matches.size() && e < num_test_edges; e++)
+	for(int e = 0; e < (int)edge_matches.size(); e++)
 	{
-        edge_match m = edge_matches.top();
+        const edge_match& m = edge_matches[e];
         int a=m.a, b=m.b, x=m.x, y=m.y;
 
 // 3 correspondences (a,b,c) <-> (x,y,z)
@@ -668,25 +1246,10 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
             if(a==c || b==c)
             	continue;
 
-            float edge_a_b = 0.0;
-            float edge_a_c = 0.0;
-            float edge_b_c = 0.0;
-
-			// Lower triangle matrix not filled (symmetric) -> take correspondent from upper matrix
-			if (a > b)
-				edge_a_b = edges_world.at<float>(b,a);
-			else
-				edge_a_b = edges_world.at<float>(a,b);
-
-			if (a > c)
-				edge_a_c = edges_world.at<float>(c,a);
-			else
-				edge_a_c = edges_world.at<float>(a,c);
-
-			if (b > c)
-				edge_b_c = edges_world.at<float>(c,b);
-			else
-				edge_b_c = edges_world.at<float>(b,c);
+            // (adjacency matrix filled symmetric)
+            float edge_a_b = edges_world[a*num_p + b];
+            float edge_a_c = edges_world[a*num_p + c];
+            float edge_b_c = edges_world[b*num_p + c];
 	    
 			// Test if edges of new point in cv::Range
             if(edge_a_c > edges_template_max || edge_a_c < edges_template_min  || edge_b_c > edges_template_max || edge_b_c < edges_template_min)
@@ -696,9 +1259,9 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
             {
 				int my_num_corres = 3;
 
-				float dist_a_b = edge_a_b - edges_template.at<float>(x,y);
-				float dist_a_c = edge_a_c - edges_template.at<float>(x,z);
-				float dist_b_c = edge_b_c - edges_template.at<float>(y,z);
+				float dist_a_b = edge_a_b - edges_template[x*num_temp + y];
+				float dist_a_c = edge_a_c - edges_template[x*num_temp + z];
+				float dist_b_c = edge_b_c - edges_template[y*num_temp + z];
 
 				my_residuum = dist_a_b*dist_a_b + dist_a_c*dist_a_c + dist_b_c*dist_b_c;
 
@@ -708,37 +1271,35 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 
 				best_residuum[my_num_corres-1] = my_residuum;
 
-
-				for (int i = 0; i < num_temp; i++)
-				{
-					best_template_idx[i][my_num_corres-1] = -1;
-					best_template_to_world[i][my_num_corres-1] = -1;
-				}
-				for (int i = 0; i < num_p; i++)
-				{
-					best_world_idx[i][my_num_corres-1] = -1;
-					best_world_to_template[i][my_num_corres-1] = -1;
-				}
-
-				best_template_idx[0][my_num_corres-1] = x;
-				best_template_idx[1][my_num_corres-1] = y;
-				best_template_idx[2][my_num_corres-1] = z;
-				best_world_idx[0][my_num_corres-1] = a;
-				best_world_idx[1][my_num_corres-1] = b;
-				best_world_idx[2][my_num_corres-1] = c;
-
-				best_template_to_world[x][my_num_corres-1] = a;
-				best_template_to_world[y][my_num_corres-1] = b;
-				best_template_to_world[z][my_num_corres-1] = c;
-				best_world_to_template[a][my_num_corres-1] = x;
-				best_world_to_template[b][my_num_corres-1] = y;
-				best_world_to_template[c][my_num_corres-1] = z;
+				int *template_idx = &best_template_idx[(my_num_corres-1)*num_temp];
+				int *world_idx = &best_world_idx[(my_num_corres-1)*num_temp];
+				int *template_to_world = &best_template_to_world[(my_num_corres-1)*num_temp];
+				int *world_to_template = &best_world_to_template[(my_num_corres-1)*num_p];
+
+				std::fill(template_idx, template_idx + num_temp, -1);
+				std::fill(world_idx, world_idx + num_temp, -1);
+				std::fill(template_to_world, template_to_world + num_temp, -1);
+				std::fill(world_to_template, world_to_template + num_p, -1);
+
+				template_idx[0] = x;
+				template_idx[1] = y;
+				template_idx[2] = z;
+				world_idx[0] = a;
+				world_idx[1] = b;
+				world_idx[2] = c;
+
+				template_to_world[x] = a;
+				template_to_world[y] = b;
+				template_to_world[z] = c;
+				world_to_template[a] = x;
+				world_to_template[b] = y;
+				world_to_template[c] = z;
 
 // 4+ correspondences (a,b,c,...) ~ (x,y,z,...)
 				while(my_num_corres < num_temp)
 				{
 					// Find closest point
-					unsigned int best_world_idx_local=-1, best_template_idx_local=-1;
+					int best_world_idx_local=-1, best_template_idx_local=-1;
 					float new_residuum=std::numeric_limits<float>::infinity(); // only additional terms for residuum
 					float best_new_residuum=std::numeric_limits<float>::infinity();
 
@@ -746,14 +1307,14 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 					for (int i=0; i<num_temp; i++)
 					{
 						// Test if already assigned
-						if(best_template_to_world[i][my_num_corres-1] >= 0)
+						if(template_to_world[i] >= 0)
 							continue;
 
 						// Go through ALL world points (that are NOT assigned yet) -> take world correspondent with smallest residuum
 						for (int j=0; j<num_p; j++)
 						{
 							// Test if already assigned
-							if(best_world_to_template[j][my_num_corres-1] >= 0)
+							if(world_to_template[j] >= 0)
 								continue;
 
 							new_residuum = 0.0;
@@ -762,13 +1323,7 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 							// -> check if edges (corresp <-> ACTUAL world point) are in range and best residuum so far
 							for (int k=0; k<my_num_corres; k++)
 							{
-								float new_edge_world = 0.0;
-
-								// only upper triangle matrix filled
-								if (j > best_world_idx[k][my_num_corres-1])
-									new_edge_world = edges_world.at<float>(best_world_idx[k][my_num_corres-1],j);
-								else
-									new_edge_world = edges_world.at<float>(j,best_world_idx[k][my_num_corres-1]);
+								float new_edge_world = edges_world[world_idx[k]*num_p + j];
 
 								// edge in [min...max] range?
 								if ((new_edge_world > edges_template_max) || (new_edge_world < edges_template_min))
@@ -779,8 +1334,8 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 
 								// Test if the edge from the actual (j.) world candidate to the other (k.) correspondants fit to
 								// the edges from the assigned object template points to the "next" template point
-								float new_edge_template = edges_template.at<float>(i,best_template_idx[k][my_num_corres-1]);
-								float new_dist = abs(new_edge_world - new_edge_template);
+								float new_edge_template = edges_template[i*num_temp + template_idx[k]];
+								float new_dist = fabs(new_edge_world - new_edge_template);
 								// Constraint:
 								if (new_dist > max_distance)
 								{
@@ -806,30 +1361,33 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 						break;
 					
 					best_residuum[my_num_corres] = my_residuum;
-					
-					for (int i= 0; i<my_num_corres; i++)
-					{
-						best_template_idx[i][my_num_corres] = best_template_idx[i][my_num_corres-1];
-						best_world_idx[i][my_num_corres] = best_world_idx[i][my_num_corres-1];
-					}
-					best_template_idx[my_num_corres][my_num_corres] = best_template_idx_local;
-					best_world_idx[my_num_corres][my_num_corres] = best_world_idx_local;
 
+					// Next row: the assignment so far plus the new correspondence
+					int *next_template_idx = template_idx + num_temp;
+					int *next_world_idx = world_idx + num_temp;
+					int *next_template_to_world = template_to_world + num_temp;
+					int *next_world_to_template = world_to_template + num_p;
+
+					std::copy(template_idx, template_idx + my_num_corres, next_template_idx);
+					std::copy(world_idx, world_idx + my_num_corres, next_world_idx);
+					next_template_idx[my_num_corres] = best_template_idx_local;
+					next_world_idx[my_num_corres] = best_world_idx_local;
+
+					std::copy(template_to_world, template_to_world + num_temp, next_template_to_world);
+					std::copy(world_to_template, world_to_template + num_p, next_world_to_template);
+					next_template_to_world[best_template_idx_local] = best_world_idx_local;
+					next_world_to_template[best_world_idx_local] = best_template_idx_local;
 
-					for (int i=0; i<num_temp;i++)
-						best_template_to_world[i][my_num_corres] = best_template_to_world[i][my_num_corres-1];
-					for (int i=0; i<num_p;i++)
-						best_world_to_template[i][my_num_corres] = best_world_to_template[i][my_num_corres-1];
-					best_template_to_world[best_template_idx_local][my_num_corres] = best_world_idx_local;
-					best_world_to_template[best_world_idx_local][my_num_corres] = best_template_idx_local;
+					template_idx = next_template_idx;
+					world_idx = next_world_idx;
+					template_to_world = next_template_to_world;
+					world_to_template = next_world_to_template;
 
 					my_num_corres++;
 				}
 		
             }
         }
-
-        edge_matches.pop();
 	}
 
 	if (best_residuum[min_correspondences-1] == std::numeric_limits<float>::infinity())
@@ -838,17 +1396,16 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 			std::cerr << "Not enough correspondences found - num_temp = " << num_temp << std::endl;
 		RT = cv::Mat::zeros(4, 4, CV_32F);
 		*avg_deviation = std::numeric_limits<float>::infinity();
+		setLastPose(template_id, cv::Mat());
 		return;
 	}
 
 	// Decide which result with which number of correspondances to take
 	// (the smaller the residuum the better but also the more correspondants the better)
-	unsigned int best_num_corres = 4;
+	int best_num_corres = 4;
 
 	int num_edges=0;
-	std::vector<float>avg_edge_residuum;
-	for(int i=0; i<num_temp; i++)
-		avg_edge_residuum.push_back(0);
+	std::vector<float>& avg_edge_residuum = workspace.avg_edge_residuum;
 	avg_edge_residuum[0] = std::numeric_limits<float>::infinity();
 	for (int i=1; i<num_temp; i++)
 	{
@@ -873,14 +1430,16 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 	}
 
 
-	for(unsigned int i = 0; i<best_num_corres; i++)
+	const int *template_idx = &best_template_idx[(best_num_corres-1)*num_temp];
+	const int *world_idx = &best_world_idx[(best_num_corres-1)*num_temp];
+	for(int i = 0; i<best_num_corres; i++)
 	{
-		my_points.at<float>(0,i) = points_3D.at<float>(0,best_world_idx[i][best_num_corres-1]);
-		my_points.at<float>(1,i) = points_3D.at<float>(1,best_world_idx[i][best_num_corres-1]);
-		my_points.at<float>(2,i) = points_3D.at<float>(2,best_world_idx[i][best_num_corres-1]);
-		my_template.at<float>(0,i) = marker_template.at<float>(0,best_template_idx[i][best_num_corres-1]);
-		my_template.at<float>(1,i) = marker_template.at<float>(1,best_template_idx[i][best_num_corres-1]);
-		my_template.at<float>(2,i) = marker_template.at<float>(2,best_template_idx[i][best_num_corres-1]);
+		my_points.at<float>(0,i) = points_3D.at<float>(0,world_idx[i]);
+		my_points.at<float>(1,i) = points_3D.at<float>(1,world_idx[i]);
+		my_points.at<float>(2,i) = points_3D.at<float>(2,world_idx[i]);
+		my_template.at<float>(0,i) = marker_template.at<float>(0,template_idx[i]);
+		my_template.at<float>(1,i) = marker_template.at<float>(1,template_idx[i]);
+		my_template.at<float>(2,i) = marker_template.at<float>(2,template_idx[i]);
 	}
 		
 	
@@ -888,6 +1447,9 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 
 	*avg_deviation = avg_edge_residuum[best_num_corres-1];
 
+	// Last pose for the ROI segmentation of the next frame
+	setLastPose(template_id, RT);
+
 
 	if (do_profiling)
 	{
@@ -895,11 +1457,222 @@ MarkerTracking::fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int templa
 		std::cout << "best_num_corres = " << best_num_corres << std::endl;
 		std::cout << "avg_deviation = " << avg_deviation << " (avg_edge_residuum)" << std::endl;
 	}
+}
 
-	end_time = boost::posix_time::microsec_clock::universal_time();
-	time_diff = end_time - start_time;
-    if(do_profiling)
-      std::cout << std::endl << "Template Search (residuum) took " << time_diff.total_microseconds() << " us." << std::endl;
+
+bool
+MarkerTracking::trackTemplate(const cv::Mat &points_3D, int template_id, TemplateFitWorkspace &workspace, cv::Mat &RT, float *avg_deviation)
+{
+	TemplateTrackingStatistics& tracking = workspace.tracking;
+	if (tracking.state == TEMPLATE_LOST || points_3D.rows < 3)
+		return false;
+
+	// Predicted pose: pose change of the last frame applied again (constant velocity), else the last pose
+	float RT_predicted[16];
+	if (tracking.state == TEMPLATE_TRACKING)
+	{
+		float RT_previous_inv[16], RT_velocity[16];
+		invertPose(workspace.RT_previous, RT_previous_inv);
+		multiplyPoses(workspace.RT_last, RT_previous_inv, RT_velocity);
+		multiplyPoses(RT_velocity, workspace.RT_last, RT_predicted);
+	}
+	else
+		std::copy(workspace.RT_last, workspace.RT_last + 16, RT_predicted);
+
+	const cv::Mat& marker_template = object_templates[template_id];
+	int num_temp = workspace.num_template_points;
+	int num_p = points_3D.cols;
+	const float *points_x = points_3D.ptr<float>(0);
+	const float *points_y = points_3D.ptr<float>(1);
+	const float *points_z = points_3D.ptr<float>(2);
+
+	// Nearest 3D point of every predicted marker within the gate
+	const float max_squared_dist = template_tracking_gate*template_tracking_gate;
+	std::vector<int>& template_idx = workspace.tracked_template_idx;
+	std::vector<int>& world_idx = workspace.tracked_world_idx;
+	int num_corres = 0;
+	for (int i = 0; i < num_temp; i++)
+	{
+		float X = marker_template.at<float>(0,i), Y = marker_template.at<float>(1,i), Z = marker_template.at<float>(2,i);
+		float predicted[3];
+		for (int j = 0; j < 3; j++)
+			predicted[j] = RT_predicted[4*j]*X + RT_predicted[4*j + 1]*Y + RT_predicted[4*j + 2]*Z + RT_predicted[4*j + 3];
+
+		int nearest = -1;
+		float nearest_squared_dist = max_squared_dist;
+		for (int k = 0; k < num_p; k++)
+		{
+			float dx = points_x[k] - predicted[0], dy = points_y[k] - predicted[1], dz = points_z[k] - predicted[2];
+			float squared_dist = dx*dx + dy*dy + dz*dz;
+			if (squared_dist < nearest_squared_dist)
+			{
+				nearest_squared_dist = squared_dist;
+				nearest = k;
+			}
+		}
+		if (nearest < 0)
+			continue;
+
+		// A 3D point nearest to two markers => ambiguous => full search
+		for (int c = 0; c < num_corres; c++)
+			if (world_idx[c] == nearest)
+				return false;
+
+		template_idx[num_corres] = i;
+		world_idx[num_corres] = nearest;
+		num_corres++;
+	}
+
+	// Constraint:
+	if (num_corres < TEMPLATE_MIN_CORRESPONDENCES)
+		return false;
+
+	// Edge residuum of the correspondences (as in the full search)
+	const std::vector<float>& edges_template = workspace.edges_template;
+	float residuum = 0;
+	for (int c = 0; c < num_corres; c++)
+	{
+		for (int d = c+1; d < num_corres; d++)
+		{
+			double dx = points_x[world_idx[c]] - points_x[world_idx[d]];
+			double dy = points_y[world_idx[c]] - points_y[world_idx[d]];
+			double dz = points_z[world_idx[c]] - points_z[world_idx[d]];
+			float dist = (float)sqrt(dx*dx + dy*dy + dz*dz) - edges_template[template_idx[c]*num_temp + template_idx[d]];
+			residuum += dist*dist;
+		}
+	}
+
+	// Constraint (residuum_max of the full search):
+	if (residuum > num_corres*TEMPLATE_MAX_EDGE_DISTANCE)
+		return false;
+
+	cv::Mat& my_template = workspace.my_template;
+	cv::Mat& my_points = workspace.my_points;
+	for (int c = 0; c < num_corres; c++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			my_points.at<float>(j,c) = points_3D.at<float>(j,world_idx[c]);
+			my_template.at<float>(j,c) = marker_template.at<float>(j,template_idx[c]);
+		}
+	}
+
+	fitTwoPointSets(my_template.colRange(0,num_corres), my_points.colRange(0,num_corres), num_corres, RT, avg_deviation);
+
+	// Average edge residuum with the factor of the full search (the more correspondences, the better)
+	float factor_ = 1.0;
+	for (int j = num_corres; j < num_temp; j++)
+		factor_ = factor_*1.65f;
+	*avg_deviation = factor_*residuum/(num_corres*(num_corres-1)/2);
+
+	std::copy(workspace.RT_last, workspace.RT_last + 16, workspace.RT_previous);
+	std::copy(RT.ptr<float>(0), RT.ptr<float>(0) + 16, workspace.RT_last);
+	tracking.state = TEMPLATE_TRACKING;
+	tracking.num_tracked++;
+
+	setLastPose(template_id, RT);
+
+	return true;
+}
+
+
+void
+MarkerTracking::updateTemplateTracking(TemplateFitWorkspace &workspace, const cv::Mat &RT, float avg_deviation)
+{
+	TemplateTrackingStatistics& tracking = workspace.tracking;
+	tracking.num_full_searches++;
+
+	if (avg_deviation == std::numeric_limits<float>::infinity())
+	{
+		if (tracking.state != TEMPLATE_LOST)
+			tracking.num_losses++;
+		tracking.state = TEMPLATE_LOST;
+		return;
+	}
+
+	// Found in the last frame too (else lost) => velocity known
+	if (tracking.state == TEMPLATE_LOST)
+		tracking.state = TEMPLATE_ACQUIRING;
+	else
+	{
+		std::copy(workspace.RT_last, workspace.RT_last + 16, workspace.RT_previous);
+		tracking.state = TEMPLATE_TRACKING;
+	}
+	std::copy(RT.ptr<float>(0), RT.ptr<float>(0) + 16, workspace.RT_last);
+}
+
+
+MarkerTracking::TemplateTrackingStatistics
+MarkerTracking::getTemplateTrackingStatistics(int template_id)
+{
+	if (template_id < 0 || template_id >= (int)fit_workspaces.size())
+	{
+		std::cerr << "MarkerTracking: getTemplateTrackingStatistics() - no template " << template_id << std::endl;
+		TemplateTrackingStatistics no_tracking = { TEMPLATE_LOST, 0, 0, 0 };
+		return no_tracking;
+	}
+
+	TemplateFitWorkspace& workspace = *fit_workspaces[template_id];
+	boost::mutex::scoped_lock workspace_lock(workspace.mutex);
+	return workspace.tracking;
+}
+
+
+void
+MarkerTracking::filterPoses(long long timestamp_us, std::vector<cv::Mat> &RT)
+{
+	boost::mutex::scoped_lock lock(pose_filter_mutex);
+
+	int num_poses = std::min((int)RT.size(), (int)pose_filters.size());
+	for(int i = 0; i < num_poses; i++)
+	{
+		PoseFilter& pose_filter = pose_filters[i];
+
+		if (RT[i].total() != 16 || RT[i].type() != CV_32F || cv::countNonZero(RT[i]) == 0)
+		{
+			if (pose_filter.isInitialized() && timestamp_us - pose_filter.getTimestamp() > POSE_FILTER_TIMEOUT_US)
+				pose_filter.reset();
+			continue;
+		}
+
+		float RT_measured[16];
+		cv::Mat RT_continuous = RT[i].isContinuous() ? RT[i] : RT[i].clone();
+		std::copy(RT_continuous.ptr<float>(0), RT_continuous.ptr<float>(0) + 16, RT_measured);
+		pose_filter.update(timestamp_us, RT_measured);
+
+		// New matrix: RT[i] may share its data with the fitted pose of other stages
+		cv::Mat RT_filtered(4, 4, CV_32F);
+		pose_filter.getPose(RT_filtered.ptr<float>(0));
+		RT[i] = RT_filtered;
+	}
+}
+
+
+bool
+MarkerTracking::predictPose(int template_id, long long timestamp_us, cv::Mat &RT)
+{
+	boost::mutex::scoped_lock lock(pose_filter_mutex);
+
+	if (template_id < 0 || template_id >= (int)pose_filters.size())
+	{
+		std::cerr << "MarkerTracking: predictPose() - no template " << template_id << std::endl;
+		return false;
+	}
+	if (!pose_filters[template_id].isInitialized())
+		return false;
+
+	RT.create(4, 4, CV_32F);
+	pose_filters[template_id].predictPose(timestamp_us, RT.ptr<float>(0));
+	return true;
+}
+
+
+void
+MarkerTracking::setLastPose(int template_id, const cv::Mat &RT)
+{
+	boost::mutex::scoped_lock lock(last_pose_mutex);
+	if (template_id < (int)RT_template_leftcam_last.size())
+		RT_template_leftcam_last[template_id] = RT.clone();
 }
 
 
@@ -15,13 +15,21 @@
 
 #include <boost/thread.hpp>
 #include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <opencv2/video/tracking.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "EpipolarMatcher.h"
+#include "UndistortionMap.h"
+#include "BlobDetector.h"
+#include "PointSetFit.h"
+#include "PoseFilter.h"
+
 #include <iostream>
 #include <queue>
+#include <algorithm>
 #include <fstream>
 #include <limits>
 
@@ -55,18 +63,88 @@ public:
 	    }
 	  };
 
+	  // (reverse order: heap with the WORST match at the front)
+	  class edge_match_worst_comp
+	  {
+	  public:
+	    bool operator() (const edge_match &lhs, const edge_match &rhs) const
+	    {
+	      return (lhs.dist < rhs.dist);
+	    }
+	  };
+
   // Segmentation parameters
   float min_segmentation_area, max_segmentation_area;
 
+  // Segmentation mode ("segmentation_mode": "contours" (default, threshold + findContours + moments) or
+  // "blobs" (fused single pass BlobDetector))
+  enum SegmentationMode { SEGMENTATION_CONTOURS, SEGMENTATION_BLOBS };
+  SegmentationMode segmentation_mode;
+
+  // Centroid of the blobs found by the BlobDetector ("centroid_mode": "binary" (default), "intensity" (intensity
+  // weighted) or "gaussian" (2D Gaussian fit)), NOT used by SEGMENTATION_CONTOURS
+  BlobDetector::CentroidMode centroid_mode;
+
+  // ROI segmentation ("roi_full_scan_interval": full frame scan at least every N frames (0: always full frame scan), else
+  // only windows of +-roi_window_radius pixels around the last 2D points and the reprojected last poses are segmented (segmentation_mode))
+  int roi_full_scan_interval, roi_window_radius;
+
+  // ROI segmentation statistics per camera (0: left, 1: right) (hit/miss: last 2D point found/lost in the ROI windows)
+  struct RoiStatistics
+  {
+	  long long num_full_scans, num_roi_scans, num_hits, num_misses;
+  };
+  RoiStatistics roi_statistics[2];
+
+  // Template tracking ("template_tracking_gate" [mm], 0: off): once found, a template is predicted from its last poses
+  // (constant velocity) and its markers are associated with the nearest 3D points within +-template_tracking_gate,
+  // the full search of fit3DPointsToObjectTemplate(s)() only runs if the template is lost or the association fails
+  float template_tracking_gate;
+
+  // Tracking state per template (lost: full search; acquiring: found in the last frame, velocity unknown;
+  // tracking: found in the last two frames)
+  enum TemplateTrackingState { TEMPLATE_LOST, TEMPLATE_ACQUIRING, TEMPLATE_TRACKING };
+
+  // Tracking statistics per template (tracked: found by association, full searches: runs of the full search, losses:
+  // not found any more)
+  struct TemplateTrackingStatistics
+  {
+	  TemplateTrackingState state;
+	  long long num_tracked, num_full_searches, num_losses;
+  };
+
+  // Pose filters (see filterPoses() and PoseFilter::setNoise()): measurement noise of the fitted pose ("pose_filter_position_noise" [mm],
+  // "pose_filter_orientation_noise" [rad]) and process noise ("pose_filter_acceleration_noise" [mm/s^2/sqrt(Hz)],
+  // "pose_filter_angular_acceleration_noise" [rad/s^2/sqrt(Hz)])
+  float pose_filter_position_noise, pose_filter_orientation_noise;
+  float pose_filter_acceleration_noise, pose_filter_angular_acceleration_noise;
+
+  // Stereo correspondence parameters ("stereo_matcher": "all_pairs" (default, at most 200 candidates) or
+  // "epipolar_band" (only right points within +-epipolar_band_width [rad] around the epipolar line, no limit))
+  bool do_use_epipolar_band;
+  float epipolar_band_width;
+
+  // Number of left/right point pairs pruned by the epipolar band in the last get3DPointsFrom2DPoints() call
+  int num_pruned_pairs;
+
+  // Grid step [pixels] of the undistortion lookup tables ("undistortion_map_step", 0: cv::undistortPoints() per frame)
+  // (cached in "<camera config file>_left/right.undistortion_map" next to the camera config file)
+  int undistortion_map_step;
+
   // Stereo camera configuration
   const char *left_camera_id;
   const char *right_camera_id;
   int camera_exposure, camera_gain;
   int frame_rate;
   int frame_width, frame_height;
+  // Maximum time difference of the left and right frame of a stereo frame ("sync_tolerance_us" [us], 0: no synchronization,
+  // see StereoCamera::setSyncTolerance())
+  int sync_tolerance_us;
 
   // INTRINSICS
   cv::Mat om_leftcam_to_rightcam, KK_left, KK_right, kc_left, kc_right, F_stereo_camera;
+  // Essential matrix for undistorted 2D points (computed from F_stereo_camera, KK_left and KK_right)
+  cv::Mat E_stereo_camera;
 
   // EXTRINSICS
   // Transformation matrix and translation vector from left camera KoSy to right camera KoSy
@@ -91,6 +169,112 @@ private:
   std::vector<char> left_camera_id_buf;
   std::vector<char> right_camera_id_buf;
 
+  // Correspondence candidate search (with reused buffers) of get3DPointsFrom2DPoints()
+  EpipolarMatcher epipolar_matcher;
+  std::vector<int> match_left, match_right;
+
+  // Undistortion lookup tables of the left and right camera (if undistortion_map_step > 0)
+  UndistortionMap undistortion_map_left, undistortion_map_right;
+
+  // Fused segmentation of the left and right camera frames (segmentation_mode SEGMENTATION_BLOBS)
+  BlobDetector blob_detector[2];
+
+  // ROI segmentation state per camera (last 2D points, threshold of the last full frame scan, reused buffers)
+  std::vector< ::cv::Point2f > roi_last_points[2], roi_found_points[2];
+  std::vector< ::cv::Rect > roi_windows[2], roi_bounding_boxes[2];
+  int roi_frames_since_full_scan[2];
+  unsigned char roi_threshold[2];
+
+  // Last found pose of every template (empty if not found) for the ROI segmentation
+  // (locked, as segmentation and fitting of different frames may run in parallel, see TrackingPipeline)
+  std::vector<cv::Mat> RT_template_leftcam_last, roi_last_poses[2];
+  boost::mutex last_pose_mutex;
+
+  // Edge between the points a < b (of the 3D points or of a template)
+  struct Edge
+  {
+	  float length;
+	  int a, b;
+	  Edge(float length, int a, int b) : length(length), a(a), b(b) {};
+  };
+
+  struct EdgeLengthComp
+  {
+	  bool operator() (const Edge &lhs, const Edge &rhs) const { return (lhs.length < rhs.length); };
+	  bool operator() (const Edge &lhs, float length) const { return (lhs.length < length); };
+	  bool operator() (float length, const Edge &rhs) const { return (length < rhs.length); };
+  };
+
+  // Points (point major) and edge lengths (num_points x num_points, symmetric) of the actual 3D points
+  struct WorldEdges
+  {
+	  int num_points;
+	  std::vector<float> points, edges;
+	  // Edges sorted by length (only if computed with do_sort)
+	  std::vector<Edge> sorted_edges;
+
+	  WorldEdges() : num_points(0) {};
+
+	  // Copy the points and compute their edge lengths
+	  void set(const cv::Mat &points_3D, bool do_sort);
+  };
+
+  // Buffers of fit3DPointsToObjectTemplate() per template (reused => no allocation once big enough), with the
+  // edge lengths of the template computed once by readObjectConfigFile()
+  // (locked, as the same template may be fit for different frames in parallel)
+  struct TemplateFitWorkspace
+  {
+	  // Template edge lengths (num_template_points x num_template_points, row major) and the shortest/longest edge
+	  int num_template_points;
+	  std::vector<float> edges_template;
+	  float edges_template_min, edges_template_max;
+	  // Template edges sorted by length (=> edge matches of a 3D point edge by binary search)
+	  std::vector<Edge> sorted_edges_template;
+
+	  // Best "num_test_edges" edge matches (bounded heap with the worst kept match at the front, see edge_match_worst_comp,
+	  // sorted best first by sortEdgeMatches()) and the number of all found edge matches
+	  std::vector<edge_match> edge_matches;
+	  int num_test_edges, num_edge_matches;
+
+	  // Best found indexes/assignments (row c: c+1 correspondences, num_template_points resp. number of 3D points columns)
+	  std::vector<int> best_template_idx, best_world_idx, best_template_to_world, best_world_to_template;
+	  std::vector<float> best_residuum, residuum_max, avg_edge_residuum;
+
+	  // Tracking state, last two poses (4x4, row major) and statistics (see template_tracking_gate)
+	  TemplateTrackingStatistics tracking;
+	  float RT_last[16], RT_previous[16];
+	  // Associated template/world point indexes of the tracking
+	  std::vector<int> tracked_template_idx, tracked_world_idx;
+
+	  // Edges of the actual 3D points (only for fit3DPointsToObjectTemplate(), fit3DPointsToObjectTemplates() shares them)
+	  WorldEdges world_edges;
+
+	  // Corresponding template/world points (3 x num_template_points)
+	  cv::Mat my_template, my_points;
+
+	  boost::mutex mutex;
+
+	  // Compute the template edge lengths and allocate the buffers
+	  void setTemplate(const cv::Mat &marker_template);
+
+	  // Collect the edge matches (keeps only the best num_test_edges)
+	  void clearEdgeMatches();
+	  void addEdgeMatch(float dist, int a, int b, int x, int y);
+	  // Sort the kept matches best first and drop those not tested by the correspondence search
+	  void sortEdgeMatches();
+  };
+  std::vector<boost::shared_ptr<TemplateFitWorkspace> > fit_workspaces;
+
+  // Sorted edges of the actual 3D points shared by all templates in fit3DPointsToObjectTemplates(), the template
+  // order (most points first) and the templates of the actual frame that need the full search (not tracked)
+  WorldEdges frame_edges;
+  boost::mutex frame_edges_mutex;
+  std::vector<int> fit_order, search_order;
+
+  // Pose filter of every template (created by readObjectConfigFile(), see filterPoses())
+  std::vector<PoseFilter> pose_filters;
+  boost::mutex pose_filter_mutex;
+
   // Some flags
   static const bool do_profiling = false;
   bool do_debugging;
@@ -109,10 +293,12 @@ public:
 
   // Read the "frame_id"th 2D point (=line) from the file "file_name" and append to the "points_2D" vector
   // (one line per 2D Point with the X and then Y position (e.g. TAB as seperator))
+  // (the file is reopened and scanned up to "frame_id" at every call => use Points2DFileReader to replay whole files)
   void get2DPointsFromFile(const char *file_name, std::vector< ::cv::Point2f > *points_2D, int frame_id);
 
   // Segment the camera frame (histogram -> thresholding), find circles and append its centers to the "points_2D" vector
-  void get2DPointsFromImage(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D);
+  // ("camera_id" (0: left, 1: right) selects the buffers of the camera, needed if both frames are segmented in parallel)
+  void get2DPointsFromImage(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D, int camera_id = 0);
 
   // Compute 3D points from the 2D points from left and right by correspondence optimization and triangulation (stereo camera parameters used)
   cv::Mat get3DPointsFrom2DPoints(std::vector<cv::Point2f> points_2D_left, std::vector<cv::Point2f> points_2D_right);
@@ -123,7 +309,25 @@ public:
   //  avg_deviation: is the MSE (with a factor considering that the more correspondences, the better))
   void fit3DPointsToObjectTemplate(const cv::Mat &points_3D, int template_id, cv::Mat &RT, float *avg_deviation);
 
+  // Find ALL marker object templates (as fit3DPointsToObjectTemplate()) in parallel (OpenMP), the edges of the 3D points
+  // are computed and sorted only once (=> edge matches by binary search) (RT, avg_deviations: one per template)
+  void fit3DPointsToObjectTemplates(const cv::Mat &points_3D, std::vector<cv::Mat> &RT, std::vector<float> &avg_deviations);
+
+  // Tracking state and statistics of the "template_id"th template (see template_tracking_gate)
+  TemplateTrackingStatistics getTemplateTrackingStatistics(int template_id);
+
+  // Filter the found poses RT (one per template, empty or zero if not found) of the frame taken at "timestamp_us" [us]
+  // with the pose filter of each template and replace them by the filtered poses (6-DoF constant velocity Kalman filter,
+  // see PoseFilter) (a filter not updated for a while is reset, so a template found again starts at its measured pose)
+  // (the average deviations of the fit are not changed, they describe the poses before filtering)
+  void filterPoses(long long timestamp_us, std::vector<cv::Mat> &RT);
+
+  // Pose of the "template_id"th template extrapolated by its pose filter to "timestamp_us" [us] (e.g. the time the pose
+  // is displayed or sent, to compensate the latency of the tracking) (returns FALSE if the template is not filtered yet)
+  bool predictPose(int template_id, long long timestamp_us, cv::Mat &RT);
+
   // Find the best fit transformation between two 3D point sets (minimize (least-square): point_set_1 - RT*point_set_0)
+  // (stack only, see fitPointSets(); RT is only allocated if not yet 4x4 CV_32F)
   static void fitTwoPointSets(const cv::Mat &point_set_0, const cv::Mat &point_set_1, int num_points, cv::Mat &RT, float *avg_deviation);
 
   // Output the cv::Mat dimension and data
@@ -139,6 +343,33 @@ private:
   // Read the camera parameters / marker object data from the given xml file (opencv format and parser used)
   bool readCameraConfigFile(const char *camera_config_file_name);
   bool readObjectConfigFile(const char *object_config_file_name);
+
+  // Threshold for the segmentation by a sparse histogram of the camera frame
+  unsigned char getSegmentationThreshold(const ::cv::Mat &camera_image);
+
+  // Segment the whole camera frame / only the ROI windows (returns FALSE if a point was lost) (both with segmentation_mode)
+  void segmentFullImage(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D, int camera_id);
+  bool segmentRoiWindows(const ::cv::Mat &camera_image, std::vector< ::cv::Point2f > *points_2D, int camera_id);
+
+  // Segment the (part of the) camera frame with segmentation_mode and append the centroids to "points_2D" (and the
+  // bounding boxes of the blobs to "bounding_boxes", if given)
+  void segmentImage(const ::cv::Mat &camera_image, unsigned char threshold, std::vector< ::cv::Point2f > *points_2D,
+		  	  	  	std::vector< ::cv::Rect > *bounding_boxes, int camera_id);
+
+  // Project the 3D point (X,Y,Z) (camera KoSy) into the camera frame (returns FALSE if behind the camera)
+  static bool projectPoint(const ::cv::Mat &KK, const ::cv::Mat &kc, float X, float Y, float Z, ::cv::Point2f &point);
+
+  // Find the template by association with its predicted markers (returns FALSE if not tracked => full search needed)
+  bool trackTemplate(const cv::Mat &points_3D, int template_id, TemplateFitWorkspace &workspace, cv::Mat &RT, float *avg_deviation);
+  // Update the tracking state after the full search (found: avg_deviation not infinite)
+  void updateTemplateTracking(TemplateFitWorkspace &workspace, const cv::Mat &RT, float avg_deviation);
+
+  // Last pose for the ROI segmentation (empty: not found)
+  void setLastPose(int template_id, const cv::Mat &RT);
+
+  // Correspondence search of fit3DPointsToObjectTemplate(s)() from the edge matches of the workspace
+  void fitEdgeMatches(const cv::Mat &points_3D, int template_id, TemplateFitWorkspace &workspace, const WorldEdges &world_edges,
+		  	  	  	  cv::Mat &RT, float *avg_deviation);
 };
 
 }
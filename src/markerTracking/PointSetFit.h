@@ -0,0 +1,177 @@
+//============================================================================
+// Name        : PointSetFit.h
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Fixed-size least-squares fit of two 3D point sets (rigid
+//				 transformation RT minimizing |point_set_1 - RT*point_set_0|),
+//				 as fast alternative to the cv::Mat/cv::SVD implementation
+//				 of MarkerTracking::fitTwoPointSets():
+//				 - Only stack memory (no cv::Mat, no allocation)
+//				 - The rotation is the unit quaternion maximizing the 4x4
+//				   symmetric matrix of Horn's method (largest eigenvector,
+//				   Jacobi rotations in double), which is the same proper
+//				   rotation as the SVD solution with Umeyama correction
+//				 - Point count as template parameter (unrolled by the
+//				   compiler) or at runtime
+//				 Horn 1987: Closed-form solution of absolute orientation
+//				 using unit quaternions
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef POINT_SET_FIT_H_
+#define POINT_SET_FIT_H_
+
+#include <cmath>
+
+namespace tiy
+{
+
+// Eigenvector (q) of the largest eigenvalue of the symmetric 4x4 matrix A (A is changed)
+inline void
+largestEigenvector4(double A[4][4], double q[4])
+{
+	double V[4][4] = { {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1} };
+
+	// Cyclic Jacobi rotations, each zeroing A[p][r] (converges quadratically, usually in 4-6 sweeps)
+	for (int sweep = 0; sweep < 32; sweep++)
+	{
+		double off_diagonal = 0, diagonal = 0;
+		for (int p = 0; p < 4; p++)
+		{
+			diagonal += fabs(A[p][p]);
+			for (int r = p+1; r < 4; r++)
+				off_diagonal += fabs(A[p][r]);
+		}
+		if (off_diagonal <= 1e-15 * diagonal)
+			break;
+
+		for (int p = 0; p < 3; p++)
+		{
+			for (int r = p+1; r < 4; r++)
+			{
+				double a_pr = A[p][r];
+				if (a_pr == 0.0)
+					continue;
+
+				double theta = (A[r][r] - A[p][p]) / (2.0 * a_pr);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+				double c = 1.0 / sqrt(t*t + 1.0), s = t * c;
+
+				A[p][p] -= t * a_pr;
+				A[r][r] += t * a_pr;
+				A[p][r] = A[r][p] = 0.0;
+				for (int k = 0; k < 4; k++)
+				{
+					if (k != p && k != r)
+					{
+						double a_kp = A[k][p], a_kr = A[k][r];
+						A[k][p] = A[p][k] = c * a_kp - s * a_kr;
+						A[k][r] = A[r][k] = s * a_kp + c * a_kr;
+					}
+					double v_kp = V[k][p], v_kr = V[k][r];
+					V[k][p] = c * v_kp - s * v_kr;
+					V[k][r] = s * v_kp + c * v_kr;
+				}
+			}
+		}
+	}
+
+	int largest = 0;
+	for (int p = 1; p < 4; p++)
+		if (A[p][p] > A[largest][largest])
+			largest = p;
+	for (int k = 0; k < 4; k++)
+		q[k] = V[k][largest];
+}
+
+
+// Fit "num_points" point pairs (point_set_0/1[0..2]: x, y and z row of each set) => RT (4x4, row major);
+// returns the average deviation |point_set_1 - RT*point_set_0|
+inline float
+fitPointSets(const float *const point_set_0[3], const float *const point_set_1[3], int num_points, float RT[16])
+{
+	// Centroids
+	double centroid_0[3] = {0, 0, 0}, centroid_1[3] = {0, 0, 0};
+	for (int j = 0; j < 3; j++)
+	{
+		for (int i = 0; i < num_points; i++)
+		{
+			centroid_0[j] += point_set_0[j][i];
+			centroid_1[j] += point_set_1[j][i];
+		}
+		centroid_0[j] /= num_points;
+		centroid_1[j] /= num_points;
+	}
+
+	// Cross covariance S[a][b] = sum (point_0 - centroid_0)_a * (point_1 - centroid_1)_b
+	double S[3][3] = { {0, 0, 0}, {0, 0, 0}, {0, 0, 0} };
+	for (int i = 0; i < num_points; i++)
+	{
+		double p0[3], p1[3];
+		for (int j = 0; j < 3; j++)
+		{
+			p0[j] = point_set_0[j][i] - centroid_0[j];
+			p1[j] = point_set_1[j][i] - centroid_1[j];
+		}
+		for (int a = 0; a < 3; a++)
+			for (int b = 0; b < 3; b++)
+				S[a][b] += p0[a] * p1[b];
+	}
+
+	// Horn's symmetric matrix (its largest eigenvector is the rotation quaternion (w,x,y,z))
+	double N[4][4] = {
+		{ S[0][0] + S[1][1] + S[2][2], S[1][2] - S[2][1], S[2][0] - S[0][2], S[0][1] - S[1][0] },
+		{ S[1][2] - S[2][1], S[0][0] - S[1][1] - S[2][2], S[0][1] + S[1][0], S[2][0] + S[0][2] },
+		{ S[2][0] - S[0][2], S[0][1] + S[1][0], -S[0][0] + S[1][1] - S[2][2], S[1][2] + S[2][1] },
+		{ S[0][1] - S[1][0], S[2][0] + S[0][2], S[1][2] + S[2][1], -S[0][0] - S[1][1] + S[2][2] } };
+
+	double q[4];
+	largestEigenvector4(N, q);
+	double norm_q = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	double w = q[0]/norm_q, x = q[1]/norm_q, y = q[2]/norm_q, z = q[3]/norm_q;
+
+	double R[3][3] = {
+		{ 1 - 2*(y*y + z*z), 2*(x*y - w*z), 2*(x*z + w*y) },
+		{ 2*(x*y + w*z), 1 - 2*(x*x + z*z), 2*(y*z - w*x) },
+		{ 2*(x*z - w*y), 2*(y*z + w*x), 1 - 2*(x*x + y*y) } };
+
+	// t = centroid_1 - R*centroid_0
+	for (int j = 0; j < 3; j++)
+	{
+		double t = centroid_1[j] - (R[j][0]*centroid_0[0] + R[j][1]*centroid_0[1] + R[j][2]*centroid_0[2]);
+		RT[4*j + 0] = (float)R[j][0];
+		RT[4*j + 1] = (float)R[j][1];
+		RT[4*j + 2] = (float)R[j][2];
+		RT[4*j + 3] = (float)t;
+	}
+	RT[12] = 0; RT[13] = 0; RT[14] = 0; RT[15] = 1;
+
+	// Average deviation
+	float dev_sum = 0;
+	for (int i = 0; i < num_points; i++)
+	{
+		double dev_squared = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			float dev = point_set_1[j][i] - (RT[4*j]*point_set_0[0][i] + RT[4*j + 1]*point_set_0[1][i] + RT[4*j + 2]*point_set_0[2][i] + RT[4*j + 3]);
+			dev_squared += (double)dev * dev;
+		}
+		dev_sum += (float)sqrt(dev_squared);
+	}
+
+	return dev_sum / num_points;
+}
+
+
+// Same with the point count as template parameter (e.g. point_set_0[3][4] for 4 markers)
+template <int NUM_POINTS>
+inline float
+fitPointSets(const float (&point_set_0)[3][NUM_POINTS], const float (&point_set_1)[3][NUM_POINTS], float RT[16])
+{
+	const float *const rows_0[3] = { point_set_0[0], point_set_0[1], point_set_0[2] };
+	const float *const rows_1[3] = { point_set_1[0], point_set_1[1], point_set_1[2] };
+	return fitPointSets(rows_0, rows_1, NUM_POINTS, RT);
+}
+
+}
+
+#endif // POINT_SET_FIT_H_
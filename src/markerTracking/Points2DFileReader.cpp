@@ -0,0 +1,236 @@
+//============================================================================
+// Name        : Points2DFileReader.cpp
+// Author      : Andre Gaschler, Andreas Pflaum
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "Points2DFileReader.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace tiy
+{
+
+Points2DFileReader::Points2DFileReader(bool do_debugging_) :
+	do_debugging(do_debugging_),
+	next_frame_id(-1)
+{
+}
+
+
+Points2DFileReader::~Points2DFileReader()
+{
+	close();
+}
+
+
+bool
+Points2DFileReader::open(const std::string& file_name_)
+{
+	close();
+
+	file_name = file_name_;
+	input_file.open(file_name.c_str(), std::ios::in | std::ios::binary);
+	if (!input_file.is_open())
+	{
+		std::cerr << "Points2DFileReader: open() - file with 2D points: " << file_name << " could not be opened." << std::endl;
+		return false;
+	}
+
+	// Index all line beginnings in one pass (chunkwise, no line parsing)
+	line_offsets.clear();
+	line_offsets.push_back(0);
+
+	const std::streamsize chunk_size = 1 << 16;
+	std::vector<char> chunk(chunk_size);
+	std::streamoff chunk_offset = 0;
+
+	while (input_file)
+	{
+		input_file.read(&chunk[0], chunk_size);
+		std::streamsize num_read = input_file.gcount();
+		if (num_read <= 0)
+			break;
+
+		const char *begin = &chunk[0];
+		const char *end = begin + num_read;
+		for (const char *c = (const char *)memchr(begin, '\n', end - begin); c != NULL; c = (const char *)memchr(c + 1, '\n', end - (c + 1)))
+			line_offsets.push_back(chunk_offset + (c - begin) + 1);
+
+		chunk_offset += num_read;
+	}
+
+	// Last line without line break
+	if (line_offsets.back() != chunk_offset)
+		line_offsets.push_back(chunk_offset);
+
+	input_file.clear();
+	next_frame_id = -1;
+
+	if (do_debugging)
+		std::cout << "Points2DFileReader: open() - " << file_name << " has " << getNumFrames() << " frames" << std::endl;
+
+	return true;
+}
+
+
+void
+Points2DFileReader::close()
+{
+	if (input_file.is_open())
+		input_file.close();
+
+	line_offsets.clear();
+	next_frame_id = -1;
+}
+
+
+int
+Points2DFileReader::getNumFrames() const
+{
+	if (line_offsets.empty())
+		return 0;
+
+	return (int)line_offsets.size() - 1;
+}
+
+
+bool
+Points2DFileReader::get2DPoints(int frame_id, std::vector< ::cv::Point2f > *points_2D)
+{
+	if (!input_file.is_open())
+	{
+		std::cerr << "Points2DFileReader: get2DPoints() - file NOT open" << std::endl;
+		return false;
+	}
+
+	if (frame_id < 0 || frame_id >= getNumFrames())
+		return false;
+
+	// Only seek if not reading sequentially
+	if (frame_id != next_frame_id)
+	{
+		input_file.clear();
+		input_file.seekg(line_offsets[frame_id]);
+	}
+
+	std::streamsize line_length = (std::streamsize)(line_offsets[frame_id+1] - line_offsets[frame_id]);
+	if (line_length == 0)
+	{
+		next_frame_id = frame_id + 1;
+		return true;
+	}
+
+	if ((std::streamsize)line_buffer.size() < line_length)
+		line_buffer.resize(line_length);
+
+	input_file.read(&line_buffer[0], line_length);
+	if (input_file.gcount() != line_length)
+	{
+		std::cerr << "Points2DFileReader: get2DPoints() - reading frame " << frame_id << " of " << file_name << " failed." << std::endl;
+		next_frame_id = -1;
+		return false;
+	}
+	next_frame_id = frame_id + 1;
+
+	const char *c = &line_buffer[0];
+	const char *end = c + line_length;
+	::cv::Point2f new_2D_point;
+
+	while (parseFloat(c, end, new_2D_point.x))
+	{
+		if (parseFloat(c, end, new_2D_point.y))
+			points_2D->push_back(new_2D_point);
+		else
+			break;
+	}
+
+	return true;
+}
+
+
+bool
+Points2DFileReader::parseFloat(const char *&begin, const char *end, float& value)
+{
+	static const double pow_10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+									 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	const char *c = begin;
+
+	while (c < end && (*c == ' ' || *c == '\t' || *c == '\r' || *c == '\n' || *c == '\v' || *c == '\f'))
+		c++;
+
+	bool is_negative = false;
+	if (c < end && (*c == '-' || *c == '+'))
+	{
+		is_negative = (*c == '-');
+		c++;
+	}
+
+	// Mantissa (only the first 19 significant digits are exact in 64 bit)
+	unsigned long long mantissa = 0;
+	int exponent = 0, num_digits = 0, num_significant = 0;
+
+	for (; c < end && *c >= '0' && *c <= '9'; c++, num_digits++)
+	{
+		if (num_significant < 19)
+		{
+			mantissa = mantissa*10 + (*c - '0');
+			if (mantissa)
+				num_significant++;
+		}
+		else
+			exponent++;
+	}
+	if (c < end && *c == '.')
+	{
+		for (c++; c < end && *c >= '0' && *c <= '9'; c++, num_digits++)
+		{
+			if (num_significant < 19)
+			{
+				mantissa = mantissa*10 + (*c - '0');
+				if (mantissa)
+					num_significant++;
+				exponent--;
+			}
+		}
+	}
+
+	if (num_digits == 0)
+		return false;
+
+	// Exponent
+	if (c < end && (*c == 'e' || *c == 'E'))
+	{
+		const char *e = c + 1;
+		bool is_exp_negative = false;
+		if (e < end && (*e == '-' || *e == '+'))
+		{
+			is_exp_negative = (*e == '-');
+			e++;
+		}
+		if (e < end && *e >= '0' && *e <= '9')
+		{
+			int exp_value = 0;
+			for (; e < end && *e >= '0' && *e <= '9'; e++)
+				if (exp_value < 10000)
+					exp_value = exp_value*10 + (*e - '0');
+			exponent += is_exp_negative ? -exp_value : exp_value;
+			c = e;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = (exponent >= -22) ? result / pow_10[-exponent] : result * pow(10.0, exponent);
+	else if (exponent > 0)
+		result = (exponent <= 22) ? result * pow_10[exponent] : result * pow(10.0, exponent);
+
+	value = (float)(is_negative ? -result : result);
+	begin = c;
+
+	return true;
+}
+
+}
@@ -0,0 +1,74 @@
+//============================================================================
+// Name        : Points2DFileReader.h
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Persistent reader for 2D point files (one frame per line with
+//				 the X and then Y position of every 2D point, e.g. TAB as
+//				 seperator), as alternative to
+//				 MarkerTracking::get2DPointsFromFile():
+//				 - The file is opened and indexed (line offsets) only once
+//				 - Every frame is then read with one seek (none if read
+//				   sequentially) and parsed without std::stringstream
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef POINTS_2D_FILE_READER_H_
+#define POINTS_2D_FILE_READER_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace tiy
+{
+
+class Points2DFileReader
+{
+
+private:
+
+	bool do_debugging;
+
+	std::ifstream input_file;
+	std::string file_name;
+
+	// Offset of the first character of every line (plus one entry for the end of the file)
+	std::vector<std::streamoff> line_offsets;
+
+	// Line that the file stream is positioned at (-1: unknown => seek needed)
+	int next_frame_id;
+
+	// Reused line buffer (no allocation per frame)
+	std::vector<char> line_buffer;
+
+public:
+
+	Points2DFileReader(bool do_debugging_);
+
+	~Points2DFileReader();
+
+	// Open the file and build the line offset index (one pass over the whole file)
+	bool open(const std::string& file_name_);
+	void close();
+
+	bool isOpen() const { return input_file.is_open(); }
+
+	// Number of frames (= lines) in the file
+	int getNumFrames() const;
+
+	// Read the "frame_id"th frame (=line) and append its 2D points to the "points_2D" vector
+	// (returns FALSE if the file is not open or the frame does not exist)
+	bool get2DPoints(int frame_id, std::vector< ::cv::Point2f > *points_2D);
+
+private:
+
+	// Parse the next number of [begin, end) into "value", skipping leading white spaces
+	// (returns FALSE if no number is found, like "std::stringstream >> float")
+	static bool parseFloat(const char *&begin, const char *end, float& value);
+};
+
+}
+
+#endif // POINTS_2D_FILE_READER_H_
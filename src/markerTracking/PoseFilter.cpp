@@ -0,0 +1,329 @@
+//============================================================================
+// Name        : PoseFilter.cpp
+// Author      : Andre Gaschler, Andreas Pflaum
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "PoseFilter.h"
+
+#include <cmath>
+
+// Standard deviation of the unknown velocity [mm/s] and angular velocity [rad/s] at the start
+#define POSE_FILTER_INITIAL_VELOCITY 1000.0
+#define POSE_FILTER_INITIAL_ANGULAR_VELOCITY 3.0
+
+// Innovation [standard deviations] above which the filter restarts at the measured pose (e.g. object moved while lost)
+#define POSE_FILTER_MAX_INNOVATION 5.0
+
+namespace tiy
+{
+
+// c = a*b of the quaternions (w,x,y,z)
+static inline void
+multiplyQuaternions(const double a[4], const double b[4], double c[4])
+{
+	c[0] = a[0]*b[0] - a[1]*b[1] - a[2]*b[2] - a[3]*b[3];
+	c[1] = a[0]*b[1] + a[1]*b[0] + a[2]*b[3] - a[3]*b[2];
+	c[2] = a[0]*b[2] - a[1]*b[3] + a[2]*b[0] + a[3]*b[1];
+	c[3] = a[0]*b[3] + a[1]*b[2] - a[2]*b[1] + a[3]*b[0];
+}
+
+
+// Unit quaternion of the rotation vector v (angle |v| around v)
+static inline void
+quaternionFromRotationVector(const double v[3], double q[4])
+{
+	double angle = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+	// (sin(angle/2)/angle -> 1/2 for small angles)
+	double s = (angle < 1e-9) ? 0.5 : sin(0.5*angle) / angle;
+	q[0] = cos(0.5*angle);
+	q[1] = s*v[0];
+	q[2] = s*v[1];
+	q[3] = s*v[2];
+}
+
+
+// Rotation vector (angle in [0, pi]) of the unit quaternion q
+static inline void
+rotationVectorFromQuaternion(const double q[4], double v[3])
+{
+	double sign = (q[0] < 0.0) ? -1.0 : 1.0;
+	double s = sqrt(q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	// (angle/sin(angle/2) -> 2 for small angles)
+	double factor = (s < 1e-9) ? 2.0 : 2.0 * atan2(s, sign*q[0]) / s;
+	for (int j = 0; j < 3; j++)
+		v[j] = sign * factor * q[j+1];
+}
+
+
+// Unit quaternion of the rotation of RT (largest of w,x,y,z computed first => stable for all angles)
+static inline void
+quaternionFromPose(const float RT[16], double q[4])
+{
+	double r00 = RT[0], r01 = RT[1], r02 = RT[2];
+	double r10 = RT[4], r11 = RT[5], r12 = RT[6];
+	double r20 = RT[8], r21 = RT[9], r22 = RT[10];
+	double trace = r00 + r11 + r22;
+
+	if (trace > 0.0)
+	{
+		double s = 2.0 * sqrt(trace + 1.0);
+		q[0] = 0.25 * s; q[1] = (r21 - r12) / s; q[2] = (r02 - r20) / s; q[3] = (r10 - r01) / s;
+	}
+	else if (r00 > r11 && r00 > r22)
+	{
+		double s = 2.0 * sqrt(1.0 + r00 - r11 - r22);
+		q[0] = (r21 - r12) / s; q[1] = 0.25 * s; q[2] = (r01 + r10) / s; q[3] = (r02 + r20) / s;
+	}
+	else if (r11 > r22)
+	{
+		double s = 2.0 * sqrt(1.0 + r11 - r00 - r22);
+		q[0] = (r02 - r20) / s; q[1] = (r01 + r10) / s; q[2] = 0.25 * s; q[3] = (r12 + r21) / s;
+	}
+	else
+	{
+		double s = 2.0 * sqrt(1.0 + r22 - r00 - r11);
+		q[0] = (r10 - r01) / s; q[1] = (r02 + r20) / s; q[2] = (r12 + r21) / s; q[3] = 0.25 * s;
+	}
+
+	double norm = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+	for (int k = 0; k < 4; k++)
+		q[k] /= norm;
+}
+
+
+// RT (4x4, row major) of the unit quaternion q and the translation t
+static inline void
+poseFromQuaternion(const double q[4], const double t[3], float RT[16])
+{
+	double w = q[0], x = q[1], y = q[2], z = q[3];
+	RT[0] = (float)(1 - 2*(y*y + z*z)); RT[1] = (float)(2*(x*y - w*z)); RT[2] = (float)(2*(x*z + w*y)); RT[3] = (float)t[0];
+	RT[4] = (float)(2*(x*y + w*z)); RT[5] = (float)(1 - 2*(x*x + z*z)); RT[6] = (float)(2*(y*z - w*x)); RT[7] = (float)t[1];
+	RT[8] = (float)(2*(x*z - w*y)); RT[9] = (float)(2*(y*z + w*x)); RT[10] = (float)(1 - 2*(x*x + y*y)); RT[11] = (float)t[2];
+	RT[12] = 0; RT[13] = 0; RT[14] = 0; RT[15] = 1;
+}
+
+
+// Orientation q rotated by the angular velocity w over dt [s] (camera KoSy: exp(w*dt) * q)
+static inline void
+integrateOrientation(const double q[4], const double w[3], double dt, double q_new[4])
+{
+	double v[3] = { w[0]*dt, w[1]*dt, w[2]*dt };
+	double dq[4];
+	quaternionFromRotationVector(v, dq);
+	multiplyQuaternions(dq, q, q_new);
+
+	double norm = sqrt(q_new[0]*q_new[0] + q_new[1]*q_new[1] + q_new[2]*q_new[2] + q_new[3]*q_new[3]);
+	for (int k = 0; k < 4; k++)
+		q_new[k] /= norm;
+}
+
+
+// Covariance of (value, velocity) after dt [s] of the constant velocity model (F = [1 dt; 0 1]) with white noise
+// acceleration of spectral density "density" (Q = density^2 * [dt^3/3 dt^2/2; dt^2/2 dt])
+static inline void
+predictCovariance(double P[2][2], double dt, double density)
+{
+	double q = density*density;
+	double P00 = P[0][0] + 2.0*dt*P[0][1] + dt*dt*P[1][1] + q*dt*dt*dt/3.0;
+	double P01 = P[0][1] + dt*P[1][1] + q*dt*dt/2.0;
+	double P11 = P[1][1] + q*dt;
+	P[0][0] = P00;
+	P[0][1] = P[1][0] = P01;
+	P[1][1] = P11;
+}
+
+
+// Kalman gains of a measured value (H = [1 0]) with variance R and the corrected covariance
+static inline void
+correctCovariance(double P[2][2], double R, double K[2])
+{
+	double S = P[0][0] + R;
+	K[0] = P[0][0] / S;
+	K[1] = P[1][0] / S;
+
+	double P00 = (1.0 - K[0]) * P[0][0];
+	double P01 = (1.0 - K[0]) * P[0][1];
+	double P11 = P[1][1] - K[1] * P[0][1];
+	P[0][0] = P00;
+	P[0][1] = P[1][0] = P01;
+	P[1][1] = P11;
+}
+
+
+PoseFilter::PoseFilter()
+{
+	setNoise(0.5f, 0.005f, 300.0f, 3.0f);
+	reset();
+}
+
+
+void
+PoseFilter::setNoise(float position_noise, float orientation_noise, float acceleration_noise, float angular_acceleration_noise)
+{
+	position_variance = (double)position_noise * position_noise;
+	orientation_variance = (double)orientation_noise * orientation_noise;
+	acceleration_density = acceleration_noise;
+	angular_acceleration_density = angular_acceleration_noise;
+}
+
+
+void
+PoseFilter::reset()
+{
+	is_initialized = false;
+	last_timestamp_us = 0;
+
+	for (int j = 0; j < 3; j++)
+	{
+		position[j] = 0.0;
+		velocity[j] = 0.0;
+		angular_velocity[j] = 0.0;
+	}
+	orientation[0] = 1.0;
+	orientation[1] = orientation[2] = orientation[3] = 0.0;
+
+	P_position[0][0] = P_position[0][1] = P_position[1][0] = P_position[1][1] = 0.0;
+	P_orientation[0][0] = P_orientation[0][1] = P_orientation[1][0] = P_orientation[1][1] = 0.0;
+}
+
+
+void
+PoseFilter::initialize(long long timestamp_us, const double position_[3], const double orientation_[4])
+{
+	for (int j = 0; j < 3; j++)
+	{
+		position[j] = position_[j];
+		velocity[j] = 0.0;
+		angular_velocity[j] = 0.0;
+	}
+	for (int k = 0; k < 4; k++)
+		orientation[k] = orientation_[k];
+
+	P_position[0][0] = position_variance;
+	P_position[0][1] = P_position[1][0] = 0.0;
+	P_position[1][1] = POSE_FILTER_INITIAL_VELOCITY * POSE_FILTER_INITIAL_VELOCITY;
+	P_orientation[0][0] = orientation_variance;
+	P_orientation[0][1] = P_orientation[1][0] = 0.0;
+	P_orientation[1][1] = POSE_FILTER_INITIAL_ANGULAR_VELOCITY * POSE_FILTER_INITIAL_ANGULAR_VELOCITY;
+
+	last_timestamp_us = timestamp_us;
+	is_initialized = true;
+}
+
+
+void
+PoseFilter::predict(long long timestamp_us)
+{
+	if (timestamp_us <= last_timestamp_us)
+		return;
+
+	double dt = (timestamp_us - last_timestamp_us) * 1e-6;
+
+	for (int j = 0; j < 3; j++)
+		position[j] += velocity[j] * dt;
+
+	double orientation_new[4];
+	integrateOrientation(orientation, angular_velocity, dt, orientation_new);
+	for (int k = 0; k < 4; k++)
+		orientation[k] = orientation_new[k];
+
+	predictCovariance(P_position, dt, acceleration_density);
+	predictCovariance(P_orientation, dt, angular_acceleration_density);
+
+	last_timestamp_us = timestamp_us;
+}
+
+
+void
+PoseFilter::update(long long timestamp_us, const float RT[16])
+{
+	double measured_position[3] = { RT[3], RT[7], RT[11] };
+	double measured_orientation[4];
+	quaternionFromPose(RT, measured_orientation);
+
+	if (!is_initialized)
+	{
+		initialize(timestamp_us, measured_position, measured_orientation);
+		return;
+	}
+
+	predict(timestamp_us);
+
+	// Innovations: position difference and rotation vector from the predicted to the measured orientation (camera KoSy)
+	double position_innovation[3];
+	for (int j = 0; j < 3; j++)
+		position_innovation[j] = measured_position[j] - position[j];
+
+	double orientation_inverse[4] = { orientation[0], -orientation[1], -orientation[2], -orientation[3] };
+	double orientation_difference[4], orientation_innovation[3];
+	multiplyQuaternions(measured_orientation, orientation_inverse, orientation_difference);
+	rotationVectorFromQuaternion(orientation_difference, orientation_innovation);
+
+	// Far from the prediction => restart at the measured pose
+	double max_position_innovation = POSE_FILTER_MAX_INNOVATION * POSE_FILTER_MAX_INNOVATION * (P_position[0][0] + position_variance);
+	double max_orientation_innovation = POSE_FILTER_MAX_INNOVATION * POSE_FILTER_MAX_INNOVATION * (P_orientation[0][0] + orientation_variance);
+	for (int j = 0; j < 3; j++)
+	{
+		if (position_innovation[j]*position_innovation[j] > max_position_innovation ||
+				orientation_innovation[j]*orientation_innovation[j] > max_orientation_innovation)
+		{
+			initialize(timestamp_us > last_timestamp_us ? timestamp_us : last_timestamp_us, measured_position, measured_orientation);
+			return;
+		}
+	}
+
+	double K[2];
+	correctCovariance(P_position, position_variance, K);
+	for (int j = 0; j < 3; j++)
+	{
+		position[j] += K[0] * position_innovation[j];
+		velocity[j] += K[1] * position_innovation[j];
+	}
+
+	correctCovariance(P_orientation, orientation_variance, K);
+	double orientation_correction[3];
+	for (int j = 0; j < 3; j++)
+	{
+		orientation_correction[j] = K[0] * orientation_innovation[j];
+		angular_velocity[j] += K[1] * orientation_innovation[j];
+	}
+	double orientation_corrected[4];
+	integrateOrientation(orientation, orientation_correction, 1.0, orientation_corrected);
+	for (int k = 0; k < 4; k++)
+		orientation[k] = orientation_corrected[k];
+}
+
+
+void
+PoseFilter::getPose(float RT[16]) const
+{
+	poseFromQuaternion(orientation, position, RT);
+}
+
+
+void
+PoseFilter::predictPose(long long timestamp_us, float RT[16]) const
+{
+	double dt = (timestamp_us - last_timestamp_us) * 1e-6;
+
+	double predicted_position[3], predicted_orientation[4];
+	for (int j = 0; j < 3; j++)
+		predicted_position[j] = position[j] + velocity[j] * dt;
+	integrateOrientation(orientation, angular_velocity, dt, predicted_orientation);
+
+	poseFromQuaternion(predicted_orientation, predicted_position, RT);
+}
+
+
+void
+PoseFilter::getVelocity(float velocity_[3], float angular_velocity_[3]) const
+{
+	for (int j = 0; j < 3; j++)
+	{
+		velocity_[j] = (float)velocity[j];
+		angular_velocity_[j] = (float)angular_velocity[j];
+	}
+}
+
+}
@@ -0,0 +1,89 @@
+//============================================================================
+// Name        : PoseFilter.h
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Kalman filter of the 6-DoF pose of one marker template
+//				 (MarkerTracking holds one per template):
+//				 - State: position and velocity, orientation (unit
+//				   quaternion) and angular velocity (constant velocity
+//				   model with white noise (angular) acceleration)
+//				 - Time steps from the frame timestamps (irregular frame
+//				   rates, dropped frames and frames without the template)
+//				 - Orientation errors as rotation vectors (camera KoSy)
+//				   around the estimated orientation (error state filter),
+//				   so the quaternion stays a unit quaternion
+//				 - The noise is the same for the x, y and z axis and the
+//				   position/orientation errors are independent (first
+//				   order) => the 12x12 covariance is two 2x2 covariances
+//				   (value, velocity) shared by the three axes: fixed-size,
+//				   no allocation, below a microsecond per update
+//				 - Prediction of the pose at any time (e.g. the time the
+//				   pose is used, to compensate the latency)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef POSE_FILTER_H_
+#define POSE_FILTER_H_
+
+namespace tiy
+{
+
+class PoseFilter
+{
+
+public:
+
+	PoseFilter();
+
+	// Standard deviation of the measured position [mm] and orientation [rad], spectral density of the white noise
+	// acceleration [mm/s^2/sqrt(Hz)] and angular acceleration [rad/s^2/sqrt(Hz)] (large: follows fast motion, small: smooth)
+	void setNoise(float position_noise, float orientation_noise, float acceleration_noise, float angular_acceleration_noise);
+
+	// Forget the state (the next update starts at the measured pose)
+	void reset();
+
+	bool isInitialized() const { return is_initialized; };
+
+	// Timestamp of the last update [us]
+	long long getTimestamp() const { return last_timestamp_us; };
+
+	// Predict to "timestamp_us" [us] and correct with the measured pose RT (4x4, row major, rotation and translation [mm])
+	// (older timestamps than the last one are not predicted backwards, the measurement is used as if taken at the last one)
+	void update(long long timestamp_us, const float RT[16]);
+
+	// Filtered pose at the last update (4x4, row major)
+	void getPose(float RT[16]) const;
+
+	// Pose extrapolated to "timestamp_us" [us] (the state is not changed)
+	void predictPose(long long timestamp_us, float RT[16]) const;
+
+	// Velocity [mm/s] and angular velocity [rad/s] (rotation vector per second, camera KoSy)
+	void getVelocity(float velocity_[3], float angular_velocity_[3]) const;
+
+private:
+
+	// Predict the state to "timestamp_us"
+	void predict(long long timestamp_us);
+
+	// Start at the measured pose
+	void initialize(long long timestamp_us, const double position_[3], const double orientation_[4]);
+
+private:
+
+	bool is_initialized;
+	long long last_timestamp_us;
+
+	double position[3], velocity[3];
+	// Unit quaternion (w,x,y,z)
+	double orientation[4];
+	double angular_velocity[3];
+
+	// Covariance of (value, velocity) of each position resp. orientation axis
+	double P_position[2][2], P_orientation[2][2];
+
+	// Measurement variances and spectral densities of the process noise
+	double position_variance, orientation_variance, acceleration_density, angular_acceleration_density;
+};
+
+}
+
+#endif // POSE_FILTER_H_
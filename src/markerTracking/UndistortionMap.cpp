@@ -0,0 +1,241 @@
+//============================================================================
+// Name        : UndistortionMap.cpp
+// Author      : Andre Gaschler, Andreas Pflaum
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "UndistortionMap.h"
+
+#include <fstream>
+#include <cmath>
+#include <cstring>
+
+namespace tiy
+{
+
+// File identifier (and version) of saved maps
+static const char undistortion_map_magic[8] = { 'T', 'I', 'Y', 'U', 'D', 'M', '0', '1' };
+
+
+UndistortionMap::UndistortionMap() :
+	frame_width(0),
+	frame_height(0),
+	grid_step(0),
+	grid_cols(0),
+	grid_rows(0)
+{
+	memset(KK, 0, sizeof(KK));
+	memset(kc, 0, sizeof(kc));
+}
+
+
+bool
+UndistortionMap::getCalibration(const cv::Mat& KK_, const cv::Mat& kc_, double KK_out[9], double kc_out[5])
+{
+	if (KK_.total() != 3*3 || kc_.total() != 5*1)
+		return false;
+
+	cv::Mat KK64, kc64;
+	KK_.reshape(1, 9).convertTo(KK64, CV_64F);
+	kc_.reshape(1, 5).convertTo(kc64, CV_64F);
+
+	for (int i = 0; i < 9; i++)
+		KK_out[i] = KK64.at<double>(i, 0);
+	for (int i = 0; i < 5; i++)
+		kc_out[i] = kc64.at<double>(i, 0);
+
+	return true;
+}
+
+
+bool
+UndistortionMap::build(const cv::Mat& KK_, const cv::Mat& kc_, int frame_width_, int frame_height_, int grid_step_)
+{
+	grid.clear();
+
+	if (!getCalibration(KK_, kc_, KK, kc) || frame_width_ <= 0 || frame_height_ <= 0 || grid_step_ <= 0)
+	{
+		std::cerr << "UndistortionMap: build() - invalid calibration, frame size or grid step" << std::endl;
+		return false;
+	}
+
+	frame_width = frame_width_;
+	frame_height = frame_height_;
+	grid_step = grid_step_;
+
+	// Grid nodes at 0, grid_step, 2*grid_step, ... up to (at least) the last pixel
+	grid_cols = (frame_width - 1 + grid_step - 1) / grid_step + 1;
+	grid_rows = (frame_height - 1 + grid_step - 1) / grid_step + 1;
+
+	cv::Mat nodes_dist(1, grid_cols*grid_rows, CV_32FC2);
+	cv::Mat nodes_undist(1, grid_cols*grid_rows, CV_32FC2);
+
+	for (int r = 0; r < grid_rows; r++)
+		for (int c = 0; c < grid_cols; c++)
+			nodes_dist.at<cv::Point2f>(0, r*grid_cols + c) = cv::Point2f((float)(c*grid_step), (float)(r*grid_step));
+
+	cv::Mat KK64(3, 3, CV_64F, KK), kc64(5, 1, CV_64F, kc);
+	cv::undistortPoints(nodes_dist, nodes_undist, KK64, kc64);
+
+	grid.resize(2*grid_cols*grid_rows);
+	const cv::Point2f *nodes = nodes_undist.ptr<cv::Point2f>(0);
+	for (int i = 0; i < grid_cols*grid_rows; i++)
+	{
+		grid[2*i] = nodes[i].x;
+		grid[2*i + 1] = nodes[i].y;
+	}
+
+	return true;
+}
+
+
+bool
+UndistortionMap::save(const std::string& file_name) const
+{
+	if (!isBuilt())
+	{
+		std::cerr << "UndistortionMap: save() - map NOT built yet" << std::endl;
+		return false;
+	}
+
+	std::ofstream output_file(file_name.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!output_file.is_open())
+	{
+		std::cerr << "UndistortionMap: save() - " << file_name << " could not be opened." << std::endl;
+		return false;
+	}
+
+	int header[5] = { frame_width, frame_height, grid_step, grid_cols, grid_rows };
+
+	output_file.write(undistortion_map_magic, sizeof(undistortion_map_magic));
+	output_file.write((const char *)header, sizeof(header));
+	output_file.write((const char *)KK, sizeof(KK));
+	output_file.write((const char *)kc, sizeof(kc));
+	output_file.write((const char *)&grid[0], grid.size()*sizeof(float));
+
+	if (!output_file)
+	{
+		std::cerr << "UndistortionMap: save() - writing " << file_name << " failed." << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+bool
+UndistortionMap::load(const std::string& file_name, const cv::Mat& KK_, const cv::Mat& kc_, int frame_width_, int frame_height_, int grid_step_)
+{
+	std::ifstream input_file(file_name.c_str(), std::ios::in | std::ios::binary);
+	if (!input_file.is_open())
+		return false;
+
+	char magic[8];
+	int header[5];
+	double KK_file[9], kc_file[5], KK_config[9], kc_config[5];
+
+	input_file.read(magic, sizeof(magic));
+	input_file.read((char *)header, sizeof(header));
+	input_file.read((char *)KK_file, sizeof(KK_file));
+	input_file.read((char *)kc_file, sizeof(kc_file));
+
+	// Only use maps of the same version, frame size, grid step and calibration
+	if (!input_file || memcmp(magic, undistortion_map_magic, sizeof(magic)) != 0 ||
+			header[0] != frame_width_ || header[1] != frame_height_ || header[2] != grid_step_ ||
+				!getCalibration(KK_, kc_, KK_config, kc_config) ||
+					memcmp(KK_file, KK_config, sizeof(KK_file)) != 0 || memcmp(kc_file, kc_config, sizeof(kc_file)) != 0)
+		return false;
+
+	int grid_cols_file = header[3], grid_rows_file = header[4];
+	if (grid_cols_file <= 0 || grid_rows_file <= 0 || grid_cols_file > 100000 || grid_rows_file > 100000)
+		return false;
+
+	std::vector<float> grid_file(2*grid_cols_file*grid_rows_file);
+	input_file.read((char *)&grid_file[0], grid_file.size()*sizeof(float));
+	if (input_file.gcount() != (std::streamsize)(grid_file.size()*sizeof(float)))
+		return false;
+
+	frame_width = frame_width_;
+	frame_height = frame_height_;
+	grid_step = grid_step_;
+	grid_cols = grid_cols_file;
+	grid_rows = grid_rows_file;
+	memcpy(KK, KK_file, sizeof(KK));
+	memcpy(kc, kc_file, sizeof(kc));
+	grid.swap(grid_file);
+
+	return true;
+}
+
+
+bool
+UndistortionMap::loadOrBuild(const std::string& file_name, const cv::Mat& KK_, const cv::Mat& kc_, int frame_width_, int frame_height_, int grid_step_)
+{
+	if (load(file_name, KK_, kc_, frame_width_, frame_height_, grid_step_))
+		return true;
+
+	if (!build(KK_, kc_, frame_width_, frame_height_, grid_step_))
+		return false;
+
+	// A missing cache file is no error (e.g. read-only configuration directory)
+	if (!save(file_name))
+		std::cerr << "UndistortionMap: loadOrBuild() - map NOT cached in " << file_name << std::endl;
+
+	return true;
+}
+
+
+void
+UndistortionMap::undistortPoints(const cv::Mat& points_dist, cv::Mat& points_undist) const
+{
+	int num_points = (int)points_dist.total();
+	points_undist.create(1, num_points, CV_32FC2);
+
+	if (num_points == 0)
+		return;
+
+	const cv::Point2f *src = points_dist.ptr<cv::Point2f>(0);
+	cv::Point2f *dst = points_undist.ptr<cv::Point2f>(0);
+	const float inv_grid_step = 1.0f / grid_step;
+
+	std::vector<int> outside_ids;
+
+	for (int i = 0; i < num_points; i++)
+	{
+		float gx = src[i].x * inv_grid_step, gy = src[i].y * inv_grid_step;
+		int ix = (int)floor(gx), iy = (int)floor(gy);
+
+		if (ix < 0 || iy < 0 || ix >= grid_cols - 1 || iy >= grid_rows - 1)
+		{
+			outside_ids.push_back(i);
+			continue;
+		}
+
+		// Bilinear interpolation between the 4 surrounding grid nodes
+		float wx = gx - ix, wy = gy - iy;
+		const float *n00 = &grid[2*(iy*grid_cols + ix)];
+		const float *n10 = n00 + 2*grid_cols;
+
+		float x0 = n00[0] + wx*(n00[2] - n00[0]), y0 = n00[1] + wx*(n00[3] - n00[1]);
+		float x1 = n10[0] + wx*(n10[2] - n10[0]), y1 = n10[1] + wx*(n10[3] - n10[1]);
+
+		dst[i].x = x0 + wy*(x1 - x0);
+		dst[i].y = y0 + wy*(y1 - y0);
+	}
+
+	// Points outside the grid (e.g. not from this camera): exact undistortion
+	if (!outside_ids.empty())
+	{
+		cv::Mat outside_dist(1, (int)outside_ids.size(), CV_32FC2), outside_undist;
+		for (size_t o = 0; o < outside_ids.size(); o++)
+			outside_dist.at<cv::Point2f>(0, (int)o) = src[outside_ids[o]];
+
+		cv::Mat KK64(3, 3, CV_64F, (void *)KK), kc64(5, 1, CV_64F, (void *)kc);
+		cv::undistortPoints(outside_dist, outside_undist, KK64, kc64);
+
+		for (size_t o = 0; o < outside_ids.size(); o++)
+			dst[outside_ids[o]] = outside_undist.at<cv::Point2f>(0, (int)o);
+	}
+}
+
+}
@@ -0,0 +1,75 @@
+//============================================================================
+// Name        : UndistortionMap.h
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Lookup table for the lens undistortion of 2D points of one
+//				 camera, as fast alternative to cv::undistortPoints()
+//				 (iterative solver per point):
+//				 - The undistorted (normalized) positions are computed once
+//				   on a grid with "grid_step" pixels spacing over the frame
+//				 - Points are undistorted by bilinear interpolation
+//				   (points outside the grid by cv::undistortPoints())
+//				 - The map can be saved to / loaded from a binary file
+//				   (only used if built with the same calibration)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef UNDISTORTION_MAP_H_
+#define UNDISTORTION_MAP_H_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace tiy
+{
+
+class UndistortionMap
+{
+
+private:
+
+	// Calibration the map was built with (camera matrix, distortion coefficients as double)
+	double KK[9], kc[5];
+
+	int frame_width, frame_height;
+	int grid_step;
+
+	// Number of grid nodes per row/column (covering the whole frame)
+	int grid_cols, grid_rows;
+
+	// Undistorted normalized position of every grid node (interleaved x,y, row major)
+	std::vector<float> grid;
+
+public:
+
+	UndistortionMap();
+
+	// Compute the map for the camera matrix KK_ (3x3) and distortion coefficients kc_ (5x1)
+	// with a grid of "grid_step_" pixels over the frame (frame_width_ x frame_height_)
+	bool build(const cv::Mat& KK_, const cv::Mat& kc_, int frame_width_, int frame_height_, int grid_step_);
+
+	bool isBuilt() const { return !grid.empty(); }
+
+	// Save the map to / load the map from a binary file
+	// (load() returns FALSE if the file does not exist or was built with another calibration, frame size or grid step)
+	bool save(const std::string& file_name) const;
+	bool load(const std::string& file_name, const cv::Mat& KK_, const cv::Mat& kc_, int frame_width_, int frame_height_, int grid_step_);
+
+	// Load the map from "file_name" or (if not possible) build it and save it to "file_name"
+	bool loadOrBuild(const std::string& file_name, const cv::Mat& KK_, const cv::Mat& kc_, int frame_width_, int frame_height_, int grid_step_);
+
+	// Undistort the 2D points (1xN, CV_32FC2, pixels) to normalized points like cv::undistortPoints(points_dist, points_undist, KK, kc)
+	void undistortPoints(const cv::Mat& points_dist, cv::Mat& points_undist) const;
+
+private:
+
+	// Copy KK_ and kc_ to KK and kc (any float/double matrix), returns FALSE if the sizes are wrong
+	static bool getCalibration(const cv::Mat& KK_, const cv::Mat& kc_, double KK_out[9], double kc_out[5]);
+};
+
+}
+
+#endif // UNDISTORTION_MAP_H_
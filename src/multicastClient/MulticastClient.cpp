@@ -6,6 +6,8 @@
 
 #include "MulticastClient.h"
 
+#include <algorithm>
+
 namespace tiy
 {
 
@@ -13,14 +15,21 @@ MulticastClient::MulticastClient(boost::asio::io_service& io_service,
 	      const boost::asio::ip::address& listen_address,
 	      const boost::asio::ip::address& multicast_address,
 	      short& multicast_port,
-	      bool do_debugging_)
+	      bool do_debugging_,
+	      int queue_capacity_)
     : socket_(io_service),
-      do_debugging(do_debugging_)
+      do_debugging(do_debugging_),
+      packets(std::max(queue_capacity_, 1)),
+      free_packets(packets.size()),
+      received_packets(packets.size())
   {
 	{
-		boost::mutex::scoped_lock multicast_client_lock(multicast_client_mutex);
-		is_new_data = false;
 		go_on = true;
+		num_dropped_packets = 0;
+		is_waiting = false;
+
+		for (int i = 0; i < (int)packets.size(); i++)
+			free_packets.push(i);
 	}
 
 		// Create the socket so that multiple may be bound to the same address.
@@ -48,24 +57,37 @@ MulticastClient::handle_receive_from(const boost::system::error_code& error,
 {
   if (!error)
   {
-    std::string data_string_buffer;
-	{
-		boost::mutex::scoped_lock multicast_client_lock(multicast_client_mutex);
-
-		if (!go_on)
-			return;
-
-		is_new_data = true;
-		data_string = std::string(data_, bytes_recvd);
-		data_string_buffer = data_string;
-	}
+	if (!go_on)
+		return;
 
 	if (do_debugging)
 	{
 		boost::mutex::scoped_lock my_io_lock(io_mutex);
-		std::cout << "MulticastClient: Received string \"" << data_string_buffer << "\"" << std::endl;
+		PoseMessage message;
+		if (decodePoseMessage(data_, bytes_recvd, message))
+			std::cout << "MulticastClient: Received pose message " << message.sequence_number << " (" << message.poses.size() << " poses)" << std::endl;
+		else
+			std::cout << "MulticastClient: Received string \"" << std::string(data_, bytes_recvd) << "\"" << std::endl;
 	}
 
+	// Queue the packet (or drop it, if the consumer does not keep up)
+	int packet_index;
+	if (free_packets.pop(packet_index))
+	{
+		packets[packet_index].assign(data_, data_ + bytes_recvd);
+		received_packets.push(packet_index);
+
+		// (the fence orders the push before reading is_waiting, see waitForData())
+		boost::atomic_thread_fence(boost::memory_order_seq_cst);
+		if (is_waiting)
+		{
+			boost::mutex::scoped_lock wait_lock(wait_mutex);
+			wait_condition.notify_one();
+		}
+	}
+	else
+		num_dropped_packets++;
+
     socket_.async_receive_from(
         boost::asio::buffer(data_, max_length), sender_endpoint_,
         boost::bind(&MulticastClient::handle_receive_from, this,
@@ -88,33 +110,123 @@ MulticastClient::handle_receive_from(const boost::system::error_code& error,
   }
 }
 
+bool
+MulticastClient::popPacket(int& packet_index)
+  {
+	return received_packets.pop(packet_index);
+  }
+
 bool
 MulticastClient::getReceivedString(std::string& data_string_)
   {
+	int packet_index, newest_packet_index = -1;
+	while (popPacket(packet_index))
 	{
-		boost::mutex::scoped_lock multicast_client_lock(multicast_client_mutex);
-		
-		if (is_new_data)
+		if (newest_packet_index >= 0)
+			free_packets.push(newest_packet_index);
+		newest_packet_index = packet_index;
+	}
+
+	if (newest_packet_index < 0)
+	{
+		data_string_ = "";
+		return false;
+	}
+
+	const std::vector<char>& packet = packets[newest_packet_index];
+	data_string_.assign(packet.begin(), packet.end());
+	free_packets.push(newest_packet_index);
+
+	return true;
+  }
+
+int
+MulticastClient::getReceivedStrings(std::vector<std::string>& data_strings_)
+  {
+	// (the strings of data_strings_ are reused => no allocation once big enough)
+	int num_strings = 0, packet_index;
+	while (popPacket(packet_index))
+	{
+		if (num_strings >= (int)data_strings_.size())
+			data_strings_.resize(num_strings + 1);
+
+		const std::vector<char>& packet = packets[packet_index];
+		data_strings_[num_strings++].assign(packet.begin(), packet.end());
+		free_packets.push(packet_index);
+	}
+
+	data_strings_.resize(num_strings);
+	return num_strings;
+  }
+
+int
+MulticastClient::getReceivedPoseMessages(std::vector<PoseMessage>& messages_)
+  {
+	int num_messages = 0, packet_index;
+	while (popPacket(packet_index))
+	{
+		if (num_messages >= (int)messages_.size())
+			messages_.resize(num_messages + 1);
+
+		const std::vector<char>& packet = packets[packet_index];
+		if (!packet.empty() && decodePoseMessage(&packet[0], packet.size(), messages_[num_messages]))
+			num_messages++;
+		free_packets.push(packet_index);
+	}
+
+	messages_.resize(num_messages);
+	return num_messages;
+  }
+
+bool
+MulticastClient::waitForData(double timeout_seconds)
+  {
+	if (received_packets.read_available() > 0)
+		return true;
+
+	boost::chrono::steady_clock::time_point timeout_time = boost::chrono::steady_clock::now()
+			+ boost::chrono::microseconds((long long)(timeout_seconds * 1e6));
+
+	boost::mutex::scoped_lock wait_lock(wait_mutex);
+	is_waiting = true;
+
+	bool is_data = false;
+	while (go_on)
+	{
+		if (received_packets.read_available() > 0)
 		{
-			data_string_ = data_string;
-			is_new_data = false;
-			return true;
+			is_data = true;
+			break;
 		}
-		else
+		if (wait_condition.wait_until(wait_lock, timeout_time) == boost::cv_status::timeout)
 		{
-			data_string_ = "";
-			return false;
-		}		
+			is_data = (received_packets.read_available() > 0);
+			break;
+		}
 	}
+
+	is_waiting = false;
+	return is_data;
+  }
+
+bool
+MulticastClient::getReceivedPoseMessage(PoseMessage& message_)
+  {
+	std::string data_string_buffer;
+	if (!getReceivedString(data_string_buffer))
+		return false;
+
+	return decodePoseMessage(data_string_buffer.data(), data_string_buffer.size(), message_);
   }
 
 void
 MulticastClient::stopReceiving()
   {
+	go_on = false;
+
 	{
-		boost::mutex::scoped_lock multicast_client_lock(multicast_client_mutex);
-		
-		go_on = false;
+		boost::mutex::scoped_lock wait_lock(wait_mutex);
+		wait_condition.notify_all();
 	}
   }
 
@@ -2,8 +2,16 @@
 // Name        : MulticastClient.h
 // Author      : Andreas Pflaum
 // Description : Cross-platform class for setting up a boost udp multicast client
-//				 Async waiting for new data from a multicast server. The newest
-//				 received data string can be get by getReceivedString().
+//				 Async waiting for new data from a multicast server. The
+//				 received packets are queued in a lock-free single-producer/
+//				 single-consumer ring (receive thread -> ONE consumer thread):
+//				 - all queued packets: getReceivedStrings(),
+//				   getReceivedPoseMessages() (binary, see PoseMessage.h)
+//				 - only the newest packet: getReceivedString(),
+//				   getReceivedPoseMessage()
+//				 - waitForData() blocks until a packet is queued
+//				 - packets received while the ring is full are dropped
+//				   (getNumDroppedPackets())
 //				 Connection parameters:
 //				 - listen_address (e.g. "0.0.0.0", IP6: "0::0")
 //				 - multicast_address (e.g. "239.255.0.1", IP6: "ff31::8000:1234")
@@ -30,9 +38,16 @@
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 
 #include <iostream>
 #include <string>
+#include <vector>
+
+#include "../multicastServer/PoseMessage.h"
+
+#define MULTICAST_CLIENT_QUEUE_CAPACITY 64
 
 namespace tiy
 {
@@ -47,11 +62,27 @@ public:
 	      const boost::asio::ip::address& listen_address,
 	      const boost::asio::ip::address& multicast_address,
 	      short& multicast_port,
-	      bool do_debugging_);
+	      bool do_debugging_,
+	      int queue_capacity_ = MULTICAST_CLIENT_QUEUE_CAPACITY);
 
-  // Get newest received data string and return TRUE if not already get before, else FALSE
+  // Get newest received data string and return TRUE if not already get before, else FALSE (older queued strings are discarded)
   bool getReceivedString(std::string& data_string_);
 
+  // Decode newest received data as binary pose message and return TRUE if not already get before and valid, else FALSE
+  bool getReceivedPoseMessage(PoseMessage& message_);
+
+  // Get all queued data strings in order of receiving (NOT blocking, no lock); returns their number
+  int getReceivedStrings(std::vector<std::string>& data_strings_);
+
+  // Get all queued binary pose messages in order of receiving (other data is skipped); returns their number
+  int getReceivedPoseMessages(std::vector<PoseMessage>& messages_);
+
+  // Block until data is queued (TRUE) or "timeout_seconds" are over or receiving stopped (FALSE)
+  bool waitForData(double timeout_seconds);
+
+  // Number of packets dropped, as the queue was full
+  long long getNumDroppedPackets() const { return num_dropped_packets; };
+
   void stopReceiving();
 
 private:
@@ -60,19 +91,35 @@ private:
   void handle_receive_from(const boost::system::error_code& error,
       size_t bytes_recvd);
 
+  // Pop the next queued packet (consumer)
+  bool popPacket(int& packet_index);
+
 private:
 
-  bool do_debugging, is_new_data, go_on;
+  typedef boost::lockfree::spsc_queue<int> PacketQueue;
+
+  bool do_debugging;
+  boost::atomic<bool> go_on;
 
   boost::asio::ip::udp::socket socket_;
   boost::asio::ip::udp::endpoint sender_endpoint_;
   
-  enum { max_length = 512 };
+  enum { max_length = 65536 }; // (maximum UDP datagram size)
   char data_[max_length];
 
-  std::string data_string;
-  
-  boost::mutex multicast_client_mutex, io_mutex;
+  // Packet slots (buffers grow to the packet size and are reused) and indices of the
+  // free (consumer -> receive thread) and received (receive thread -> consumer) slots
+  std::vector<std::vector<char> > packets;
+  PacketQueue free_packets, received_packets;
+
+  boost::atomic<long long> num_dropped_packets;
+
+  // waitForData() (the lock is only taken by the receive thread if a consumer waits)
+  boost::atomic<bool> is_waiting;
+  boost::mutex wait_mutex;
+  boost::condition_variable wait_condition;
+
+  boost::mutex io_mutex;
 
 };
 
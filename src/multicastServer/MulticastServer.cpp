@@ -6,6 +6,13 @@
 
 #include "MulticastServer.h"
 
+#include <cstring>
+
+#ifdef __linux__
+	#include <sys/socket.h>
+	#include <errno.h>
+#endif
+
 namespace tiy
 {
 
@@ -15,11 +22,20 @@ MulticastServer::MulticastServer(boost::asio::io_service& io_service,
     bool do_debugging_)
   : endpoint_(multicast_address, multicast_port),
     socket_(io_service, endpoint_.protocol()),
-    do_debugging(do_debugging_)
+    do_debugging(do_debugging_),
+    send_buffers(MULTICAST_SERVER_SEND_BUFFERS),
+    free_send_buffers(MULTICAST_SERVER_SEND_BUFFERS)
 {
 	{
-	  boost::mutex::scoped_lock multicast_server_lock(multicast_server_mutex);
 	  go_on = true;
+	  num_dropped_messages = 0;
+
+	  for (int i = 0; i < MULTICAST_SERVER_SEND_BUFFERS; i++)
+	  {
+		  send_buffers[i].reserve(MULTICAST_SERVER_SEND_BUFFER_SIZE);
+		  free_send_buffers.push(i);
+	  }
+	  batch.reserve(MULTICAST_SERVER_SEND_BUFFERS);
 	}
 
 	if (do_debugging)
@@ -32,20 +48,14 @@ MulticastServer::MulticastServer(boost::asio::io_service& io_service,
 
 MulticastServer::~MulticastServer()
 {
-  {
-	boost::mutex::scoped_lock multicast_server_lock(multicast_server_mutex);
-	go_on = false;
-  }
+  go_on = false;
 }
 
 void
-MulticastServer::sendString(std::string send_string)
+MulticastServer::sendString(const std::string& send_string)
 {
-	{
-	  boost::mutex::scoped_lock multicast_server_lock(multicast_server_mutex);
-	  if (!go_on)
-		  return;
-	}
+	if (!go_on)
+	  return;
 
 	if (do_debugging)
 	  {
@@ -53,35 +63,136 @@ MulticastServer::sendString(std::string send_string)
 		std::cout << "MulticastServer: SENDING \"" << send_string << "\""<< std::endl;
 	  }
 
-    socket_.async_send_to(
-        boost::asio::buffer(send_string), endpoint_,
-        boost::bind(&MulticastServer::handleSend, this,
-          boost::asio::placeholders::error));
+	if (addToBatch(send_string))
+		sendBatch();
 }
 
 
 void
-MulticastServer::handleSend(const boost::system::error_code& error)
+MulticastServer::sendData(const std::vector<char>& send_data)
 {
-  {
-    boost::mutex::scoped_lock multicast_server_lock(multicast_server_mutex);
-    if (!go_on)
-    	return;
-  }
+	if (!go_on)
+	  return;
 
-  if (error)
-  {
-	  if (do_debugging)
+	if (do_debugging)
+	  {
+		boost::mutex::scoped_lock io_lock(io_mutex);
+		std::cout << "MulticastServer: SENDING " << send_data.size() << " bytes" << std::endl;
+	  }
+
+	if (addToBatch(send_data))
+		sendBatch();
+}
+
+
+bool
+MulticastServer::addToBatch(const char *data, size_t size)
+{
+	if (!go_on)
+	  return false;
+
+	// Batch full => send it first
+	if ((int)batch.size() >= MULTICAST_SERVER_SEND_BUFFERS)
+		sendBatch();
+
+	int send_buffer_index;
+	if (!free_send_buffers.pop(send_buffer_index))
+	{
+		num_dropped_messages++;
+		if (do_debugging)
+		  {
+			boost::mutex::scoped_lock io_lock(io_mutex);
+			std::cout << "MulticastServer: all send buffers in use, message dropped" << std::endl;
+		  }
+		return false;
+	}
+
+	// (no allocation once the buffer is big enough)
+	send_buffers[send_buffer_index].assign(data, data + size);
+	batch.push_back(send_buffer_index);
+
+	return true;
+}
+
+
+void
+MulticastServer::sendBatch()
+{
+	if (batch.empty())
+		return;
+
+#ifdef __linux__
+	// One syscall for all messages; it returns when they are sent => the buffers are free again
+	struct mmsghdr messages[MULTICAST_SERVER_SEND_BUFFERS];
+	struct iovec message_data[MULTICAST_SERVER_SEND_BUFFERS];
+	int num_messages = (int)batch.size();
+
+	for (int i = 0; i < num_messages; i++)
+	{
+		std::vector<char>& send_buffer = send_buffers[batch[i]];
+		message_data[i].iov_base = send_buffer.empty() ? NULL : &send_buffer[0];
+		message_data[i].iov_len = send_buffer.size();
+
+		memset(&messages[i], 0, sizeof(messages[i]));
+		messages[i].msg_hdr.msg_name = endpoint_.data();
+		messages[i].msg_hdr.msg_namelen = endpoint_.size();
+		messages[i].msg_hdr.msg_iov = &message_data[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	int num_sent = 0;
+	while (go_on && num_sent < num_messages)
+	{
+		int result = sendmmsg(socket_.native_handle(), messages + num_sent, num_messages - num_sent, 0);
+		if (result < 0)
 		{
-		  boost::mutex::scoped_lock io_lock(io_mutex);
-		  std::cout << "MulticastServer: ERROR async_send_to() (error: " << error << " ("<< boost::system::system_error(error).what() << "))" << std::endl;
+			if (errno == EINTR)
+				continue;
+			stopOnError("sendmmsg()", boost::system::error_code(errno, boost::system::system_category()));
+			break;
 		}
+		num_sent += result;
+	}
 
-	  {
-		boost::mutex::scoped_lock multicast_server_lock(multicast_server_mutex);
-		go_on = false;
-	  }
-  }
+	for (int i = 0; i < num_messages; i++)
+		free_send_buffers.push(batch[i]);
+#else
+	for (unsigned int i = 0; i < batch.size(); i++)
+	{
+		socket_.async_send_to(
+			boost::asio::buffer(send_buffers[batch[i]]), endpoint_,
+			boost::bind(&MulticastServer::handleSend, this,
+			  boost::asio::placeholders::error, batch[i]));
+	}
+#endif
+
+	batch.clear();
 }
 
-}
\ No newline at end of file
+
+void
+MulticastServer::handleSend(const boost::system::error_code& error, int send_buffer_index)
+{
+  free_send_buffers.push(send_buffer_index);
+
+  if (!go_on)
+	  return;
+
+  if (error)
+	  stopOnError("async_send_to()", error);
+}
+
+
+void
+MulticastServer::stopOnError(const char *function_name, const boost::system::error_code& error)
+{
+  if (do_debugging)
+	{
+	  boost::mutex::scoped_lock io_lock(io_mutex);
+	  std::cout << "MulticastServer: ERROR " << function_name << " (error: " << error << " ("<< boost::system::system_error(error).what() << "))" << std::endl;
+	}
+
+  go_on = false;
+}
+
+}
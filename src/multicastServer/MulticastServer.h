@@ -6,6 +6,12 @@
 //				 with:
 //				 - multicast_address (e.g. "239.255.0.1", IP6: "ff31::8000:1234")
 //				 - multicast_port (short int, < 32768)
+//				 The messages are copied into a ring of preallocated send
+//				 buffers (kept until the sending has completed). Several
+//				 messages of a frame can be sent as a batch (addToBatch(),
+//				 sendBatch()): on Linux with one sendmmsg() syscall, else
+//				 with one async_send_to() per message.
+//				 The send methods must be called from ONE thread.
 // Licence	   : see LICENCE.txt
 //============================================================================
 //
@@ -28,9 +34,15 @@
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 #include <boost/bind.hpp>
+#include <boost/atomic.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 
 #include <iostream>
 #include <string>
+#include <vector>
+
+#define MULTICAST_SERVER_SEND_BUFFERS 16		// maximum number of messages per batch/sending at the same time
+#define MULTICAST_SERVER_SEND_BUFFER_SIZE 1472	// reserved bytes per send buffer (ethernet MTU - IP/UDP header), bigger messages grow it
 
 
 namespace tiy
@@ -49,22 +61,49 @@ public:
 
 	~MulticastServer();
 
-	// Send the string send_string with async_send_to() (calls handleSend() in a new thread)
-	void sendString(std::string send_string);
+	// Send the string send_string (copied into a free send buffer; Linux: sent synchronously by sendBatch() with sendmmsg(),
+	// else sent asynchronously and the buffer freed by handleSend() in the io_service thread)
+	void sendString(const std::string& send_string);
+
+	// Send binary data (e.g. an encoded PoseMessage)
+	void sendData(const std::vector<char>& send_data);
+
+	// Copy a message into a free send buffer and queue it for sendBatch() (FALSE: dropped, as no send buffer free)
+	bool addToBatch(const char *data, size_t size);
+	bool addToBatch(const std::string& send_string) { return addToBatch(send_string.data(), send_string.size()); };
+	bool addToBatch(const std::vector<char>& send_data) { return addToBatch(send_data.empty() ? NULL : &send_data[0], send_data.size()); };
+
+	// Send all queued messages (Linux: one sendmmsg() syscall)
+	void sendBatch();
+
+	// Number of messages dropped, as all send buffers were in use
+	long long getNumDroppedMessages() const { return num_dropped_messages; };
 
 private:
 
-	// Called by async_send_to() used in sendString()
-	void handleSend(const boost::system::error_code& error);
+	// Called by async_send_to() used in sendBatch() (gives the send buffer back)
+	void handleSend(const boost::system::error_code& error, int send_buffer_index);
+
+	void stopOnError(const char *function_name, const boost::system::error_code& error);
 
 private:
 
+	typedef boost::lockfree::spsc_queue<int> SendBufferQueue;
+
 	boost::asio::ip::udp::endpoint endpoint_;
 	boost::asio::ip::udp::socket socket_;
 
-	bool do_debugging, go_on;
+	bool do_debugging;
+	boost::atomic<bool> go_on;
+
+	// Send buffer ring: preallocated buffers, indices of the free ones and of the batch
+	std::vector<std::vector<char> > send_buffers;
+	SendBufferQueue free_send_buffers;
+	std::vector<int> batch;
+
+	boost::atomic<long long> num_dropped_messages;
 
-	boost::mutex multicast_server_mutex, io_mutex;
+	boost::mutex io_mutex;
 
 };
 
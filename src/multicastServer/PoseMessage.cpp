@@ -0,0 +1,201 @@
+//============================================================================
+// Name        : PoseMessage.cpp
+// Author      : Andreas Pflaum, Andre Gaschler
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "PoseMessage.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace tiy
+{
+
+// Little endian (independent of the host byte order)
+static inline void
+writeUInt(char *dst, boost::uint64_t value, int num_bytes)
+{
+	for (int i = 0; i < num_bytes; i++)
+		dst[i] = (char)((value >> (8 * i)) & 0xFF);
+}
+
+
+static inline boost::uint64_t
+readUInt(const char *src, int num_bytes)
+{
+	boost::uint64_t value = 0;
+	for (int i = 0; i < num_bytes; i++)
+		value |= (boost::uint64_t)(unsigned char)src[i] << (8 * i);
+	return value;
+}
+
+
+static inline void
+writeFloat(char *dst, float value)
+{
+	boost::uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	writeUInt(dst, bits, 4);
+}
+
+
+static inline float
+readFloat(const char *src)
+{
+	boost::uint32_t bits = (boost::uint32_t)readUInt(src, 4);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+TemplatePose::TemplatePose() :
+	template_id(0),
+	is_valid(false),
+	residual(0.0f)
+{
+	position[0] = position[1] = position[2] = 0.0f;
+	orientation[0] = 1.0f;
+	orientation[1] = orientation[2] = orientation[3] = 0.0f;
+}
+
+
+void
+TemplatePose::setTransformation(int template_id_, const float *RT, float residual_)
+{
+	template_id = template_id_;
+	residual = residual_;
+
+	is_valid = false;
+	for (int i = 0; i < 16; i++)
+		if (RT[i] != 0.0f)
+			is_valid = true;
+
+	if (!is_valid)
+	{
+		*this = TemplatePose();
+		template_id = template_id_;
+		return;
+	}
+
+	position[0] = RT[3];
+	position[1] = RT[7];
+	position[2] = RT[11];
+
+	// Rotation matrix to quaternion (numerically stable for all angles: largest of w,x,y,z computed first)
+	const float r00 = RT[0], r01 = RT[1], r02 = RT[2];
+	const float r10 = RT[4], r11 = RT[5], r12 = RT[6];
+	const float r20 = RT[8], r21 = RT[9], r22 = RT[10];
+	const float trace = r00 + r11 + r22;
+	float w, x, y, z;
+
+	if (trace > 0.0f)
+	{
+		float s = 2.0f * std::sqrt(trace + 1.0f);
+		w = 0.25f * s;
+		x = (r21 - r12) / s;
+		y = (r02 - r20) / s;
+		z = (r10 - r01) / s;
+	}
+	else if (r00 > r11 && r00 > r22)
+	{
+		float s = 2.0f * std::sqrt(1.0f + r00 - r11 - r22);
+		w = (r21 - r12) / s;
+		x = 0.25f * s;
+		y = (r01 + r10) / s;
+		z = (r02 + r20) / s;
+	}
+	else if (r11 > r22)
+	{
+		float s = 2.0f * std::sqrt(1.0f + r11 - r00 - r22);
+		w = (r02 - r20) / s;
+		x = (r01 + r10) / s;
+		y = 0.25f * s;
+		z = (r12 + r21) / s;
+	}
+	else
+	{
+		float s = 2.0f * std::sqrt(1.0f + r22 - r00 - r11);
+		w = (r10 - r01) / s;
+		x = (r02 + r20) / s;
+		y = (r12 + r21) / s;
+		z = 0.25f * s;
+	}
+
+	// Unique sign (w >= 0)
+	float norm = std::sqrt(w*w + x*x + y*y + z*z);
+	if (w < 0.0f)
+		norm = -norm;
+	orientation[0] = w / norm;
+	orientation[1] = x / norm;
+	orientation[2] = y / norm;
+	orientation[3] = z / norm;
+}
+
+
+size_t
+encodePoseMessage(const PoseMessage& message, std::vector<char>& buffer)
+{
+	size_t size = message.getEncodedSize();
+	buffer.resize(size);
+
+	char *dst = &buffer[0];
+	writeUInt(dst, POSE_MESSAGE_MAGIC, 2);
+	writeUInt(dst + 2, POSE_MESSAGE_VERSION, 1);
+	writeUInt(dst + 3, (boost::uint64_t)message.type, 1);
+	writeUInt(dst + 4, (boost::uint64_t)message.poses.size(), 2);
+	writeUInt(dst + 6, 0, 2);
+	writeUInt(dst + 8, message.sequence_number, 4);
+	writeUInt(dst + 12, (boost::uint64_t)message.timestamp_us, 8);
+	dst += POSE_MESSAGE_HEADER_SIZE;
+
+	for (size_t i = 0; i < message.poses.size(); i++, dst += POSE_MESSAGE_POSE_SIZE)
+	{
+		const TemplatePose& pose = message.poses[i];
+		writeUInt(dst, (boost::uint64_t)pose.template_id, 2);
+		writeUInt(dst + 2, pose.is_valid ? 1 : 0, 1);
+		writeUInt(dst + 3, 0, 1);
+		for (int j = 0; j < 3; j++)
+			writeFloat(dst + 4 + 4*j, pose.position[j]);
+		for (int j = 0; j < 4; j++)
+			writeFloat(dst + 16 + 4*j, pose.orientation[j]);
+		writeFloat(dst + 32, pose.residual);
+	}
+
+	return size;
+}
+
+
+bool
+decodePoseMessage(const char *data, size_t size, PoseMessage& message)
+{
+	if (size < POSE_MESSAGE_HEADER_SIZE || readUInt(data, 2) != POSE_MESSAGE_MAGIC || readUInt(data + 2, 1) != POSE_MESSAGE_VERSION)
+		return false;
+
+	size_t num_poses = (size_t)readUInt(data + 4, 2);
+	if (size != POSE_MESSAGE_HEADER_SIZE + num_poses * POSE_MESSAGE_POSE_SIZE)
+		return false;
+
+	message.type = (int)readUInt(data + 3, 1);
+	message.sequence_number = (unsigned int)readUInt(data + 8, 4);
+	message.timestamp_us = (long long int)readUInt(data + 12, 8);
+	message.poses.resize(num_poses);
+
+	const char *src = data + POSE_MESSAGE_HEADER_SIZE;
+	for (size_t i = 0; i < num_poses; i++, src += POSE_MESSAGE_POSE_SIZE)
+	{
+		TemplatePose& pose = message.poses[i];
+		pose.template_id = (int)readUInt(src, 2);
+		pose.is_valid = ((readUInt(src + 2, 1) & 1) != 0);
+		for (int j = 0; j < 3; j++)
+			pose.position[j] = readFloat(src + 4 + 4*j);
+		for (int j = 0; j < 4; j++)
+			pose.orientation[j] = readFloat(src + 16 + 4*j);
+		pose.residual = readFloat(src + 32);
+	}
+
+	return true;
+}
+
+}
@@ -0,0 +1,84 @@
+//============================================================================
+// Name        : PoseMessage.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Compact binary pose message sent by the server (alternative
+//				 to the tab separated text strings), to be decoded by the
+//				 clients with decodePoseMessage() or
+//				 MulticastClient::getReceivedPoseMessage().
+//				 Layout (little endian, no padding):
+//				 - Header (POSE_MESSAGE_HEADER_SIZE bytes):
+//				   uint16 magic (POSE_MESSAGE_MAGIC), uint8 version,
+//				   uint8 type (object/virtual point poses), uint16 number
+//				   of poses, uint16 reserved (0), uint32 sequence number,
+//				   int64 frame timestamp [us]
+//				 - Per template (POSE_MESSAGE_POSE_SIZE bytes):
+//				   uint16 template id, uint8 flags (bit 0: valid),
+//				   uint8 reserved (0), float32 position x,y,z [mm],
+//				   float32 orientation quaternion w,x,y,z, float32
+//				   residual (average deviation of the fit, also for
+//				   Kalman filtered poses: of the pose before filtering)
+//				 => up to 40 templates fit into a datagram of 1472 bytes
+//				    (ethernet MTU)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef POSE_MESSAGE_H_
+#define POSE_MESSAGE_H_
+
+#include <boost/cstdint.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#define POSE_MESSAGE_MAGIC 0x5954		// "TY"
+#define POSE_MESSAGE_VERSION 1
+#define POSE_MESSAGE_HEADER_SIZE 20
+#define POSE_MESSAGE_POSE_SIZE 36
+
+
+namespace tiy
+{
+
+struct TemplatePose
+{
+	int template_id;
+	bool is_valid;
+	float position[3];		// [mm] in the left camera coordinate system
+	float orientation[4];	// unit quaternion w,x,y,z
+	float residual;			// average deviation of the fit [mm] (of the unfiltered pose)
+
+	TemplatePose();
+
+	// Set from the 4x4 transformation "RT" (float, row major), invalid if it is zero (not found)
+	void setTransformation(int template_id_, const float *RT, float residual_);
+};
+
+
+struct PoseMessage
+{
+	enum PoseType
+	{
+		OBJECT_POSE = 0,
+		VIRTUAL_POINT_POSE = 1
+	};
+
+	int type;
+	unsigned int sequence_number;
+	long long int timestamp_us;
+	std::vector<TemplatePose> poses;
+
+	PoseMessage() : type(OBJECT_POSE), sequence_number(0), timestamp_us(0) {};
+
+	size_t getEncodedSize() const { return POSE_MESSAGE_HEADER_SIZE + poses.size() * POSE_MESSAGE_POSE_SIZE; };
+};
+
+
+// Encode "message" into "buffer" (resized to the message size, no allocation if big enough); returns the message size
+size_t encodePoseMessage(const PoseMessage& message, std::vector<char>& buffer);
+
+// Decode a received message; returns FALSE if "data" is no pose message (e.g. a text string) or of an other version
+bool decodePoseMessage(const char *data, size_t size, PoseMessage& message);
+
+}
+
+#endif // POSE_MESSAGE_H_
@@ -5,6 +5,8 @@
 //				 library. Configured by three "config_*.xml" files:
 //				 - Stereo camera/video files/2D Point data files as input source
 //				 - Searching for defined marker objects in the computed 3D point cloud
+//				 - Serial main loop or pipelined stages (grab, segment, reconstruct,
+//				   fit, publish) in parallel threads (do_use_pipeline)
 //				 - Using left mouse button or SPACE key to log points/frames/videos
 //				   (if interactive mode is on)
 //				 - Publishing the found 6D object pose (x,y,z,rodriguez-orientation(3D))
@@ -15,14 +17,19 @@
 //============================================================================
 
 #include "multicastServer/MulticastServer.h" // FIRST TO INCLUDE
+#include "multicastServer/PoseMessage.h"
+#include "sharedMemoryServer/SharedMemoryServer.h"
 
 #include "markerTracking/MarkerTracking.h"
+#include "markerTracking/Points2DFileReader.h"
+#include "trackingPipeline/TrackingPipeline.h"
 
 #ifdef USE_aravis
 	#include "stereoCam/unix/BaslerGigEStereoCamera.h"
 #endif
 
 #include "stereoCam/OpenCVStereoCamera.h"
+#include "stereoCam/RawFileStereoCamera.h"
 
 #ifdef WIN32
 	#include "inputDevice/win/WindowsMouse.h"
@@ -131,7 +138,7 @@ int main(int argc, char* argv[])
 	std::string input_device_src = (std::string)input_file_storage["input_device_src"];	// (m: Mouse, k: Keyboard)
 	std::string mouse_device_id = (std::string)input_file_storage["mouse_device_id"];
 	std::string keyboard_device_id = (std::string)input_file_storage["keyboard_device_id"];
-	std::string input_src = (std::string)input_file_storage["input_src"];	// (b: Basler Camera, o: OpenCV Camera, v: Video files, t: 2D point files)
+	std::string input_src = (std::string)input_file_storage["input_src"];	// (b: Basler Camera, o: OpenCV Camera, v: Video files, r: Raw stereo file, t: 2D point files)
 	std::string video_left = (std::string)input_file_storage["video_left"];
 	std::string video_right = (std::string)input_file_storage["video_right"];
 	std::string points_2D_left = (std::string)input_file_storage["points_2D_left"];
@@ -146,6 +153,40 @@ int main(int argc, char* argv[])
 	std::string log_frame_left_prefix = log_file_directory + (std::string)input_file_storage["log_frame_left_prefix"];
 	std::string log_frame_right_prefix = log_file_directory + (std::string)input_file_storage["log_frame_right_prefix"];
 
+	// Optional (serial main loop if not given)
+	int do_use_pipeline = 0, pipeline_queue_capacity = 2, do_use_zero_copy = 0;
+	if (!input_file_storage["do_use_pipeline"].empty())
+		do_use_pipeline = (int)input_file_storage["do_use_pipeline"];
+	if (!input_file_storage["pipeline_queue_capacity"].empty())
+		pipeline_queue_capacity = (int)input_file_storage["pipeline_queue_capacity"];
+	if (!input_file_storage["do_use_zero_copy"].empty())
+		do_use_zero_copy = (int)input_file_storage["do_use_zero_copy"];
+
+	// Optional (raw stereo files, see RawStereoFormat.h)
+	int do_pace_raw_video = 1, do_log_raw_video = 0;
+	std::string raw_video = "video.tiyraw", log_raw_video = log_file_directory + "log_video.tiyraw";
+	if (!input_file_storage["raw_video"].empty())
+		raw_video = (std::string)input_file_storage["raw_video"];
+	if (!input_file_storage["do_pace_raw_video"].empty())
+		do_pace_raw_video = (int)input_file_storage["do_pace_raw_video"];
+	if (!input_file_storage["do_log_raw_video"].empty())
+		do_log_raw_video = (int)input_file_storage["do_log_raw_video"];
+	if (!input_file_storage["log_raw_video"].empty())
+		log_raw_video = log_file_directory + (std::string)input_file_storage["log_raw_video"];
+
+	// Optional (text strings if not given)
+	int do_send_binary = 0;
+	if (!input_file_storage["do_send_binary"].empty())
+		do_send_binary = (int)input_file_storage["do_send_binary"];
+
+	// Optional (only multicast if not given)
+	int do_use_shared_memory = 0;
+	std::string shared_memory_name = SHARED_POSE_RING_NAME;
+	if (!input_file_storage["do_use_shared_memory"].empty())
+		do_use_shared_memory = (int)input_file_storage["do_use_shared_memory"];
+	if (!input_file_storage["shared_memory_name"].empty())
+		shared_memory_name = (std::string)input_file_storage["shared_memory_name"];
+
 	input_file_storage.release();
 
 	if (do_use_kalman_filter==-1 || do_interactive_mode==-1 || multicast_port==-1 || do_show_graphics==-1 ||
@@ -172,6 +213,20 @@ int main(int argc, char* argv[])
 		return 0;
 	}
 
+	if ((do_log_video || do_log_raw_video) && (input_src == "t"))
+	{
+		std::cerr << "Cannot record video files when reading 2D point files." << std::endl;
+		std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
+		return 0;
+	}
+
+	if (do_log_raw_video && (input_src == "r"))
+	{
+		std::cerr << "Cannot read a raw stereo file and record to a raw file at the same time." << std::endl;
+		std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
+		return 0;
+	}
+
 	bool do_debugging = (do_output_debug != 0);
 
 
@@ -218,9 +273,10 @@ int main(int argc, char* argv[])
 
 
   // -------------------------------------------------------------------------------------
-  // Stereo camera
+  // Stereo camera (or 2D point files)
   // -------------------------------------------------------------------------------------
   boost::scoped_ptr<tiy::StereoCamera> stereo_camera;
+  tiy::Points2DFileReader points_2D_file_left(do_debugging), points_2D_file_right(do_debugging);
 
   std::string camera_id_left = m_track.left_camera_id;
   std::string camera_id_right = m_track.right_camera_id;
@@ -241,6 +297,18 @@ int main(int argc, char* argv[])
   else if (input_src == "v")
   		  stereo_camera.reset(new tiy::OpenCVStereoCamera(do_debugging, camera_id_left, camera_id_right,
 								m_track.frame_width, m_track.frame_height, m_track.camera_exposure, m_track.camera_gain, m_track.frame_rate, video_left, video_right));
+  else if (input_src == "r")
+  		  stereo_camera.reset(new tiy::RawFileStereoCamera(do_debugging, camera_id_left, camera_id_right,
+								m_track.frame_width, m_track.frame_height, m_track.camera_exposure, m_track.camera_gain, m_track.frame_rate, raw_video, (do_pace_raw_video != 0)));
+  else if (input_src == "t")
+  {
+	  if (!points_2D_file_left.open(points_2D_left) || !points_2D_file_right.open(points_2D_right))
+	  {
+		  std::cerr << "Points2DFileReader::open() failed" << std::endl;
+		  std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
+		  return 0;
+	  }
+  }
   else
   {
 	  std::cerr << "No input source \"input_src\" specified in the configuration file \"" << arg_run_parameter_config_file << "\"" << std::endl;
@@ -249,19 +317,19 @@ int main(int argc, char* argv[])
   }
 
 
-  if (stereo_camera->openCam())
-	  stereo_camera->startCam();
-  else
+  if (stereo_camera)
   {
-	  std::cerr << "MarkerTracking::connectStereoCamera() failed" << std::endl;
-	  std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
-	  return 0;
+	  stereo_camera->setSyncTolerance(m_track.sync_tolerance_us);
+	  if (stereo_camera->openCam())
+		  stereo_camera->startCam();
+	  else
+	  {
+		  std::cerr << "MarkerTracking::connectStereoCamera() failed" << std::endl;
+		  std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
+		  return 0;
+	  }
   }
 
-  cv::Mat image_left = stereo_camera->createImage();
-  cv::Mat image_right = stereo_camera->createImage();
-  long long int frame_timestamp;
-
 
   // -------------------------------------------------------------------------------------
   // BOOST ASIO MULTICAST SERVER
@@ -272,6 +340,16 @@ int main(int argc, char* argv[])
   boost::system::error_code error_c;
   boost::thread server_io_service_thread(boost::bind(&boost::asio::io_service::run, &server_io_service, error_c));
 
+  // Same data to the clients on this host (optional)
+  boost::scoped_ptr<tiy::SharedMemoryServer> shared_memory_server;
+  if (do_use_shared_memory)
+	  shared_memory_server.reset(new tiy::SharedMemoryServer(shared_memory_name, do_debugging));
+
+  // Binary pose messages (reused => no allocation per frame)
+  tiy::PoseMessage pose_message;
+  std::vector<char> pose_message_buffer;
+  unsigned int pose_message_sequence_number = 0;
+
 
   // -------------------------------------------------------------------------------------
   // Logging
@@ -290,6 +368,22 @@ int main(int argc, char* argv[])
 	  log_virt_point.open(log_virt_point_pose.c_str());
   if (do_log_video)
 	  stereo_camera->startRecording(log_video_left, log_video_right);
+  if (do_log_raw_video)
+	  stereo_camera->startRawRecording(log_raw_video);
+
+
+  // -------------------------------------------------------------------------------------
+  // Tracking pipeline (grab -> segment -> reconstruct -> fit, serial or in parallel threads)
+  // -------------------------------------------------------------------------------------
+  tiy::TrackingPipeline tracking_pipeline(m_track, stereo_camera.get(), &points_2D_file_left, &points_2D_file_right, (do_log_video || do_log_raw_video), do_debugging);
+  tiy::TrackingFrame serial_frame;
+  tracking_pipeline.setZeroCopy(do_use_zero_copy != 0);
+
+  if (do_use_pipeline && !tracking_pipeline.start(pipeline_queue_capacity))
+  {
+	  std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
+	  return 0;
+  }
 
 
   // -------------------------------------------------------------------------------------
@@ -297,7 +391,6 @@ int main(int argc, char* argv[])
   // -------------------------------------------------------------------------------------
   int capture_counter = 1;
   bool is_base_temp = false;
-  int test_points_counter = 0;
 
   // time measurement
   boost::posix_time::ptime start_time, end_time;
@@ -306,11 +399,33 @@ int main(int argc, char* argv[])
   for(int i = 0; true; i++)
     {
 	  // -------------------------------------------------------------------------------------
-	  // Grab stereo frame
+	  // Grab stereo frame, extract (or read from file) 2D points, compute 3D points and
+	  // search for marker objects (templates) - pipelined: of the next frames in parallel
 	  // -------------------------------------------------------------------------------------
-	  if(!stereo_camera->grabFrame(image_left, image_right, frame_timestamp))
+	  tiy::TrackingFrame *frame = &serial_frame;
+	  if (do_use_pipeline)
+		  frame = tracking_pipeline.waitForFrame();
+	  else
+		  tracking_pipeline.processFrame(serial_frame);
+
+	  if (!frame)
+	  {
+		  std::cerr << "Tracking pipeline failed (no frame)" << std::endl;
+		  std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
+		  return 0;
+	  }
+	  else if (frame->status == tiy::TrackingFrame::FRAME_INPUT_FINISHED)
+	  {
+		  if (input_src == "t")
+			  std::cout << "2D point files finished." << std::endl;
+		  else
+			  std::cout << "Input finished." << std::endl;
+		  std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
+		  return 0;
+	  }
+	  else if (frame->status == tiy::TrackingFrame::FRAME_GRAB_FAILED)
       {
-		  if (input_src == "v")
+		  if (input_src == "v" || input_src == "r")
     	  {
 			  std::cout << "Video file finished." << std::endl;
 		  	  std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
@@ -322,56 +437,21 @@ int main(int argc, char* argv[])
 		  return 0;
       }
 
-	  if (do_log_video)
-		  stereo_camera->recordFrame();
+	  // Replace the fitted poses by the Kalman filtered ones (before any output)
+	  // (avg_dev stays the average deviation of the fit, i.e. of the pose BEFORE filtering)
+	  if (do_use_kalman_filter)
+		  m_track.filterPoses(frame->timestamp_us, frame->RT_template_leftcam);
 
+	  const cv::Mat& image_left = frame->image_left;
+	  const cv::Mat& image_right = frame->image_right;
+	  const long long int frame_timestamp = frame->timestamp_us;
+	  const std::vector<cv::Point2f>& points_2D_left = frame->points_2D_left;
+	  const std::vector<cv::Point2f>& points_2D_right = frame->points_2D_right;
+	  const cv::Mat& points_3D = frame->points_3D;
+	  const std::vector<cv::Mat>& RT_template_leftcam = frame->RT_template_leftcam;
+	  const std::vector<float>& avg_dev = frame->avg_dev;
 
-      // -------------------------------------------------------------------------------------
-      // Extract (or read from file) 2D points
-      // -------------------------------------------------------------------------------------
-      cv::vector<cv::Point2f> points_2D_left, points_2D_right;
-#pragma omp parallel sections
-      {
-#pragma omp section
-        {
-        	if (input_src == "t")
-        		m_track.get2DPointsFromFile("testpoints_left", &points_2D_left, test_points_counter);
-        	else
-        		m_track.get2DPointsFromImage(image_left, &points_2D_left);
-        }
-#pragma omp section
-        {
-        	if (input_src == "t")
-    	    	m_track.get2DPointsFromFile("testpoints_right", &points_2D_right, test_points_counter);
-        	else
-        		m_track.get2DPointsFromImage(image_right, &points_2D_right);
-        }
-      }
-      test_points_counter++;
-
-
-      // -------------------------------------------------------------------------------------
-      // Compute 3D points from 2D points
-      // -------------------------------------------------------------------------------------
-      cv::Mat points_3D = m_track.get3DPointsFrom2DPoints(points_2D_left, points_2D_right);
 
-
-      // -------------------------------------------------------------------------------------
-      // Search for marker objects (templates)
-      // -------------------------------------------------------------------------------------
-      std::vector<cv::Mat>RT_template_leftcam;
-      std::vector<float>avg_dev;
-
-      for(int t = 0; t < m_track.num_templates;t++)
-      {
-    	  RT_template_leftcam.push_back(cv::Mat::zeros(4,4,CV_32F));
-    	  avg_dev.push_back(0);
-      }
-#pragma omp parallel for
-      for(int r = 0; r < m_track.num_templates; r++)	  
-    	  m_track.fit3DPointsToObjectTemplate(points_3D, r, RT_template_leftcam[r], &avg_dev[r]);
-
-		  
       // -------------------------------------------------------------------------------------
       // Update mouse and keyboard status
       // -------------------------------------------------------------------------------------
@@ -405,9 +485,26 @@ int main(int argc, char* argv[])
 	  if (!do_interactive_mode || ((input_device_src == "m") && was_left_button_pressed) || ((input_device_src == "k") && was_SPACE_pressed))
         {
 	      // -------------------------------------------------------------------------------------
-	      // Send (publish the object/virtual point pose over multicast)
+	      // Send (publish the object/virtual point pose over multicast and optionally shared memory)
 	      // -------------------------------------------------------------------------------------
-	      if(do_send_object_pose)
+	      if(do_send_object_pose && do_send_binary)
+	        {
+			  pose_message.type = tiy::PoseMessage::OBJECT_POSE;
+			  pose_message.sequence_number = pose_message_sequence_number++;
+			  pose_message.timestamp_us = frame_timestamp;
+			  pose_message.poses.resize(m_track.num_templates);
+			  for(int r = 0; r < m_track.num_templates; r++)
+			  {
+				  cv::Mat RT = RT_template_leftcam[r].isContinuous() ? RT_template_leftcam[r] : RT_template_leftcam[r].clone();
+				  pose_message.poses[r].setTransformation(r, RT.ptr<float>(0), avg_dev[r]);
+			  }
+
+			  tiy::encodePoseMessage(pose_message, pose_message_buffer);
+			  multicast_server.addToBatch(pose_message_buffer);
+			  if (shared_memory_server)
+				  shared_memory_server->sendData(pose_message_buffer);
+	        }
+	      else if(do_send_object_pose)
 	        {
 	    	  std::string send_string;
 			  for(int r = 0; r < m_track.num_templates; r++)
@@ -427,12 +524,33 @@ int main(int argc, char* argv[])
 				  send_string += send_buffer;
 			  }
 
-			  multicast_server.sendString(send_string);
+			  multicast_server.addToBatch(send_string);
+			  if (shared_memory_server)
+				  shared_memory_server->sendString(send_string);
 
 			  if(do_debugging)
 			  	std::cout << "-------------" << std::endl << "SENDING :" << send_string << std::endl << "----------------" << std::endl;
 	        }			
-		  if(do_send_virt_point_pose)
+		  if(do_send_virt_point_pose && do_send_binary)
+	        {
+			  pose_message.type = tiy::PoseMessage::VIRTUAL_POINT_POSE;
+			  pose_message.sequence_number = pose_message_sequence_number++;
+			  pose_message.timestamp_us = frame_timestamp;
+			  pose_message.poses.resize(m_track.num_templates);
+			  for(int r = 0; r < m_track.num_templates; r++)
+			  {
+				  cv::Mat RT_virt_point_to_leftcam = cv::Mat::zeros(4, 4, CV_32F);
+				  if (countNonZero(RT_template_leftcam[r]) && countNonZero(m_track.RT_virt_point_to_template[r] - cv::Mat::eye(4, 4, CV_32F)))
+					RT_virt_point_to_leftcam = RT_template_leftcam[r] * m_track.RT_virt_point_to_template[r];
+				  pose_message.poses[r].setTransformation(r, RT_virt_point_to_leftcam.ptr<float>(0), avg_dev[r]);
+			  }
+
+			  tiy::encodePoseMessage(pose_message, pose_message_buffer);
+			  multicast_server.addToBatch(pose_message_buffer);
+			  if (shared_memory_server)
+				  shared_memory_server->sendData(pose_message_buffer);
+	        }
+		  else if(do_send_virt_point_pose)
 	        {
 	    	  std::string send_string;
 			  for(int r = 0; r < m_track.num_templates; r++)
@@ -455,11 +573,16 @@ int main(int argc, char* argv[])
 
 				  send_string += send_buffer;
 			  }
-			  multicast_server.sendString(send_string);
+			  multicast_server.addToBatch(send_string);
+			  if (shared_memory_server)
+				  shared_memory_server->sendString(send_string);
 
 			  if(do_debugging)
 			  	std::cout << "-------------" << std::endl << "SENDING :" << send_string << std::endl << "----------------" << std::endl;
 	        }
+
+		  // Object and virtual point poses of the frame together (Linux: one syscall)
+		  multicast_server.sendBatch();
 			
 		  // -------------------------------------------------------------------------------------
 		  // Display
@@ -595,14 +718,12 @@ int main(int argc, char* argv[])
 			  }
 			  log_virt_point << std::endl;
 		  }
-		  if (do_log_video)
-			  stereo_camera->recordFrame();
         }
 
 	  // -------------------------------------------------------------------------------------
       // Capture stereo frame
       // -------------------------------------------------------------------------------------
-	  if (do_log_frame && (((input_device_src == "m") && was_left_button_pressed) || ((input_device_src == "k") && was_SPACE_pressed)))
+	  if (do_log_frame && !(input_src == "t") && (((input_device_src == "m") && was_left_button_pressed) || ((input_device_src == "k") && was_SPACE_pressed)))
 		{			
 		  std::string save_file;
 
@@ -673,7 +794,17 @@ int main(int argc, char* argv[])
 		std::cout << "comp_time = " << time_diff.total_microseconds() << " [us]" << std::endl;
 
 		start_time = boost::posix_time::microsec_clock::universal_time();
+
+		if (i % 500 == 499)
+		{
+			tracking_pipeline.printStatistics(std::cout);
+			if (stereo_camera && stereo_camera->getSyncTolerance() > 0)
+				stereo_camera->getSyncStatistics().print(std::cout);
+		}
       }
+
+      if (do_use_pipeline)
+    	  tracking_pipeline.releaseFrame(frame);
     } //end MAIN LOOP
 
 	if (log_2D_left.is_open())
@@ -685,7 +816,8 @@ int main(int argc, char* argv[])
 	if (log_object.is_open())
 		log_object.close();
 
-	stereo_camera->closeCam();
+	if (stereo_camera)
+		stereo_camera->closeCam();
 
   std::cerr << "PRESS A KEY TO EXIT"; cv::destroyAllWindows(); cv::waitKey(1); std::cin.get();
   return 0;
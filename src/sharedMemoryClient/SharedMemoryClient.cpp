@@ -0,0 +1,264 @@
+//============================================================================
+// Name        : SharedMemoryClient.cpp
+// Author      : Andreas Pflaum, Andre Gaschler
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "SharedMemoryClient.h"
+
+// Interval of trying to (re)connect to the server [ms]
+#define SHARED_MEMORY_CLIENT_CONNECT_INTERVAL_MS 100
+
+namespace tiy
+{
+
+SharedMemoryClient::SharedMemoryClient(const std::string& shared_memory_name_, bool do_debugging_) :
+	shared_memory_name(shared_memory_name_),
+	do_debugging(do_debugging_),
+	header(NULL),
+	read_index(0)
+{
+	go_on = true;
+	num_dropped_packets = 0;
+
+	connect();
+}
+
+
+SharedMemoryClient::~SharedMemoryClient()
+{
+	disconnect();
+}
+
+
+bool
+SharedMemoryClient::connect()
+{
+	if (header != NULL)
+	{
+		if (!header->is_closed.load(boost::memory_order_acquire))
+			return true;
+
+		if (do_debugging)
+		{
+			boost::mutex::scoped_lock io_lock(io_mutex);
+			std::cout << "SharedMemoryClient: server closed \"" << shared_memory_name << "\"" << std::endl;
+		}
+		disconnect();
+	}
+
+	// (not at every call, as opening is a syscall)
+	boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+	if (!last_connect_time.is_not_a_date_time() && (now - last_connect_time).total_milliseconds() < SHARED_MEMORY_CLIENT_CONNECT_INTERVAL_MS)
+		return false;
+	last_connect_time = now;
+
+	try
+	{
+		// (read_write, as 64 bit atomic loads may write on 32 bit platforms)
+		shared_memory.reset(new boost::interprocess::shared_memory_object(boost::interprocess::open_only, shared_memory_name.c_str(), boost::interprocess::read_write));
+		mapped_region.reset(new boost::interprocess::mapped_region(*shared_memory, boost::interprocess::read_write));
+	}
+	catch (boost::interprocess::interprocess_exception&)
+	{
+		// Server not started (yet)
+		disconnect();
+		return false;
+	}
+
+	SharedPoseRingHeader *ring_header = (SharedPoseRingHeader *)mapped_region->get_address();
+
+	// Not yet initialized by the server, or of an other version
+	if (mapped_region->get_size() < SHARED_POSE_RING_HEADER_SIZE || ring_header->magic.load(boost::memory_order_acquire) != SHARED_POSE_RING_MAGIC)
+	{
+		disconnect();
+		return false;
+	}
+	if (ring_header->version != SHARED_POSE_RING_VERSION || ring_header->num_slots == 0 ||
+			mapped_region->get_size() < getSharedPoseRingSize(ring_header->num_slots, ring_header->slot_size))
+	{
+		std::cerr << "SharedMemoryClient: connect() - \"" << shared_memory_name << "\" is no pose ring (version " << SHARED_POSE_RING_VERSION << ")" << std::endl;
+		disconnect();
+		return false;
+	}
+
+	header = ring_header;
+
+	// Only messages sent from now on
+	read_index = header->write_index.load(boost::memory_order_acquire);
+
+	if (do_debugging)
+	{
+		boost::mutex::scoped_lock io_lock(io_mutex);
+		std::cout << "SharedMemoryClient: connected to \"" << shared_memory_name << "\"" << std::endl;
+	}
+
+	return true;
+}
+
+
+void
+SharedMemoryClient::disconnect()
+{
+	header = NULL;
+	mapped_region.reset();
+	shared_memory.reset();
+}
+
+
+bool
+SharedMemoryClient::readMessage()
+{
+	if (!connect())
+		return false;
+
+	boost::uint64_t write_index = header->write_index.load(boost::memory_order_acquire);
+
+	// Overwritten since the last read
+	if (write_index < read_index)
+		read_index = write_index;
+	else if (write_index - read_index > header->num_slots)
+	{
+		num_dropped_packets += (long long)(write_index - header->num_slots - read_index);
+		read_index = write_index - header->num_slots;
+	}
+
+	while (read_index < write_index)
+	{
+		SharedPoseRingSlot *slot = getSharedPoseRingSlot(header, read_index);
+		boost::uint64_t expected_sequence = 2 * read_index + 2;
+		read_index++;
+
+		// Seqlock: the slot must hold the expected message before and after copying it
+		boost::uint64_t sequence = slot->sequence.load(boost::memory_order_acquire);
+		if (sequence == expected_sequence)
+		{
+			boost::uint32_t size = slot->size;
+			if (size <= header->slot_size)
+			{
+				packet.assign(slot->getData(), slot->getData() + size);
+
+				boost::atomic_thread_fence(boost::memory_order_acquire);
+				if (slot->sequence.load(boost::memory_order_relaxed) == expected_sequence)
+					return true;
+			}
+		}
+
+		num_dropped_packets++;
+	}
+
+	return false;
+}
+
+
+void
+SharedMemoryClient::skipToNewest()
+{
+	if (!connect())
+		return;
+
+	boost::uint64_t write_index = header->write_index.load(boost::memory_order_acquire);
+	if (write_index > read_index + 1)
+		read_index = write_index - 1;
+}
+
+
+bool
+SharedMemoryClient::getReceivedString(std::string& data_string_)
+{
+	skipToNewest();
+
+	bool is_new_data = false;
+	while (readMessage())
+		is_new_data = true;
+
+	if (!is_new_data)
+	{
+		data_string_ = "";
+		return false;
+	}
+
+	data_string_.assign(packet.begin(), packet.end());
+	return true;
+}
+
+
+bool
+SharedMemoryClient::getReceivedPoseMessage(PoseMessage& message_)
+{
+	std::string data_string_buffer;
+	if (!getReceivedString(data_string_buffer))
+		return false;
+
+	return decodePoseMessage(data_string_buffer.data(), data_string_buffer.size(), message_);
+}
+
+
+int
+SharedMemoryClient::getReceivedStrings(std::vector<std::string>& data_strings_)
+{
+	// (the strings of data_strings_ are reused => no allocation once big enough)
+	int num_strings = 0;
+	while (readMessage())
+	{
+		if (num_strings >= (int)data_strings_.size())
+			data_strings_.resize(num_strings + 1);
+
+		data_strings_[num_strings++].assign(packet.begin(), packet.end());
+	}
+
+	data_strings_.resize(num_strings);
+	return num_strings;
+}
+
+
+int
+SharedMemoryClient::getReceivedPoseMessages(std::vector<PoseMessage>& messages_)
+{
+	int num_messages = 0;
+	while (readMessage())
+	{
+		if (num_messages >= (int)messages_.size())
+			messages_.resize(num_messages + 1);
+
+		if (!packet.empty() && decodePoseMessage(&packet[0], packet.size(), messages_[num_messages]))
+			num_messages++;
+	}
+
+	messages_.resize(num_messages);
+	return num_messages;
+}
+
+
+bool
+SharedMemoryClient::waitForData(double timeout_seconds)
+{
+	boost::chrono::steady_clock::time_point timeout_time = boost::chrono::steady_clock::now()
+			+ boost::chrono::microseconds((long long)(timeout_seconds * 1e6));
+
+	// Polling the write index (no syscall): yielding first for a low latency, then sleeping shortly
+	for (int num_idle = 0; go_on; num_idle++)
+	{
+		if (connect() && header->write_index.load(boost::memory_order_acquire) > read_index)
+			return true;
+
+		if (boost::chrono::steady_clock::now() >= timeout_time)
+			return false;
+
+		if (num_idle < 256)
+			boost::this_thread::yield();
+		else
+			boost::this_thread::sleep_for(boost::chrono::microseconds(20));
+	}
+
+	return false;
+}
+
+
+void
+SharedMemoryClient::stopReceiving()
+{
+	go_on = false;
+}
+
+}
@@ -0,0 +1,105 @@
+//============================================================================
+// Name        : SharedMemoryClient.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Client of a SharedMemoryServer on the same host, with the
+//				 same interface as the MulticastClient:
+//				 - The messages are read wait-free from the ring in shared
+//				   memory (no syscall, no lock), in order of sending
+//				 - Messages overwritten before they were read are counted
+//				   as dropped (getNumDroppedPackets())
+//				 - The client can be started before the server and
+//				   reconnects if the server is restarted (after it
+//				   stopped properly)
+//				 The get/wait methods must be called from ONE thread.
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef SHARED_MEMORY_CLIENT_H_
+#define SHARED_MEMORY_CLIENT_H_
+
+#include "../sharedMemoryServer/SharedPoseRing.h"
+#include "../multicastServer/PoseMessage.h"
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace tiy
+{
+
+class SharedMemoryClient
+{
+
+public:
+
+	// Constructor (NOT blocking, connects to the shared memory "shared_memory_name_" as soon as the server created it)
+	SharedMemoryClient(const std::string& shared_memory_name_, bool do_debugging_);
+
+	~SharedMemoryClient();
+
+	// Get newest received data string and return TRUE if not already get before, else FALSE (older messages are skipped)
+	bool getReceivedString(std::string& data_string_);
+
+	// Decode newest received data as binary pose message and return TRUE if not already get before and valid, else FALSE
+	bool getReceivedPoseMessage(PoseMessage& message_);
+
+	// Get all new data strings in order of sending (NOT blocking); returns their number
+	int getReceivedStrings(std::vector<std::string>& data_strings_);
+
+	// Get all new binary pose messages in order of sending (other data is skipped); returns their number
+	int getReceivedPoseMessages(std::vector<PoseMessage>& messages_);
+
+	// Block until new data is available (TRUE) or "timeout_seconds" are over or receiving stopped (FALSE)
+	bool waitForData(double timeout_seconds);
+
+	// Number of messages overwritten by the server before they were read
+	long long getNumDroppedPackets() const { return num_dropped_packets; };
+
+	bool isConnected() const { return (header != NULL); };
+
+	void stopReceiving();
+
+private:
+
+	// Map the ring (if not yet done or the server was restarted); FALSE if not available
+	bool connect();
+	void disconnect();
+
+	// Read the next message into "packet" (FALSE: no new message)
+	bool readMessage();
+
+	// Skip to the newest message
+	void skipToNewest();
+
+private:
+
+	std::string shared_memory_name;
+	bool do_debugging;
+	boost::atomic<bool> go_on;
+
+	boost::scoped_ptr<boost::interprocess::shared_memory_object> shared_memory;
+	boost::scoped_ptr<boost::interprocess::mapped_region> mapped_region;
+	SharedPoseRingHeader *header;
+	boost::posix_time::ptime last_connect_time;
+
+	// Index of the next message to read
+	boost::uint64_t read_index;
+
+	// Last read message (reused)
+	std::vector<char> packet;
+
+	boost::atomic<long long> num_dropped_packets;
+
+	boost::mutex io_mutex;
+
+};
+
+}
+
+#endif // SHARED_MEMORY_CLIENT_H_
@@ -0,0 +1,135 @@
+//============================================================================
+// Name        : SharedMemoryServer.cpp
+// Author      : Andreas Pflaum, Andre Gaschler
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "SharedMemoryServer.h"
+
+#include <cstring>
+#include <new>
+
+namespace tiy
+{
+
+SharedMemoryServer::SharedMemoryServer(const std::string& shared_memory_name_, bool do_debugging_, int num_slots_, int slot_size_) :
+	shared_memory_name(shared_memory_name_),
+	do_debugging(do_debugging_),
+	header(NULL)
+{
+	if (num_slots_ < 1 || slot_size_ < 1)
+	{
+		std::cerr << "SharedMemoryServer: SharedMemoryServer() - invalid ring size " << num_slots_ << " x " << slot_size_ << " bytes" << std::endl;
+		return;
+	}
+
+	try
+	{
+		// (left over by a server that did not stop properly)
+		boost::interprocess::shared_memory_object::remove(shared_memory_name.c_str());
+
+		shared_memory.reset(new boost::interprocess::shared_memory_object(boost::interprocess::create_only, shared_memory_name.c_str(), boost::interprocess::read_write));
+		shared_memory->truncate((boost::interprocess::offset_t)getSharedPoseRingSize(num_slots_, slot_size_));
+		mapped_region.reset(new boost::interprocess::mapped_region(*shared_memory, boost::interprocess::read_write));
+	}
+	catch (boost::interprocess::interprocess_exception& e)
+	{
+		std::cerr << "SharedMemoryServer: SharedMemoryServer() - could not create shared memory \"" << shared_memory_name << "\" (" << e.what() << ")" << std::endl;
+		mapped_region.reset();
+		shared_memory.reset();
+		return;
+	}
+
+	// The memory is zero (sequences 0 = empty slots)
+	SharedPoseRingHeader *ring_header = new (mapped_region->get_address()) SharedPoseRingHeader;
+
+	// The clients in other processes need address free atomics
+	if (!ring_header->write_index.is_lock_free() || !ring_header->magic.is_lock_free())
+	{
+		std::cerr << "SharedMemoryServer: SharedMemoryServer() - no lock-free 64 bit atomics on this platform" << std::endl;
+		return;
+	}
+
+	ring_header->version = SHARED_POSE_RING_VERSION;
+	ring_header->num_slots = num_slots_;
+	ring_header->slot_size = slot_size_;
+	ring_header->slot_stride = (boost::uint32_t)getSharedPoseRingSlotStride(slot_size_);
+	ring_header->is_closed.store(0, boost::memory_order_relaxed);
+	ring_header->write_index.store(0, boost::memory_order_relaxed);
+	ring_header->magic.store(SHARED_POSE_RING_MAGIC, boost::memory_order_release);
+
+	header = ring_header;
+
+	if (do_debugging)
+	{
+		boost::mutex::scoped_lock io_lock(io_mutex);
+		std::cout << "SharedMemoryServer: STARTED (\"" << shared_memory_name << "\", " << num_slots_ << " x " << slot_size_ << " bytes)" << std::endl;
+	}
+}
+
+
+SharedMemoryServer::~SharedMemoryServer()
+{
+	if (header != NULL)
+		header->is_closed.store(1, boost::memory_order_release);
+
+	mapped_region.reset();
+	if (shared_memory)
+	{
+		shared_memory.reset();
+		// (the clients keep their mapping until they notice is_closed)
+		boost::interprocess::shared_memory_object::remove(shared_memory_name.c_str());
+	}
+}
+
+
+bool
+SharedMemoryServer::sendString(const std::string& send_string)
+{
+	if (do_debugging)
+	  {
+		boost::mutex::scoped_lock io_lock(io_mutex);
+		std::cout << "SharedMemoryServer: SENDING \"" << send_string << "\""<< std::endl;
+	  }
+
+	return sendData(send_string.data(), send_string.size());
+}
+
+
+bool
+SharedMemoryServer::sendData(const std::vector<char>& send_data)
+{
+	return sendData(send_data.empty() ? NULL : &send_data[0], send_data.size());
+}
+
+
+bool
+SharedMemoryServer::sendData(const char *data, size_t size)
+{
+	if (header == NULL)
+		return false;
+
+	if (size > header->slot_size)
+	{
+		std::cerr << "SharedMemoryServer: sendData() - message of " << size << " bytes bigger than the slot size " << header->slot_size << std::endl;
+		return false;
+	}
+
+	boost::uint64_t index = header->write_index.load(boost::memory_order_relaxed);
+	SharedPoseRingSlot *slot = getSharedPoseRingSlot(header, index);
+
+	// Seqlock: odd sequence while writing (the fence keeps the message writes behind it)
+	slot->sequence.store(2 * index + 1, boost::memory_order_relaxed);
+	boost::atomic_thread_fence(boost::memory_order_release);
+
+	if (size > 0)
+		memcpy(slot->getData(), data, size);
+	slot->size = (boost::uint32_t)size;
+
+	slot->sequence.store(2 * index + 2, boost::memory_order_release);
+	header->write_index.store(index + 1, boost::memory_order_release);
+
+	return true;
+}
+
+}
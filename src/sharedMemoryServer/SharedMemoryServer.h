@@ -0,0 +1,70 @@
+//============================================================================
+// Name        : SharedMemoryServer.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Publishing data (e.g. binary pose messages, see
+//				 PoseMessage.h) to SharedMemoryClients on the same host,
+//				 as alternative to the MulticastServer with lower latency:
+//				 - The messages are written into a ring in shared memory
+//				   (layout see SharedPoseRing.h), named e.g. "tiy_poses"
+//				 - Sending never blocks; if a client does not keep up,
+//				   the oldest messages are overwritten
+//				 - The shared memory is removed by the destructor
+//				 The send methods must be called from ONE thread.
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef SHARED_MEMORY_SERVER_H_
+#define SHARED_MEMORY_SERVER_H_
+
+#include "SharedPoseRing.h"
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace tiy
+{
+
+class SharedMemoryServer
+{
+
+public:
+
+	// Creates the shared memory "shared_memory_name_" (an existing one is replaced) with "num_slots_" messages of up to "slot_size_" bytes
+	SharedMemoryServer(const std::string& shared_memory_name_, bool do_debugging_,
+						int num_slots_ = SHARED_POSE_RING_NUM_SLOTS, int slot_size_ = SHARED_POSE_RING_SLOT_SIZE);
+
+	~SharedMemoryServer();
+
+	bool isOpen() const { return (header != NULL); };
+
+	// Write the string send_string into the ring (FALSE: not open or too big)
+	bool sendString(const std::string& send_string);
+
+	// Write binary data (e.g. an encoded PoseMessage) into the ring
+	bool sendData(const std::vector<char>& send_data);
+
+	bool sendData(const char *data, size_t size);
+
+private:
+
+	std::string shared_memory_name;
+	bool do_debugging;
+
+	boost::scoped_ptr<boost::interprocess::shared_memory_object> shared_memory;
+	boost::scoped_ptr<boost::interprocess::mapped_region> mapped_region;
+	SharedPoseRingHeader *header;
+
+	boost::mutex io_mutex;
+
+};
+
+}
+
+#endif // SHARED_MEMORY_SERVER_H_
@@ -0,0 +1,93 @@
+//============================================================================
+// Name        : SharedPoseRing.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Layout of the shared memory ring written by the
+//				 SharedMemoryServer and read by SharedMemoryClients on the
+//				 same host (seqlock per slot => one writer, any number of
+//				 wait-free readers, no locks between the processes):
+//				 - Header (SHARED_POSE_RING_HEADER_SIZE bytes): magic,
+//				   version, number of slots, slot size, index of the next
+//				   message to write, closed flag
+//				 - Slots (each "slot_stride" bytes, cache line aligned):
+//				   sequence (odd: being written, 2 * message index + 2:
+//				   message written), message size, message (e.g. a binary
+//				   PoseMessage)
+//				 A reader copies a slot and checks that its sequence was
+//				 the expected one before and after the copy; else the slot
+//				 was overwritten meanwhile and the message is lost.
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef SHARED_POSE_RING_H_
+#define SHARED_POSE_RING_H_
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/static_assert.hpp>
+
+#include <cstddef>
+
+#define SHARED_POSE_RING_MAGIC 0x52534954		// "TISR"
+#define SHARED_POSE_RING_VERSION 1
+#define SHARED_POSE_RING_HEADER_SIZE 64
+#define SHARED_POSE_RING_SLOT_HEADER_SIZE 16
+#define SHARED_POSE_RING_ALIGNMENT 64			// cache line
+
+#define SHARED_POSE_RING_NAME "tiy_poses"
+#define SHARED_POSE_RING_NUM_SLOTS 64
+#define SHARED_POSE_RING_SLOT_SIZE 1472		// maximum message size (as a datagram)
+
+
+namespace tiy
+{
+
+struct SharedPoseRingHeader
+{
+	// Written last by the server (release) => the ring is initialized
+	boost::atomic<boost::uint32_t> magic;
+	boost::uint32_t version;
+	boost::uint32_t num_slots;
+	boost::uint32_t slot_size;			// maximum message size
+	boost::uint32_t slot_stride;		// bytes from slot to slot
+	boost::atomic<boost::uint32_t> is_closed;	// set by the server when it stops
+	boost::atomic<boost::uint64_t> write_index;	// number of messages written
+};
+
+
+struct SharedPoseRingSlot
+{
+	boost::atomic<boost::uint64_t> sequence;
+	boost::uint32_t size;
+	boost::uint32_t reserved;
+	// (followed by "slot_size" bytes message)
+
+	char* getData() { return (char *)this + SHARED_POSE_RING_SLOT_HEADER_SIZE; };
+};
+
+BOOST_STATIC_ASSERT(sizeof(SharedPoseRingHeader) <= SHARED_POSE_RING_HEADER_SIZE);
+BOOST_STATIC_ASSERT(sizeof(SharedPoseRingSlot) == SHARED_POSE_RING_SLOT_HEADER_SIZE);
+
+
+inline size_t
+getSharedPoseRingSlotStride(int slot_size)
+{
+	return (SHARED_POSE_RING_SLOT_HEADER_SIZE + (size_t)slot_size + SHARED_POSE_RING_ALIGNMENT - 1) / SHARED_POSE_RING_ALIGNMENT * SHARED_POSE_RING_ALIGNMENT;
+}
+
+
+inline size_t
+getSharedPoseRingSize(int num_slots, int slot_size)
+{
+	return SHARED_POSE_RING_HEADER_SIZE + (size_t)num_slots * getSharedPoseRingSlotStride(slot_size);
+}
+
+
+inline SharedPoseRingSlot*
+getSharedPoseRingSlot(SharedPoseRingHeader *header, boost::uint64_t message_index)
+{
+	return (SharedPoseRingSlot *)((char *)header + SHARED_POSE_RING_HEADER_SIZE + (size_t)(message_index % header->num_slots) * header->slot_stride);
+}
+
+}
+
+#endif // SHARED_POSE_RING_H_
@@ -0,0 +1,221 @@
+//============================================================================
+// Name        : FramePool.cpp
+// Author      : Andreas Pflaum, Andre Gaschler
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "FramePool.h"
+
+#ifdef WIN32
+	#include <malloc.h>
+#else
+	#include <stdlib.h>
+#endif
+
+namespace tiy
+{
+
+FramePool::FramePool(int capacity_) :
+	data_size(0),
+	buffer_size(0),
+	capacity(capacity_),
+	num_used(0),
+	num_heap_allocations(0),
+	is_released(false)
+{
+}
+
+
+FramePool::~FramePool()
+{
+	for (unsigned int i = 0; i < buffers.size(); i++)
+		freeBuffer(buffers[i]);
+}
+
+
+void
+FramePool::reserve(int capacity_)
+{
+	boost::mutex::scoped_lock lock(pool_mutex);
+
+	if (capacity_ <= capacity)
+		return;
+
+	capacity = capacity_;
+	if (data_size > 0)
+		fill();
+}
+
+
+void
+FramePool::fill()
+{
+	buffers.reserve(capacity);
+	free_buffers.reserve(capacity);
+
+	while ((int)buffers.size() < capacity)
+	{
+		uchar *buffer = allocateBuffer(true);
+		if (buffer == NULL)
+		{
+			std::cerr << "FramePool: fill() - could not allocate " << capacity << " buffers of " << buffer_size << " bytes" << std::endl;
+			capacity = (int)buffers.size();
+			return;
+		}
+
+		buffers.push_back(buffer);
+		free_buffers.push_back(buffer);
+	}
+}
+
+
+uchar*
+FramePool::allocateBuffer(bool is_pooled)
+{
+	void *buffer = NULL;
+#ifdef WIN32
+	buffer = _aligned_malloc(buffer_size, FRAME_POOL_ALIGNMENT);
+#else
+	if (posix_memalign(&buffer, FRAME_POOL_ALIGNMENT, buffer_size) != 0)
+		buffer = NULL;
+#endif
+	if (buffer == NULL)
+		return NULL;
+
+	BufferTrailer *trailer = (BufferTrailer *)((uchar *)buffer + data_size);
+	trailer->refcount = 0;
+	trailer->is_pooled = is_pooled;
+
+	return (uchar *)buffer;
+}
+
+
+void
+FramePool::freeBuffer(uchar *buffer)
+{
+#ifdef WIN32
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+
+void
+FramePool::release()
+{
+	bool do_delete;
+	{
+		boost::mutex::scoped_lock lock(pool_mutex);
+		is_released = true;
+		do_delete = (num_used == 0);
+	}
+
+	// (else deleted by the last deallocate())
+	if (do_delete)
+		delete this;
+}
+
+
+int
+FramePool::getCapacity()
+{
+	boost::mutex::scoped_lock lock(pool_mutex);
+	return capacity;
+}
+
+
+int
+FramePool::getNumUsed()
+{
+	boost::mutex::scoped_lock lock(pool_mutex);
+	return num_used;
+}
+
+
+long long
+FramePool::getNumHeapAllocations()
+{
+	boost::mutex::scoped_lock lock(pool_mutex);
+	return num_heap_allocations;
+}
+
+
+void
+FramePool::allocate(int dims, const int* sizes, int type, int*& refcount, uchar*& datastart, uchar*& data, size_t* step)
+{
+	// Continuous steps (like the default allocator)
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; i--)
+	{
+		step[i] = total;
+		total *= sizes[i];
+	}
+
+	// The trailer behind the data is kept aligned for the reference count
+	size_t aligned_total = (total + 15) & ~(size_t)15;
+
+	uchar *buffer = NULL;
+	{
+		boost::mutex::scoped_lock lock(pool_mutex);
+
+		if (data_size == 0)
+		{
+			data_size = aligned_total;
+			buffer_size = data_size + sizeof(BufferTrailer);
+			fill();
+		}
+
+		if (aligned_total == data_size && !free_buffers.empty())
+		{
+			buffer = free_buffers.back();
+			free_buffers.pop_back();
+		}
+		else
+			num_heap_allocations++;
+
+		num_used++;
+	}
+
+	BufferTrailer *trailer;
+	if (buffer != NULL)
+		trailer = (BufferTrailer *)(buffer + data_size);
+	else
+	{
+		// Different size or pool exhausted => heap (same buffer layout)
+		buffer = (uchar *)cv::fastMalloc(aligned_total + sizeof(BufferTrailer));
+		trailer = (BufferTrailer *)(buffer + aligned_total);
+		trailer->is_pooled = false;
+	}
+
+	refcount = &trailer->refcount;
+
+	*refcount = 1;
+	datastart = data = buffer;
+}
+
+
+void
+FramePool::deallocate(int* refcount, uchar* datastart, uchar* data)
+{
+	bool is_pooled = (((BufferTrailer *)refcount)->is_pooled != 0);
+
+	if (!is_pooled)
+		cv::fastFree(datastart);
+
+	bool do_delete;
+	{
+		boost::mutex::scoped_lock lock(pool_mutex);
+
+		if (is_pooled)
+			free_buffers.push_back(datastart);
+
+		num_used--;
+		do_delete = is_released && (num_used == 0);
+	}
+
+	if (do_delete)
+		delete this;
+}
+
+}
@@ -0,0 +1,89 @@
+//============================================================================
+// Name        : FramePool.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Fixed capacity pool of pre-allocated, page aligned image
+//				 buffers, used as cv::MatAllocator (cv::Mat::allocator):
+//				 - cv::Mat::create() takes a free buffer, the buffer is
+//				   given back when the reference count of the cv::Mat
+//				   (shared by all its copies) drops to zero
+//				 - The buffer size is fixed by the first allocation, other
+//				   sizes and allocations beyond the capacity are served
+//				   from the heap (counted)
+//				 - Thread-safe; the pool is deleted by release() as soon
+//				   as no buffer is used any more
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef FRAME_POOL_H_
+#define FRAME_POOL_H_
+
+#include <opencv2/core/core.hpp>
+
+#include <boost/thread.hpp>
+
+#include <iostream>
+#include <vector>
+
+// Alignment of the buffers (page size)
+#define FRAME_POOL_ALIGNMENT 4096
+
+
+namespace tiy
+{
+
+class FramePool : public cv::MatAllocator
+{
+
+private:
+
+	// Behind the image data of every buffer (the reference count has to be the first member)
+	struct BufferTrailer
+	{
+		int refcount;
+		int is_pooled;
+	};
+
+	boost::mutex pool_mutex;
+
+	size_t data_size, buffer_size;
+	int capacity;
+	std::vector<uchar*> buffers, free_buffers;
+
+	// Buffers in use (pooled and from the heap) and number of heap allocations
+	int num_used;
+	long long num_heap_allocations;
+	bool is_released;
+
+private:
+
+	// Only by release()
+	virtual ~FramePool();
+
+	uchar* allocateBuffer(bool is_pooled);
+	static void freeBuffer(uchar *buffer);
+
+	// Allocate buffers up to the capacity (pool_mutex locked)
+	void fill();
+
+public:
+
+	FramePool(int capacity_);
+
+	// Increase the capacity to at least "capacity_" buffers (e.g. before a TrackingPipeline holds more images)
+	void reserve(int capacity_);
+
+	// Delete the pool (at once or after the last buffer is given back)
+	void release();
+
+	int getCapacity();
+	int getNumUsed();
+	long long getNumHeapAllocations();
+
+	// cv::MatAllocator
+	virtual void allocate(int dims, const int* sizes, int type, int*& refcount, uchar*& datastart, uchar*& data, size_t* step);
+	virtual void deallocate(int* refcount, uchar* datastart, uchar* data);
+};
+
+}
+
+#endif // FRAME_POOL_H_
@@ -6,13 +6,102 @@
 
 #include "OpenCVStereoCamera.h"
 
+#if defined(__SSSE3__)
+	#include <tmmintrin.h>
+	#define OPENCV_STEREO_CAMERA_SSSE3
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define OPENCV_STEREO_CAMERA_SSE2
+#endif
+
+// Luma weights of B, G, R (ITU-R BT.601 like cv::cvtColor(), 8 bit fixed point, sum 256)
+#define LUMA_WEIGHT_B 29
+#define LUMA_WEIGHT_G 150
+#define LUMA_WEIGHT_R 77
+
 namespace tiy
 {
 
+// Luma of "num_pixels" BGR pixels
+static void
+lumaFromBGR(const unsigned char *src, unsigned char *dst, int num_pixels)
+{
+	int i = 0;
+
+#ifdef OPENCV_STEREO_CAMERA_SSSE3
+	// Deinterleave 16 pixels (48 bytes) into B, G and R by byte shuffles, weighted sum in 16 bit (max 255*256+128)
+	const __m128i shuffle_b0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i shuffle_b1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+	const __m128i shuffle_b2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+	const __m128i shuffle_g0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i shuffle_g1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+	const __m128i shuffle_g2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+	const __m128i shuffle_r0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i shuffle_r1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+	const __m128i shuffle_r2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+	const __m128i weight_b = _mm_set1_epi16(LUMA_WEIGHT_B);
+	const __m128i weight_g = _mm_set1_epi16(LUMA_WEIGHT_G);
+	const __m128i weight_r = _mm_set1_epi16(LUMA_WEIGHT_R);
+	const __m128i rounding = _mm_set1_epi16(128);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= num_pixels; i += 16)
+	{
+		const __m128i *src16 = (const __m128i *)(src + 3*i);
+		__m128i a = _mm_loadu_si128(src16);
+		__m128i b = _mm_loadu_si128(src16 + 1);
+		__m128i c = _mm_loadu_si128(src16 + 2);
+
+		__m128i blue = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, shuffle_b0), _mm_shuffle_epi8(b, shuffle_b1)), _mm_shuffle_epi8(c, shuffle_b2));
+		__m128i green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, shuffle_g0), _mm_shuffle_epi8(b, shuffle_g1)), _mm_shuffle_epi8(c, shuffle_g2));
+		__m128i red = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, shuffle_r0), _mm_shuffle_epi8(b, shuffle_r1)), _mm_shuffle_epi8(c, shuffle_r2));
+
+		__m128i luma_lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(blue, zero), weight_b),
+													  _mm_mullo_epi16(_mm_unpacklo_epi8(green, zero), weight_g)),
+										_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(red, zero), weight_r), rounding));
+		__m128i luma_hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(blue, zero), weight_b),
+													  _mm_mullo_epi16(_mm_unpackhi_epi8(green, zero), weight_g)),
+										_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(red, zero), weight_r), rounding));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(luma_lo, 8), _mm_srli_epi16(luma_hi, 8)));
+	}
+#endif
+
+	for (; i < num_pixels; i++)
+		dst[i] = (unsigned char)((src[3*i] * LUMA_WEIGHT_B + src[3*i+1] * LUMA_WEIGHT_G + src[3*i+2] * LUMA_WEIGHT_R + 128) >> 8);
+}
+
+
+// Luma of "num_pixels" YUYV pixels (every second byte)
+static void
+lumaFromYUYV(const unsigned char *src, unsigned char *dst, int num_pixels)
+{
+	int i = 0;
+
+#ifdef OPENCV_STEREO_CAMERA_SSE2
+	const __m128i mask_luma = _mm_set1_epi16(0x00FF);
+
+	for (; i + 16 <= num_pixels; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2*i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 2*i + 16));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_and_si128(a, mask_luma), _mm_and_si128(b, mask_luma)));
+	}
+#endif
+
+	for (; i < num_pixels; i++)
+		dst[i] = src[2*i];
+}
+
+
 OpenCVStereoCamera::~OpenCVStereoCamera()
 {
 	if(is_open)
 		closeCam();
+
+	// (deleted as soon as the last frame is released)
+	capture_pool->release();
 }
 
 
@@ -78,7 +167,7 @@ OpenCVStereoCamera::openCam()
 	for (int i=0; i<2; i++)
 	{
 		camera[i].set(CV_CAP_PROP_FRAME_WIDTH, frame_width);
-		camera[i].set(CV_CAP_PROP_FRAME_HEIGHT, frame_width);
+		camera[i].set(CV_CAP_PROP_FRAME_HEIGHT, frame_height);
 
 		camera[i].set(CV_CAP_PROP_FPS, camera_framerate);
 
@@ -86,11 +175,10 @@ OpenCVStereoCamera::openCam()
 		{
 			camera[i].set(CV_CAP_PROP_GAIN, camera_gain);
 			camera[i].set(CV_CAP_PROP_EXPOSURE, camera_exposure);
-	//		camera[i].set(CV_CAP_PROP_FOURCC, CV_FOURCC('I', 'Y', 'U', 'V'));
-	//		camera[i].set(CV_CAP_PROP_FORMAT, ); //Format of the Mat objects returned by retrieve() .
-	//		camera[i].set(CV_CAP_PROP_CONVERT_RGB, false); // Boolean flags indicating whether images should be converted to RGB.
 		}
 
+		negotiateCaptureFormat(i);
+
 		if (do_debugging)
 		{
 			std::cout << "camera[" << i << "].get(CV_CAP_PROP_POS_MSEC) = " << camera[i].get(CV_CAP_PROP_POS_MSEC) << std::endl
@@ -125,9 +213,116 @@ OpenCVStereoCamera::openCam()
 }
 
 
+void
+OpenCVStereoCamera::negotiateCaptureFormat(int idx)
+{
+	capture_format[idx] = CAPTURE_BGR;
+
+	if (do_grab_from_video_file)
+	{
+		// Mono codecs can be decoded without conversion to BGR (if supported by the backend)
+		int fourcc = (int)camera[idx].get(CV_CAP_PROP_FOURCC);
+		if (fourcc == CV_FOURCC('G', 'R', 'E', 'Y') || fourcc == CV_FOURCC('Y', '8', '0', '0') || fourcc == CV_FOURCC('Y', '8', ' ', ' '))
+		{
+			camera[idx].set(CV_CAP_PROP_CONVERT_RGB, 0);
+			capture_format[idx] = CAPTURE_GREY;
+		}
+	}
+	else
+	{
+		// V4L2 pixel format: the device has to confirm the format, only then the frames are not converted to BGR
+		// (compressed formats like MJPG have to be converted)
+		if (camera[idx].set(CV_CAP_PROP_FOURCC, CV_FOURCC('G', 'R', 'E', 'Y')) &&
+				(int)camera[idx].get(CV_CAP_PROP_FOURCC) == CV_FOURCC('G', 'R', 'E', 'Y'))
+			capture_format[idx] = CAPTURE_GREY;
+		else if (camera[idx].set(CV_CAP_PROP_FOURCC, CV_FOURCC('Y', 'U', 'Y', 'V')) &&
+				(int)camera[idx].get(CV_CAP_PROP_FOURCC) == CV_FOURCC('Y', 'U', 'Y', 'V'))
+			capture_format[idx] = CAPTURE_YUYV;
+
+		if (capture_format[idx] != CAPTURE_BGR)
+			camera[idx].set(CV_CAP_PROP_CONVERT_RGB, 0);
+	}
+
+	capture_width[idx] = (int)camera[idx].get(CV_CAP_PROP_FRAME_WIDTH);
+	capture_height[idx] = (int)camera[idx].get(CV_CAP_PROP_FRAME_HEIGHT);
+	if (capture_width[idx] <= 0 || capture_height[idx] <= 0)
+	{
+		capture_width[idx] = frame_width;
+		capture_height[idx] = frame_height;
+	}
+
+	if (do_debugging)
+		std::cout << "OpenCVStereoCamera: negotiateCaptureFormat() - camera[" << idx << "] "
+				  << (capture_format[idx] == CAPTURE_GREY ? "GREY" : (capture_format[idx] == CAPTURE_YUYV ? "YUYV" : "BGR"))
+				  << " " << capture_width[idx] << "x" << capture_height[idx] << std::endl;
+}
+
+
+bool
+OpenCVStereoCamera::extractLuma(const cv::Mat& frame, cv::Mat& image, int idx)
+{
+	int width = capture_width[idx], height = capture_height[idx];
+	CaptureFormat format = capture_format[idx];
+
+	// Without conversion, some backends deliver the raw buffer as one row
+	cv::Mat source = frame;
+	if (frame.type() == CV_8UC1 && frame.rows == 1 && frame.isContinuous())
+	{
+		if (frame.total() == (size_t)(width * height))
+			source = frame.reshape(1, height);
+		else if (frame.total() == (size_t)(2 * width * height))
+			source = frame.reshape(2, height);
+		else
+		{
+			std::cerr << "OpenCVStereoCamera: extractLuma() - unexpected frame size " << frame.total() << " (camera " << idx << ")" << std::endl;
+			return false;
+		}
+	}
+	else if (format == CAPTURE_YUYV && frame.type() == CV_8UC1 && frame.cols == 2 * width)
+		source = frame.reshape(2, frame.rows);
+
+	// Mono frame (new buffer per read) => used without copy
+	if (source.type() == CV_8UC1)
+	{
+		image = source;
+		return true;
+	}
+
+	if (image.rows != source.rows || image.cols != source.cols || image.type() != CV_8UC1)
+	{
+		if (source.rows == frame_height && source.cols == frame_width)
+			image = allocateImage();
+		else
+			image.create(source.rows, source.cols, CV_8UC1);
+	}
+
+	switch (source.type())
+	{
+		case CV_8UC2:
+			for (int y = 0; y < source.rows; y++)
+				lumaFromYUYV(source.ptr(y), image.ptr(y), source.cols);
+			break;
+		case CV_8UC3:
+			for (int y = 0; y < source.rows; y++)
+				lumaFromBGR(source.ptr(y), image.ptr(y), source.cols);
+			break;
+		case CV_8UC4:
+			cv::cvtColor(source, image, CV_BGRA2GRAY, 0);
+			break;
+		default:
+			std::cerr << "OpenCVStereoCamera: extractLuma() - unsupported frame type " << source.type() << " (camera " << idx << ")" << std::endl;
+			return false;
+	}
+
+	return true;
+}
+
+
 void
 OpenCVStereoCamera::closeCam()
 {
+	stopCam();
+
 	// Free cameras
 	if (camera[LEFT].isOpened())
 		camera[LEFT].release();
@@ -138,6 +333,90 @@ OpenCVStereoCamera::closeCam()
 }
 
 
+void
+OpenCVStereoCamera::startCam()
+{
+	if (!is_open)
+	{
+		std::cerr << "OpenCVStereoCamera: startCam() - camera NOT open" << std::endl;
+		return;
+	}
+
+	// Video files are read directly by grabFrame()
+	if (do_grab_from_video_file || is_capturing)
+		return;
+
+	if (do_debugging)
+		std::cout << "OpenCVStereoCamera: startCam()" << std::endl;
+
+	for (int i = 0; i < 2; i++)
+	{
+		captured_frame_number[i] = 0;
+		grabbed_frame_number[i] = 0;
+	}
+
+	std::vector<cv::Mat> dropped_frames[2];
+	synchronizer.clear(dropped_frames);
+	synchronizer.setTolerance((long long)sync_tolerance_us * 1000);
+	synchronizer.resetStatistics();
+
+	do_stop_capture = false;
+	for (int i = 0; i < 2; i++)
+		capture_thread[i] = boost::thread(boost::bind(&OpenCVStereoCamera::captureFrames, this, i));
+
+	is_capturing = true;
+}
+
+
+void
+OpenCVStereoCamera::stopCam()
+{
+	if (!is_capturing)
+		return;
+
+	if (do_debugging)
+		std::cout << "OpenCVStereoCamera: stopCam()" << std::endl;
+
+	do_stop_capture = true;
+	for (int i = 0; i < 2; i++)
+		capture_thread[i].join();
+
+	is_capturing = false;
+}
+
+
+void
+OpenCVStereoCamera::captureFrames(int idx)
+{
+	while (!do_stop_capture)
+	{
+		// Blocks until the camera delivers the next frame (new buffer per frame, as the last one may still be used)
+		cv::Mat buffer;
+		buffer.allocator = capture_pool;
+		if (!camera[idx].read(buffer))
+		{
+			boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+			continue;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(capture_mutex);
+			captured_frame[idx] = buffer;
+			captured_frame_number[idx]++;
+			captured_time[idx] = boost::posix_time::microsec_clock::universal_time();
+
+			if (synchronizer.isEnabled())
+			{
+				std::vector<cv::Mat> dropped_frames[2];
+				long long capture_time_ns = (captured_time[idx] - start_time_timestamp).total_microseconds() * 1000;
+				synchronizer.addFrame(idx, buffer, capture_time_ns, capture_time_ns, dropped_frames);
+			}
+		}
+		capture_condition.notify_all();
+	}
+}
+
+
 bool
 OpenCVStereoCamera::grabFrame(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, double timeout_seconds)
 {
@@ -147,62 +426,108 @@ OpenCVStereoCamera::grabFrame(cv::Mat &image_left, cv::Mat &image_right, long lo
 		return false;
 	}
 
-	// Compute timestamp
-	boost::posix_time::ptime end_time_timestamp = boost::posix_time::microsec_clock::universal_time();
-	boost::posix_time::time_duration time_diff_timestamp = end_time_timestamp - start_time_timestamp;
-	timestamp_us_ = time_diff_timestamp.total_microseconds();
+	cv::Mat frame_buffer[2];
+	frame_buffer[LEFT].allocator = capture_pool;
+	frame_buffer[RIGHT].allocator = capture_pool;
+	bool got_data[2];
+	got_data[0] = false; got_data[1] = false;
 
-	cv::Mat frame_buffer[2], buffer[2];
-	for (int i = 0; i<2; i++)
+	if (is_capturing)
 	{
-		frame_buffer[i] = createImage();
-		buffer[i] = createImage();
-	}
+		// Wait for a new frame of both capture threads
+		boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() +
+																boost::chrono::microseconds((long long)(timeout_seconds * 1000000.0));
 
-	bool got_data[2], empty_queue[2];
-	got_data[0] = false; got_data[1] = false; empty_queue[0] = false; empty_queue[1] = false;
+		boost::mutex::scoped_lock lock(capture_mutex);
+		if (synchronizer.isEnabled())
+		{
+			// Wait for the next pair of frames captured within +-sync_tolerance_us
+			std::vector<cv::Mat> dropped_frames[2];
+			long long timestamp_ns;
+			while (!synchronizer.popNewestPair(frame_buffer[LEFT], frame_buffer[RIGHT], timestamp_ns, dropped_frames))
+			{
+				if (capture_condition.wait_until(lock, deadline) == boost::cv_status::timeout)
+					break;
+			}
 
-	// Synchronize grabbing
-	while((timeout_seconds > 0.0) && !(got_data[0] && got_data[1]) && !empty_queue[0] && !empty_queue[1] )
-	{
-		for(int i = 0; i < 2; i++)
+			got_data[LEFT] = got_data[RIGHT] = !frame_buffer[LEFT].empty();
+			if (got_data[LEFT])
+				timestamp_us_ = timestamp_ns / 1000;
+		}
+		else
 		{
-			if (camera[i].read(buffer[i]))
+			while (captured_frame_number[LEFT] == grabbed_frame_number[LEFT] || captured_frame_number[RIGHT] == grabbed_frame_number[RIGHT])
 			{
-				frame_buffer[i] = buffer[i];
-				got_data[i] = true;
+				if (capture_condition.wait_until(lock, deadline) == boost::cv_status::timeout)
+					break;
 			}
-			else
-				empty_queue[i] = true;
+
+			for (int i = 0; i < 2; i++)
+				got_data[i] = (captured_frame_number[i] != grabbed_frame_number[i]);
+		}
+
+		if (got_data[LEFT] && got_data[RIGHT] && !synchronizer.isEnabled())
+		{
+			for (int i = 0; i < 2; i++)
+			{
+				frame_buffer[i] = captured_frame[i];
+				grabbed_frame_number[i] = captured_frame_number[i];
+			}
+
+			// Timestamp of the later frame
+			boost::posix_time::time_duration time_diff_timestamp = std::max(captured_time[LEFT], captured_time[RIGHT]) - start_time_timestamp;
+			timestamp_us_ = time_diff_timestamp.total_microseconds();
 		}
+	}
+	else
+	{
+		boost::posix_time::ptime end_time_timestamp = boost::posix_time::microsec_clock::universal_time();
+		boost::posix_time::time_duration time_diff_timestamp = end_time_timestamp - start_time_timestamp;
+		timestamp_us_ = time_diff_timestamp.total_microseconds();
 
-		boost::this_thread::sleep(boost::posix_time::microseconds(100));
-		timeout_seconds -= 0.0001f;
+		// Blocking reads (video files or cameras without capture threads)
+		for (int i = 0; i < 2; i++)
+			got_data[i] = camera[i].read(frame_buffer[i]);
 	}
 
-	// Only if new frame of BOTH cameras successful, use it as new stereo frame (else old one used)
-	if ((got_data[0] && got_data[1]))
+	// Only if new frame of BOTH cameras successful, its luma is the new stereo frame (else old one used)
+	if (got_data[0] && got_data[1])
 	{
-		stereo_frame[LEFT] = frame_buffer[LEFT];
-		stereo_frame[RIGHT] = frame_buffer[RIGHT];
+		if (extractLuma(frame_buffer[LEFT], image_left, LEFT) && extractLuma(frame_buffer[RIGHT], image_right, RIGHT))
+		{
+			stereo_frame[LEFT] = image_left;
+			stereo_frame[RIGHT] = image_right;
+		}
+		else
+			got_data[0] = got_data[1] = false;
 	}
 
-	// Convert CV_32FC1 camera output to 8UC1
-	cv::cvtColor(stereo_frame[LEFT], image_left, CV_RGB2GRAY, 0);
-	cv::cvtColor(stereo_frame[RIGHT], image_right, CV_RGB2GRAY, 0);
+	if (!got_data[0] || !got_data[1])
+	{
+		image_left = stereo_frame[LEFT];
+		image_right = stereo_frame[RIGHT];
+	}
 
-	if (do_grab_from_video_file && empty_queue[0] && empty_queue[1])
+	if (do_grab_from_video_file && !got_data[0] && !got_data[1])
 	{
 		if (do_debugging)
-			std::cout << "OpenCVStereoCamera: grabFrame() - end of video" << timeout_seconds << std::endl;
+			std::cout << "OpenCVStereoCamera: grabFrame() - end of video" << std::endl;
 		return false;
 	}
 
-	if(timeout_seconds > 0)
+	if (got_data[0] && got_data[1])
 		return true;
 
 	std::cerr << "OpenCVStereoCamera: grabFrame() timeout" << std::endl;
 	return false;
 }
 
-}
\ No newline at end of file
+
+StereoSyncStatistics
+OpenCVStereoCamera::getSyncStatistics()
+{
+	boost::mutex::scoped_lock lock(capture_mutex);
+	return synchronizer.getStatistics();
+}
+
+}
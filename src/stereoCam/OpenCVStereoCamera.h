@@ -5,6 +5,20 @@
 //				 Besides OpenCV kompatible cameras, also video files can be
 //				 used as input (-> use different constructor with video file
 //				 e.g. "video_left.avi" and "video_right.avi" recorded before)
+//				 - Cameras: one capture thread per camera (started by
+//				   startCam()) reads the frames, grabFrame() waits for the
+//				   next frame of both cameras (condition variable, timeout
+//				   on a monotonic clock)
+//				 - Stereo synchronization (sync_tolerance_us > 0, cameras only):
+//				   the frames are paired by their capture times
+//				 - Video files: read directly by grabFrame() (no frame skipped)
+//				 - The frames read from the cameras/video files (before the
+//				   conversion to grey) are taken from a FramePool
+//				 - Grey capture: mono (GREY/Y8), else YUYV frames are
+//				   requested from the cameras (V4L2 pixel format), the luma
+//				   plane is taken without colour conversion (mono frames
+//				   without copy). Else (BGR frames) the luma is computed by
+//				   a SIMD kernel. Mono video files are decoded to grey.
 // Licence	   : see LICENCE.txt
 //============================================================================
 
@@ -13,6 +27,8 @@
 
 #include "StereoCamera.h"
 
+#include <boost/atomic.hpp>
+
 namespace tiy
 {
 
@@ -24,12 +40,46 @@ private:
 	// Stereo cameras or video grabber
 	cv::VideoCapture camera[2];
 
+	// Capture threads (cameras only) and their last captured frame, its number and capture time
+	boost::thread capture_thread[2];
+	boost::atomic<bool> do_stop_capture;
+	boost::mutex capture_mutex;
+	boost::condition_variable capture_condition;
+	cv::Mat captured_frame[2];
+	long long captured_frame_number[2], grabbed_frame_number[2];
+	boost::posix_time::ptime captured_time[2];
+
+	// Pairs the captured frames by their capture times (if sync_tolerance_us > 0)
+	StereoSynchronizer<cv::Mat> synchronizer;
+
+	// Buffers of the frames read from the cameras/video files (captured frames, synchronizer rings, frames being read)
+	FramePool *capture_pool;
+
+	// Pixel format of the frames read from the cameras/video files (mono and YUYV without conversion to BGR)
+	enum CaptureFormat { CAPTURE_BGR, CAPTURE_GREY, CAPTURE_YUYV };
+	CaptureFormat capture_format[2];
+	int capture_width[2], capture_height[2];
+
+private:
+
+	// Thread function: read the frames of camera "idx" as soon as available
+	void captureFrames(int idx);
+
+	// Request mono (GREY), else YUYV frames from camera/video file "idx" (else BGR frames)
+	void negotiateCaptureFormat(int idx);
+
+	// Luma plane of a frame read from camera/video file "idx" as grey image (mono frames without copy, else into
+	// "image" if it has the frame size)
+	bool extractLuma(const cv::Mat& frame, cv::Mat& image, int idx);
+
 public:
 
 	OpenCVStereoCamera(bool& do_debugging_, std::string& camera_id_left, std::string& camera_id_right,
 						int& frame_width_, int& frame_height_, int& camera_exposure_, int& camera_gain_, int& camera_framerate_)
 		: StereoCamera(do_debugging_, camera_id_left, camera_id_right,
-					frame_width_, frame_height_, camera_exposure_, camera_gain_, camera_framerate_) {};
+					frame_width_, frame_height_, camera_exposure_, camera_gain_, camera_framerate_),
+		  do_stop_capture(false),
+		  capture_pool(new FramePool(FRAME_POOL_CAPACITY)) {};
 
 	// Constructor for video files as stereo input source (-> initialize parameters)
 	OpenCVStereoCamera(bool& do_debugging_, std::string& camera_id_left, std::string& camera_id_right,
@@ -37,18 +87,22 @@ public:
 							std::string& video_file_left, std::string& video_file_right)
 		: StereoCamera(do_debugging_, camera_id_left, camera_id_right,
 						frame_width_, frame_height_, camera_exposure_, camera_gain_, camera_framerate_,
-						video_file_left, video_file_right) {};
+						video_file_left, video_file_right),
+		  do_stop_capture(false),
+		  capture_pool(new FramePool(FRAME_POOL_CAPACITY)) {};
 
 	virtual ~OpenCVStereoCamera();
 
 	virtual bool openCam();
 	virtual void closeCam();
 
-	// Not used here
-	virtual void startCam() {};
-	virtual void stopCam() {};
+	// Start/stop the capture threads (cameras only, without grabFrame() reads directly)
+	virtual void startCam();
+	virtual void stopCam();
 
 	virtual bool grabFrame(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, double timeout_seconds=1.0f);
+
+	virtual StereoSyncStatistics getSyncStatistics();
 };
 
 }
@@ -0,0 +1,260 @@
+//============================================================================
+// Name        : RawFileStereoCamera.cpp
+// Author      : Andreas Pflaum, Andre Gaschler
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "RawFileStereoCamera.h"
+
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace tiy
+{
+
+RawFileStereoCamera::RawFileStereoCamera(bool& do_debugging_, std::string& camera_id_left, std::string& camera_id_right,
+					int& frame_width_, int& frame_height_, int& camera_exposure_, int& camera_gain_, int& camera_framerate_,
+					std::string& raw_src_file_, bool do_pace_real_time_)
+	: StereoCamera(do_debugging_, camera_id_left, camera_id_right,
+				frame_width_, frame_height_, camera_exposure_, camera_gain_, camera_framerate_),
+	  raw_src_file(raw_src_file_),
+	  do_pace_real_time(do_pace_real_time_),
+	  file_data(NULL),
+	  file_size(0),
+#ifdef WIN32
+	  file_handle(NULL),
+	  mapping_handle(NULL),
+#else
+	  file_descriptor(-1),
+#endif
+	  num_frames(0),
+	  frame_index(0),
+	  is_replay_started(false),
+	  replay_start_timestamp_us(0)
+{
+	do_grab_from_video_file = true;
+	video_src_file[LEFT] = raw_src_file;
+}
+
+
+RawFileStereoCamera::~RawFileStereoCamera()
+{
+	if(is_open)
+		closeCam();
+}
+
+
+bool
+RawFileStereoCamera::mapFile()
+{
+#ifdef WIN32
+	file_handle = CreateFileA(raw_src_file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		file_handle = NULL;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file_handle, &size) || size.QuadPart == 0)
+		return false;
+	file_size = (size_t)size.QuadPart;
+
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mapping_handle == NULL)
+		return false;
+
+	// Copy on write: the images can be written without changing the file
+	file_data = (unsigned char *)MapViewOfFile(mapping_handle, FILE_MAP_COPY, 0, 0, 0);
+	return (file_data != NULL);
+#else
+	file_descriptor = open(raw_src_file.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return false;
+
+	struct stat file_stat;
+	if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+		return false;
+	file_size = (size_t)file_stat.st_size;
+
+	// Copy on write: the images can be written without changing the file
+	void *data = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_descriptor, 0);
+	if (data == MAP_FAILED)
+		return false;
+	file_data = (unsigned char *)data;
+
+	madvise(file_data, file_size, MADV_SEQUENTIAL);
+	return true;
+#endif
+}
+
+
+void
+RawFileStereoCamera::unmapFile()
+{
+#ifdef WIN32
+	if (file_data != NULL)
+		UnmapViewOfFile(file_data);
+	if (mapping_handle != NULL)
+		CloseHandle(mapping_handle);
+	if (file_handle != NULL)
+		CloseHandle(file_handle);
+	mapping_handle = NULL;
+	file_handle = NULL;
+#else
+	if (file_data != NULL)
+		munmap(file_data, file_size);
+	if (file_descriptor >= 0)
+		close(file_descriptor);
+	file_descriptor = -1;
+#endif
+	file_data = NULL;
+	file_size = 0;
+}
+
+
+bool
+RawFileStereoCamera::openCam()
+{
+	if (!mapFile())
+	{
+		std::cerr << "RawFileStereoCamera: openCam() - could not open/map raw file \"" << raw_src_file << "\"" << std::endl;
+		unmapFile();
+		return false;
+	}
+
+	if (file_size >= sizeof(RawStereoFileHeader))
+		memcpy(&raw_header, file_data, sizeof(RawStereoFileHeader));
+	if (file_size < sizeof(RawStereoFileHeader) || !raw_header.isValid() || raw_header.header_size > file_size)
+	{
+		std::cerr << "RawFileStereoCamera: openCam() - \"" << raw_src_file << "\" is no raw stereo file (version " << RAW_STEREO_VERSION << ")" << std::endl;
+		unmapFile();
+		return false;
+	}
+
+	if (raw_header.mat_type != mat_type)
+	{
+		std::cerr << "RawFileStereoCamera: openCam() - unsupported image type " << raw_header.mat_type << " in \"" << raw_src_file << "\"" << std::endl;
+		unmapFile();
+		return false;
+	}
+
+	// The recorded frame size is used
+	if (raw_header.frame_width != frame_width || raw_header.frame_height != frame_height)
+		std::cerr << "RawFileStereoCamera: openCam() - frame size of the raw file " << raw_header.frame_width << "x" << raw_header.frame_height
+				  << " differs from the configured one " << frame_width << "x" << frame_height << std::endl;
+	frame_width = raw_header.frame_width;
+	frame_height = raw_header.frame_height;
+
+	// (an incomplete last frame is ignored)
+	num_frames = (long long)((file_size - raw_header.header_size) / raw_header.frame_record_size);
+	frame_index = 0;
+	is_replay_started = false;
+
+	if (do_debugging)
+		std::cout << "RawFileStereoCamera: openCam() - " << num_frames << " frames " << frame_width << "x" << frame_height << std::endl;
+
+	stereo_frame[LEFT] = createImage();
+	stereo_frame[RIGHT] = createImage();
+
+	is_open = true;
+
+	return true;
+}
+
+
+void
+RawFileStereoCamera::closeCam()
+{
+	// (the images wrapping the mapped file must not be used any more)
+	stereo_frame[LEFT].release();
+	stereo_frame[RIGHT].release();
+
+	unmapFile();
+
+	is_open = false;
+}
+
+
+void
+RawFileStereoCamera::startCam()
+{
+	is_replay_started = false;
+}
+
+
+bool
+RawFileStereoCamera::seekFrame(long long frame_index_)
+{
+	if (frame_index_ < 0 || frame_index_ >= num_frames)
+	{
+		std::cerr << "RawFileStereoCamera: seekFrame() - frame " << frame_index_ << " not in [0;" << num_frames << ")" << std::endl;
+		return false;
+	}
+
+	frame_index = frame_index_;
+	is_replay_started = false;
+
+	return true;
+}
+
+
+bool
+RawFileStereoCamera::grabFrame(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, double timeout_seconds)
+{
+	if (!is_open)
+	{
+		std::cerr << "RawFileStereoCamera: grabFrame() - camera NOT open" << std::endl;
+		return false;
+	}
+
+	if (frame_index >= num_frames)
+	{
+		if (do_debugging)
+			std::cout << "RawFileStereoCamera: grabFrame() - end of raw file" << std::endl;
+		image_left = stereo_frame[LEFT];
+		image_right = stereo_frame[RIGHT];
+		return false;
+	}
+
+	unsigned char *frame_record = file_data + raw_header.header_size + (size_t)frame_index * raw_header.frame_record_size;
+	frame_index++;
+
+	RawStereoFrameHeader frame_header;
+	memcpy(&frame_header, frame_record, sizeof(RawStereoFrameHeader));
+	timestamp_us_ = (long long int)frame_header.timestamp_us;
+
+	// Wait until the recorded time since the first replayed frame is over
+	if (do_pace_real_time)
+	{
+		if (!is_replay_started)
+		{
+			replay_start_time = boost::chrono::steady_clock::now();
+			replay_start_timestamp_us = timestamp_us_;
+			is_replay_started = true;
+		}
+		else
+			boost::this_thread::sleep_until(replay_start_time + boost::chrono::microseconds(timestamp_us_ - replay_start_timestamp_us));
+	}
+
+	// No copy: the images wrap the mapped planes
+	unsigned char *plane = frame_record + RAW_STEREO_FRAME_HEADER_SIZE;
+	for (int i = 0; i < 2; i++)
+	{
+		stereo_frame[i] = cv::Mat(frame_height, frame_width, mat_type, plane, raw_header.plane_step);
+		plane += raw_header.plane_size;
+	}
+
+	image_left = stereo_frame[LEFT];
+	image_right = stereo_frame[RIGHT];
+
+	return true;
+}
+
+}
@@ -0,0 +1,78 @@
+//============================================================================
+// Name        : RawFileStereoCamera.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Child class of StereoCamera (general description there)
+//				 Replays a raw stereo file recorded by
+//				 StereoCamera::startRawRecording() (see RawStereoFormat.h):
+//				 - The file is memory mapped, the grabbed images wrap the
+//				   mapped planes (no decoding, no copy; bit-exact)
+//				 - The timestamps are the recorded ones
+//				 - Optional real-time pacing: frames are grabbed at the
+//				   recorded time differences (else as fast as possible)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef RAW_FILE_STEREO_CAMERA_H_
+#define RAW_FILE_STEREO_CAMERA_H_
+
+#include "StereoCamera.h"
+
+
+namespace tiy
+{
+
+class RawFileStereoCamera : public StereoCamera
+{
+
+private:
+
+	std::string raw_src_file;
+	bool do_pace_real_time;
+
+	// Memory mapped file
+	unsigned char *file_data;
+	size_t file_size;
+#ifdef WIN32
+	void *file_handle, *mapping_handle;
+#else
+	int file_descriptor;
+#endif
+
+	RawStereoFileHeader raw_header;
+	long long num_frames, frame_index;
+
+	// Replay start (pacing)
+	bool is_replay_started;
+	boost::chrono::steady_clock::time_point replay_start_time;
+	long long replay_start_timestamp_us;
+
+private:
+
+	bool mapFile();
+	void unmapFile();
+
+public:
+
+	RawFileStereoCamera(bool& do_debugging_, std::string& camera_id_left, std::string& camera_id_right,
+						int& frame_width_, int& frame_height_, int& camera_exposure_, int& camera_gain_, int& camera_framerate_,
+						std::string& raw_src_file_, bool do_pace_real_time_);
+
+	virtual ~RawFileStereoCamera();
+
+	virtual bool openCam();
+	virtual void closeCam();
+
+	// Restart the pacing (the next frame is grabbed at once)
+	virtual void startCam();
+
+	// The images are valid until closeCam() (writing them does not change the file)
+	virtual bool grabFrame(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, double timeout_seconds=1.0f);
+
+	long long getNumFrames() const { return num_frames; };
+	// Continue the replay at frame "frame_index_"
+	bool seekFrame(long long frame_index_);
+};
+
+}
+
+#endif // RAW_FILE_STEREO_CAMERA_H_
@@ -0,0 +1,77 @@
+//============================================================================
+// Name        : RawStereoFormat.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Raw stereo recording format, written by
+//				 StereoCamera::startRawRecording() and replayed by
+//				 RawFileStereoCamera (bit-exact, no decoding):
+//				 - File header (padded to RAW_STEREO_HEADER_SIZE bytes)
+//				 - Frame records of fixed size, each: frame header
+//				   (padded to RAW_STEREO_FRAME_HEADER_SIZE bytes), left
+//				   plane, right plane (each padded to a multiple of
+//				   RAW_STEREO_PLANE_ALIGNMENT bytes)
+//				 - Native byte order (little endian on x86)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef RAW_STEREO_FORMAT_H_
+#define RAW_STEREO_FORMAT_H_
+
+#include <boost/cstdint.hpp>
+
+#include <cstring>
+
+#define RAW_STEREO_MAGIC "TIYRAWST"
+#define RAW_STEREO_VERSION 1
+#define RAW_STEREO_HEADER_SIZE 4096			// page size => the planes of a memory mapped file are aligned
+#define RAW_STEREO_FRAME_HEADER_SIZE 64
+#define RAW_STEREO_PLANE_ALIGNMENT 64
+
+
+namespace tiy
+{
+
+struct RawStereoFileHeader
+{
+	char magic[8];						// RAW_STEREO_MAGIC (without terminating zero)
+	boost::uint32_t version;			// RAW_STEREO_VERSION
+	boost::uint32_t header_size;		// bytes before the first frame record
+	boost::int32_t frame_width, frame_height;
+	boost::int32_t mat_type;			// OpenCV type of the planes (e.g. CV_8UC1)
+	boost::uint32_t plane_step;			// bytes per row of a plane
+	boost::uint64_t plane_size;			// bytes per plane (with padding)
+	boost::uint64_t frame_record_size;	// bytes per frame record (frame header, left and right plane)
+
+	RawStereoFileHeader()
+	{
+		memset(this, 0, sizeof(RawStereoFileHeader));
+		memcpy(magic, RAW_STEREO_MAGIC, sizeof(magic));
+		version = RAW_STEREO_VERSION;
+		header_size = RAW_STEREO_HEADER_SIZE;
+	};
+
+	// Sizes of a plane of "plane_step_" * "frame_height_" bytes
+	void setPlaneSize(boost::uint32_t plane_step_)
+	{
+		plane_step = plane_step_;
+		plane_size = ((boost::uint64_t)plane_step * frame_height + RAW_STEREO_PLANE_ALIGNMENT - 1) / RAW_STEREO_PLANE_ALIGNMENT * RAW_STEREO_PLANE_ALIGNMENT;
+		frame_record_size = RAW_STEREO_FRAME_HEADER_SIZE + 2 * plane_size;
+	};
+
+	bool isValid() const
+	{
+		return (memcmp(magic, RAW_STEREO_MAGIC, sizeof(magic)) == 0) && (version == RAW_STEREO_VERSION) &&
+				(header_size >= sizeof(RawStereoFileHeader)) && (frame_width > 0) && (frame_height > 0) &&
+				(plane_size >= (boost::uint64_t)plane_step * frame_height) && (frame_record_size == RAW_STEREO_FRAME_HEADER_SIZE + 2 * plane_size);
+	};
+};
+
+
+struct RawStereoFrameHeader
+{
+	boost::int64_t timestamp_us;		// timestamp of the grabbed frame (see StereoCamera::grabFrame())
+	boost::int64_t frame_number;		// number of the recorded frame (gaps: dropped frames)
+};
+
+}
+
+#endif // RAW_STEREO_FORMAT_H_
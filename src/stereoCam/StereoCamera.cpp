@@ -23,7 +23,14 @@ StereoCamera::StereoCamera(bool& do_debugging_, std::string& camera_id_left, std
 	y_shift(0),
 	camera_exposure(camera_exposure_),
 	camera_gain(camera_gain_),
-	camera_framerate(camera_framerate_)
+	camera_framerate(camera_framerate_),
+	sync_tolerance_us(0),
+	frame_pool(new FramePool(FRAME_POOL_CAPACITY)),
+	is_recording_mono(true),
+	raw_recorder(NULL),
+	do_stop_recording(false),
+	num_recorded_frames(0),
+	num_dropped_recording_frames(0)
 {
 	camera_id[LEFT] = camera_id_left;
 	camera_id[RIGHT] = camera_id_right;
@@ -47,7 +54,14 @@ StereoCamera::StereoCamera(bool& do_debugging_, std::string& camera_id_left, std
 	y_shift(0),
 	camera_exposure(camera_exposure_),
 	camera_gain(camera_gain_),
-	camera_framerate(camera_framerate_)
+	camera_framerate(camera_framerate_),
+	sync_tolerance_us(0),
+	frame_pool(new FramePool(FRAME_POOL_CAPACITY)),
+	is_recording_mono(true),
+	raw_recorder(NULL),
+	do_stop_recording(false),
+	num_recorded_frames(0),
+	num_dropped_recording_frames(0)
 {
 	camera_id[LEFT] = camera_id_left;
 	camera_id[RIGHT] = camera_id_right;
@@ -58,37 +72,183 @@ StereoCamera::StereoCamera(bool& do_debugging_, std::string& camera_id_left, std
 }
 
 
+StereoCamera::~StereoCamera()
+{
+	if (is_recording)
+		stopRecording();
+
+	// (deleted as soon as the last image is released)
+	frame_pool->release();
+}
+
+
 bool
 StereoCamera::startRecording(std::string& video_dst_file_left, std::string& video_dst_file_right)
 {
-	is_recording = true;
+	// (the recorder thread must not write while the recorder is opened)
+	stopRecorderThread();
+	if (video_recorder[LEFT].isOpened() || video_recorder[RIGHT].isOpened())
+	{
+		video_recorder[LEFT].release();
+		video_recorder[RIGHT].release();
+	}
+
+	std::string video_dst_file[2];
+	video_dst_file[LEFT] = video_dst_file_left;
+	video_dst_file[RIGHT] = video_dst_file_right;
 
-	video_frame[LEFT] = cv::Mat::zeros(frame_height, frame_width, CV_32FC1);
-	video_frame[RIGHT] = cv::Mat::zeros(frame_height, frame_width, CV_32FC1);
+	// Mono frames lossless (FFV1), else raw (Y800), else RGB (DIVX, if the backend can write no mono frames)
+	int mono_codecs[2] = { CV_FOURCC('F', 'F', 'V', '1'), CV_FOURCC('Y', '8', '0', '0') };
+	is_recording_mono = false;
+	for (int c = 0; c < 2 && !is_recording_mono; c++)
+	{
+		//								              		CODEC	  		FPS				SIZE					isColor
+		video_recorder[LEFT].open(video_dst_file[LEFT], mono_codecs[c], camera_framerate, cv::Size(frame_width, frame_height), false);
+		video_recorder[RIGHT].open(video_dst_file[RIGHT], mono_codecs[c], camera_framerate, cv::Size(frame_width, frame_height), false);
+		is_recording_mono = video_recorder[LEFT].isOpened() && video_recorder[RIGHT].isOpened();
+	}
 
-	//								              		MPEG-1	  					FPS				SIZE			isColor
-	video_recorder[LEFT].open(video_dst_file_left, CV_FOURCC('D', 'I', 'V', 'X'), camera_framerate, createImage().size(), true);
-	video_recorder[RIGHT].open(video_dst_file_right, CV_FOURCC('D', 'I', 'V', 'X'), camera_framerate, createImage().size(), true);
+	if (!is_recording_mono)
+	{
+		// Allocated once with the type of the converted frames (no reallocation by cv::cvtColor())
+		video_frame[LEFT] = cv::Mat::zeros(frame_height, frame_width, CV_8UC3);
+		video_frame[RIGHT] = cv::Mat::zeros(frame_height, frame_width, CV_8UC3);
+
+		video_recorder[LEFT].open(video_dst_file[LEFT], CV_FOURCC('D', 'I', 'V', 'X'), camera_framerate, cv::Size(frame_width, frame_height), true);
+		video_recorder[RIGHT].open(video_dst_file[RIGHT], CV_FOURCC('D', 'I', 'V', 'X'), camera_framerate, cv::Size(frame_width, frame_height), true);
+	}
 
 	if(!video_recorder[LEFT].isOpened() || !video_recorder[RIGHT].isOpened())
 	{
 		std::cerr << "StereoCamera: startRecording() - video recorder could not be opened" << std::endl;
+		video_recorder[LEFT].release();
+		video_recorder[RIGHT].release();
+		if (is_recording)
+			startRecorderThread();
 		return false;
 	}
 
+	if (do_debugging)
+		std::cout << "StereoCamera: startRecording() - " << (is_recording_mono ? "mono" : "RGB") << " video" << std::endl;
+
+	startRecorderThread();
+
 	return true;
 }
 
 
+bool
+StereoCamera::startRawRecording(std::string& raw_dst_file)
+{
+	// (the recorder thread must not write while the recorder is opened)
+	stopRecorderThread();
+	if (raw_recorder != NULL)
+	{
+		fclose(raw_recorder);
+		raw_recorder = NULL;
+	}
+
+	raw_recorder = fopen(raw_dst_file.c_str(), "wb");
+	if (raw_recorder == NULL)
+	{
+		std::cerr << "StereoCamera: startRawRecording() - could not open " << raw_dst_file << std::endl;
+		if (is_recording)
+			startRecorderThread();
+		return false;
+	}
+
+	// Large buffer => few write calls per frame
+	setvbuf(raw_recorder, NULL, _IOFBF, 1 << 20);
+
+	raw_header = RawStereoFileHeader();
+	raw_header.frame_width = frame_width;
+	raw_header.frame_height = frame_height;
+	raw_header.mat_type = mat_type;
+	raw_header.setPlaneSize((boost::uint32_t)(frame_width * CV_ELEM_SIZE(mat_type)));
+
+	std::vector<char> header_data(raw_header.header_size, 0);
+	memcpy(&header_data[0], &raw_header, sizeof(RawStereoFileHeader));
+	if (fwrite(&header_data[0], 1, header_data.size(), raw_recorder) != header_data.size())
+	{
+		std::cerr << "StereoCamera: startRawRecording() - could not write to " << raw_dst_file << std::endl;
+		fclose(raw_recorder);
+		raw_recorder = NULL;
+		if (is_recording)
+			startRecorderThread();
+		return false;
+	}
+
+	if (do_debugging)
+		std::cout << "StereoCamera: startRawRecording() - " << raw_dst_file << std::endl;
+
+	startRecorderThread();
+
+	return true;
+}
+
+
+void
+StereoCamera::startRecorderThread()
+{
+	if (!is_recording)
+	{
+		// Copies of the queued frames
+		frame_pool->reserve(frame_pool->getCapacity() + 2 * RECORDING_QUEUE_CAPACITY);
+
+		recording_queue.clear();
+		num_recorded_frames = 0;
+		num_dropped_recording_frames = 0;
+	}
+
+	do_stop_recording = false;
+	recorder_thread = boost::thread(boost::bind(&StereoCamera::writeRecordedFrames, this));
+
+	is_recording = true;
+}
+
+
+void
+StereoCamera::stopRecorderThread()
+{
+	if (!is_recording)
+		return;
+
+	// The recorder thread writes the queued frames before it ends
+	{
+		boost::mutex::scoped_lock lock(recording_mutex);
+		do_stop_recording = true;
+	}
+	recording_condition.notify_all();
+	recorder_thread.join();
+}
+
+
 void
 StereoCamera::stopRecording()
 {
+	if (!is_recording)
+		return;
+
+	stopRecorderThread();
+
+	video_recorder[LEFT].release();
+	video_recorder[RIGHT].release();
+
+	if (raw_recorder != NULL)
+	{
+		fclose(raw_recorder);
+		raw_recorder = NULL;
+	}
+
+	if (num_dropped_recording_frames > 0)
+		std::cerr << "StereoCamera: stopRecording() - " << num_dropped_recording_frames << " frames dropped (recording too slow)" << std::endl;
+
 	is_recording = false;
 }
 
 
 bool
-StereoCamera::recordFrame()
+StereoCamera::recordFrame(long long int timestamp_us_)
 {
 	if (!is_recording)
 	{
@@ -96,16 +256,111 @@ StereoCamera::recordFrame()
 		return false;
 	}
 
-	cv::cvtColor(stereo_frame[LEFT], video_frame[LEFT], CV_GRAY2RGB, 0);
-	cv::cvtColor(stereo_frame[RIGHT], video_frame[RIGHT], CV_GRAY2RGB, 0);
+	// Copy, as the grabbed images may be camera buffers or reused by the caller
+	RecordedFrame frame;
+	frame.timestamp_us = timestamp_us_;
+	frame.frame_number = num_recorded_frames++;
+	for (int i = 0; i < 2; i++)
+	{
+		frame.image[i] = allocateImage();
+		stereo_frame[i].copyTo(frame.image[i]);
+	}
+
+	{
+		boost::mutex::scoped_lock lock(recording_mutex);
 
-	video_recorder[LEFT] << video_frame[LEFT];
-	video_recorder[RIGHT] << video_frame[RIGHT];
+		// Drop the oldest frame, if the recorder thread cannot keep up
+		if (recording_queue.size() >= RECORDING_QUEUE_CAPACITY)
+		{
+			recording_queue.pop_front();
+			num_dropped_recording_frames++;
+		}
+		recording_queue.push_back(frame);
+	}
+	recording_condition.notify_one();
 
 	return true;
 }
 
 
+long long
+StereoCamera::getNumDroppedRecordingFrames()
+{
+	boost::mutex::scoped_lock lock(recording_mutex);
+	return num_dropped_recording_frames;
+}
+
+
+void
+StereoCamera::writeRecordedFrames()
+{
+	while (true)
+	{
+		RecordedFrame frame;
+		{
+			boost::mutex::scoped_lock lock(recording_mutex);
+			while (recording_queue.empty() && !do_stop_recording)
+				recording_condition.wait(lock);
+
+			// Stopped and all frames written
+			if (recording_queue.empty())
+				break;
+
+			frame = recording_queue.front();
+			recording_queue.pop_front();
+		}
+
+		writeRecordedFrame(frame);
+	}
+}
+
+
+void
+StereoCamera::writeRecordedFrame(RecordedFrame& frame)
+{
+	for (int i = 0; i < 2 && video_recorder[i].isOpened(); i++)
+	{
+		if (is_recording_mono)
+			video_recorder[i] << frame.image[i];
+		else
+		{
+			cv::cvtColor(frame.image[i], video_frame[i], CV_GRAY2RGB, 0);
+			video_recorder[i] << video_frame[i];
+		}
+	}
+
+	if (raw_recorder != NULL)
+	{
+		// Frame header, left and right plane (padded)
+		char frame_header[RAW_STEREO_FRAME_HEADER_SIZE];
+		memset(frame_header, 0, RAW_STEREO_FRAME_HEADER_SIZE);
+		RawStereoFrameHeader *header = (RawStereoFrameHeader *)frame_header;
+		header->timestamp_us = frame.timestamp_us;
+		header->frame_number = frame.frame_number;
+
+		static const char padding[RAW_STEREO_PLANE_ALIGNMENT] = { 0 };
+		size_t plane_data_size = (size_t)raw_header.plane_step * raw_header.frame_height;
+		size_t padding_size = (size_t)raw_header.plane_size - plane_data_size;
+
+		bool is_written = (fwrite(frame_header, 1, RAW_STEREO_FRAME_HEADER_SIZE, raw_recorder) == RAW_STEREO_FRAME_HEADER_SIZE);
+		for (int i = 0; i < 2 && is_written; i++)
+		{
+			// (pool images are continuous)
+			is_written = (frame.image[i].isContinuous() && frame.image[i].rows * frame.image[i].step == plane_data_size) &&
+							(fwrite(frame.image[i].data, 1, plane_data_size, raw_recorder) == plane_data_size) &&
+							(fwrite(padding, 1, padding_size, raw_recorder) == padding_size);
+		}
+
+		if (!is_written)
+		{
+			std::cerr << "StereoCamera: writeRecordedFrame() - raw frame could not be written, raw recording stopped" << std::endl;
+			fclose(raw_recorder);
+			raw_recorder = NULL;
+		}
+	}
+}
+
+
 void
 StereoCamera::showFrame()
 {
@@ -123,7 +378,26 @@ StereoCamera::showFrame()
 cv::Mat
 StereoCamera::createImage()
 {
-	return cv::Mat::zeros(frame_height, frame_width, mat_type);
+	cv::Mat image = allocateImage();
+	image.setTo(cv::Scalar(0));
+	return image;
+}
+
+
+cv::Mat
+StereoCamera::allocateImage()
+{
+	cv::Mat image;
+	image.allocator = frame_pool;
+	image.create(frame_height, frame_width, mat_type);
+	return image;
+}
+
+
+void
+StereoCamera::reserveImages(int num_images)
+{
+	frame_pool->reserve(num_images);
 }
 
 }
\ No newline at end of file
@@ -7,6 +7,21 @@
 //				 child classes BaslerGigEStereoCamera / OpenCVStereoCamera
 //				 - Recording the actual stereo frame to the two video files
 //				   has to be done manually at every frame by recordFrame()
+//				   (only queues a copy, a recorder thread writes the mono
+//				   frames losslessly; if the queue is full, the oldest
+//				   frame is dropped)
+//				 - Raw recording (startRawRecording()): both planes and the
+//				   timestamp of every frame uncompressed in one file (see
+//				   RawStereoFormat.h, replayed by RawFileStereoCamera)
+//				 - grabFrameShared(): zero-copy grabbing (if supported by the
+//				   camera), the images wrap the camera buffers as long as the
+//				   returned frame handle is held
+//				 - Stereo synchronization (setSyncTolerance()): the left and
+//				   right frames are paired by their (device) timestamps by a
+//				   StereoSynchronizer in the child classes
+//				 - The images are taken from a FramePool (pre-allocated
+//				   buffers, no allocations per frame), the pool is kept
+//				   until the last image is released
 // Licence	   : see LICENCE.txt
 //============================================================================
 
@@ -14,15 +29,25 @@
 #define STEREO_CAMERA_H_
 
 #include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/chrono.hpp>
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include <iostream>
+#include <deque>
+#include <cstdio>
+
+#include "StereoSynchronizer.h"
+#include "FramePool.h"
+#include "RawStereoFormat.h"
 
 #define MAT_TYPE CV_8UC1
 #define LEFT 0
 #define RIGHT 1
+#define FRAME_POOL_CAPACITY 16	// images of the frame size in the frame pool (see reserveImages())
+#define RECORDING_QUEUE_CAPACITY 32	// stereo frames waiting for the recorder thread
 
 
 namespace tiy
@@ -31,6 +56,11 @@ namespace tiy
 class StereoCamera
 {
 
+public:
+
+	// Reference counted handle of the camera buffers of a stereo frame grabbed by grabFrameShared()
+	typedef boost::shared_ptr<void> FrameHandle;
+
 protected:
 
 	// Configuration
@@ -43,20 +73,54 @@ protected:
 	std::string camera_id[2];
 	int frame_width, frame_height, x_shift, y_shift, camera_exposure, camera_gain, camera_framerate;
 
+	// Maximum time difference of the left and right frame of a stereo frame [us] (0: no synchronization)
+	int sync_tolerance_us;
+
 	// Actual grabbed stereo frame
 	cv::Mat stereo_frame[2];
 	int mat_type;
 
+	// Buffers of the images of createImage()/allocateImage()
+	FramePool *frame_pool;
+
 	// Video source files to read stereo video from
 	std::string video_src_file[2];
 
-	// Video recorder
+	// Video recorder (mono frames, or RGB if the codecs support no mono) and its thread
 	cv::VideoWriter video_recorder[2];
 	cv::Mat video_frame[2];
+	bool is_recording_mono;
+	boost::thread recorder_thread;
+
+	// Raw recorder (see RawStereoFormat.h)
+	FILE *raw_recorder;
+	RawStereoFileHeader raw_header;
+
+	// Stereo frames waiting for the recorder thread (copies) and number of frames dropped as the queue was full
+	struct RecordedFrame
+	{
+		cv::Mat image[2];
+		long long timestamp_us, frame_number;
+	};
+	std::deque<RecordedFrame> recording_queue;
+	boost::mutex recording_mutex;
+	boost::condition_variable recording_condition;
+	bool do_stop_recording;
+	long long num_recorded_frames, num_dropped_recording_frames;
 
 	// Timestamp and time measure
 	boost::posix_time::ptime start_time_timestamp;
 
+private:
+
+	// Thread function: write the queued frames until stopRecording()
+	void writeRecordedFrames();
+	void writeRecordedFrame(RecordedFrame& frame);
+
+	// Start the recorder thread (if not running) / stop it after the queued frames are written
+	void startRecorderThread();
+	void stopRecorderThread();
+
 public:
 
 	// Constructor for real cameras as stereo input source (-> initialize parameters)
@@ -68,13 +132,19 @@ public:
 					int& frame_width_, int& frame_height_, int& camera_exposure_, int& camera_gain_, int& camera_framerate_,
 						std::string& video_file_left, std::string& video_file_right);
 
-	virtual ~StereoCamera() {};
+	virtual ~StereoCamera();
 
 	// Initialize and open stereo video recorder (to actually record a frame, recordFrame() need to be called)
 	bool startRecording(std::string& video_dst_file_left, std::string& video_dst_file_right);
+	// Same for a raw stereo file (uncompressed frames with timestamps, also together with the video recorder)
+	bool startRawRecording(std::string& raw_dst_file);
+	// Write the queued frames and close the video/raw files
 	void stopRecording();
-	// Record the actual stereo FRAME to the video file (usually called every time after grabFrame())
-	bool recordFrame();
+	// Record the actual stereo FRAME with its timestamp [us] to the video/raw files (usually called every time
+	// after grabFrame()), does not block: a copy is queued for the recorder thread
+	bool recordFrame(long long int timestamp_us_ = 0);
+	// Number of frames dropped since startRecording(), as the recorder thread could not keep up
+	long long getNumDroppedRecordingFrames();
 
 	// Open and configure cameras/video files
 	virtual bool openCam() = 0;
@@ -87,11 +157,32 @@ public:
 	// Grab a new synchronized stereo frame with timestamp [us]
 	virtual bool grabFrame(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, double timeout_seconds=1.0f) = 0;
 
+	// Grab a new synchronized stereo frame without copying (if supported, e.g. by BaslerGigEStereoCamera): the images wrap
+	// the camera buffers, which are given back to the camera when the last copy of "frame_handle" is released
+	// (the images must not be used any more then). Default: grabFrame() with an empty frame_handle.
+	virtual bool grabFrameShared(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, FrameHandle& frame_handle, double timeout_seconds=1.0f)
+	{
+		frame_handle.reset();
+		return grabFrame(image_left, image_right, timestamp_us_, timeout_seconds);
+	};
+
+	// Pair the left and right frames by their timestamps within +-sync_tolerance_us_ (0: off, the newest frames
+	// are paired). Has to be set before openCam().
+	void setSyncTolerance(int sync_tolerance_us_) { sync_tolerance_us = sync_tolerance_us_; };
+	int getSyncTolerance() const { return sync_tolerance_us; };
+
+	// Statistics of the stereo synchronization (empty if not supported/enabled)
+	virtual StereoSyncStatistics getSyncStatistics() { return StereoSyncStatistics(); };
+
 	// Display the actual stereo frame (one window per side) with cv::imshow (=> cv::waitKey() is needed afterwards!)
 	void showFrame();
 
-	// Create a cv::Mat with the size and type of the camera frames
+	// Create a cv::Mat with the size and type of the camera frames (zeros), from the frame pool
 	cv::Mat createImage();
+	// Same without initialization (for images which are overwritten completely)
+	cv::Mat allocateImage();
+	// Increase the capacity of the frame pool to at least "num_images" (images beyond it are allocated on the heap)
+	void reserveImages(int num_images);
 };
 
 }
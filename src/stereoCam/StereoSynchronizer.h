@@ -0,0 +1,219 @@
+//============================================================================
+// Name        : StereoSynchronizer.h
+// Author      : Andreas Pflaum, Andre Gaschler
+// Description : Pairs the frames of the left and right camera by their
+//				 timestamps (used by the StereoCamera child classes):
+//				 - A small ring of frames per camera, ordered by timestamp
+//				 - Device timestamps (own clock per camera) are mapped to
+//				   the host clock by the minimum arrival delay
+//				   (host time - device time) of the last frames
+//				 - Frames of both cameras within +-tolerance are a pair,
+//				   frames without partner (orphans) are dropped
+//				 - Statistics of the pairs (skew) and dropped frames
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef STEREO_SYNCHRONIZER_H_
+#define STEREO_SYNCHRONIZER_H_
+
+#include <deque>
+#include <vector>
+#include <iostream>
+
+#ifndef LEFT
+#define LEFT 0
+#define RIGHT 1
+#endif
+
+// Frames of the clock offset estimation window
+#define SYNC_CLOCK_OFFSET_WINDOW 256
+
+
+namespace tiy
+{
+
+struct StereoSyncStatistics
+{
+	long long num_pairs;
+	long long num_dropped[2];
+	long long sum_abs_skew_ns, max_abs_skew_ns;
+
+	StereoSyncStatistics() : num_pairs(0), sum_abs_skew_ns(0), max_abs_skew_ns(0)
+	{
+		num_dropped[LEFT] = 0;
+		num_dropped[RIGHT] = 0;
+	};
+
+	// Mean absolute time difference of the paired frames [ns]
+	double getMeanSkew() const { return num_pairs ? (double)sum_abs_skew_ns / num_pairs : 0.0; };
+
+	void print(std::ostream& output) const
+	{
+		output << "Stereo sync: " << num_pairs << " pairs, skew mean " << getMeanSkew() / 1000.0
+			   << " us, max " << max_abs_skew_ns / 1000.0 << " us, dropped frames left "
+			   << num_dropped[LEFT] << ", right " << num_dropped[RIGHT] << std::endl;
+	};
+};
+
+
+// "Frame" is the payload of a camera frame (e.g. ArvBuffer* or cv::Mat). Frames which are
+// dropped are handed back to the caller per camera (dropped[LEFT], dropped[RIGHT]), e.g. to give
+// the buffers back to the camera.
+// Not thread-safe, the caller has to lock.
+template <typename Frame>
+class StereoSynchronizer
+{
+
+private:
+
+	struct Entry
+	{
+		Frame frame;
+		long long timestamp_ns; // host clock
+	};
+
+	std::deque<Entry> ring[2];
+	int ring_size;
+	long long tolerance_ns;
+
+	// Estimation of the offset between the device clocks and the host clock
+	bool has_clock_offset[2];
+	long long clock_offset_ns[2], window_clock_offset_ns[2];
+	int num_window_frames[2];
+
+	StereoSyncStatistics statistics;
+
+private:
+
+	void dropFront(int idx, std::vector<Frame> dropped[2])
+	{
+		dropped[idx].push_back(ring[idx].front().frame);
+		ring[idx].pop_front();
+		statistics.num_dropped[idx]++;
+	};
+
+public:
+
+	StereoSynchronizer(long long tolerance_ns_ = 0, int ring_size_ = 4) : ring_size(ring_size_), tolerance_ns(tolerance_ns_)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			has_clock_offset[i] = false;
+			clock_offset_ns[i] = 0;
+			window_clock_offset_ns[i] = 0;
+			num_window_frames[i] = 0;
+		}
+	};
+
+	// Maximum time difference of the frames of a pair [ns] (0: synchronization off)
+	void setTolerance(long long tolerance_ns_) { tolerance_ns = tolerance_ns_; };
+	long long getTolerance() const { return tolerance_ns; };
+	bool isEnabled() const { return tolerance_ns > 0; };
+
+	// Add a frame of camera "idx" with its device timestamp and its arrival time on the host (for cameras
+	// without own clock, both are the same). If the ring is full, the oldest frame is dropped.
+	void addFrame(int idx, const Frame& frame, long long device_timestamp_ns, long long host_timestamp_ns, std::vector<Frame> dropped[2])
+	{
+		// The minimum delay is the transfer without any queuing (the window follows a drift of the clocks)
+		long long delay_ns = host_timestamp_ns - device_timestamp_ns;
+		if (!has_clock_offset[idx] || delay_ns < clock_offset_ns[idx])
+		{
+			clock_offset_ns[idx] = delay_ns;
+			has_clock_offset[idx] = true;
+		}
+		if (num_window_frames[idx] == 0 || delay_ns < window_clock_offset_ns[idx])
+			window_clock_offset_ns[idx] = delay_ns;
+		if (++num_window_frames[idx] >= SYNC_CLOCK_OFFSET_WINDOW)
+		{
+			clock_offset_ns[idx] = window_clock_offset_ns[idx];
+			num_window_frames[idx] = 0;
+		}
+
+		Entry entry;
+		entry.frame = frame;
+		entry.timestamp_ns = device_timestamp_ns + clock_offset_ns[idx];
+		ring[idx].push_back(entry);
+
+		while ((int)ring[idx].size() > ring_size)
+			dropFront(idx, dropped);
+	};
+
+	// Take the newest pair (frames within +-tolerance) with its (left, host clock) timestamp. Older frames, also
+	// of older pairs, are dropped. Returns false if there is no pair (yet).
+	bool popNewestPair(Frame& frame_left, Frame& frame_right, long long& timestamp_ns, std::vector<Frame> dropped[2])
+	{
+		bool found_pair = false;
+		long long skew_ns = 0;
+
+		while (!ring[LEFT].empty() && !ring[RIGHT].empty())
+		{
+			long long diff_ns = ring[LEFT].front().timestamp_ns - ring[RIGHT].front().timestamp_ns;
+
+			if (diff_ns < -tolerance_ns)
+				dropFront(LEFT, dropped);		// too old for any following right frame
+			else if (diff_ns > tolerance_ns)
+				dropFront(RIGHT, dropped);
+			else
+			{
+				// Pair found, a newer one replaces it
+				if (found_pair)
+				{
+					dropped[LEFT].push_back(frame_left);
+					dropped[RIGHT].push_back(frame_right);
+					statistics.num_dropped[LEFT]++;
+					statistics.num_dropped[RIGHT]++;
+				}
+
+				frame_left = ring[LEFT].front().frame;
+				frame_right = ring[RIGHT].front().frame;
+				timestamp_ns = ring[LEFT].front().timestamp_ns;
+				skew_ns = diff_ns < 0 ? -diff_ns : diff_ns;
+				found_pair = true;
+
+				ring[LEFT].pop_front();
+				ring[RIGHT].pop_front();
+			}
+		}
+
+		if (found_pair)
+		{
+			statistics.num_pairs++;
+			statistics.sum_abs_skew_ns += skew_ns;
+			if (skew_ns > statistics.max_abs_skew_ns)
+				statistics.max_abs_skew_ns = skew_ns;
+		}
+
+		return found_pair;
+	};
+
+	// Camera of which a new frame is needed to complete the next pair (empty ring or older newest frame)
+	int getLaggingCamera() const
+	{
+		if (ring[LEFT].empty())
+			return LEFT;
+		if (ring[RIGHT].empty())
+			return RIGHT;
+		return (ring[LEFT].back().timestamp_ns <= ring[RIGHT].back().timestamp_ns) ? LEFT : RIGHT;
+	};
+
+	// Remove all frames (dropped, but not counted) and reset the clock offsets
+	void clear(std::vector<Frame> dropped[2])
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			for (unsigned int j = 0; j < ring[i].size(); j++)
+				dropped[i].push_back(ring[i][j].frame);
+			ring[i].clear();
+
+			has_clock_offset[i] = false;
+			num_window_frames[i] = 0;
+		}
+	};
+
+	const StereoSyncStatistics& getStatistics() const { return statistics; };
+	void resetStatistics() { statistics = StereoSyncStatistics(); };
+};
+
+}
+
+#endif // STEREO_SYNCHRONIZER_H_
@@ -35,6 +35,9 @@ BaslerGigEStereoCamera::openCam()
 		}
 	}
 
+	synchronizer.setTolerance((long long)sync_tolerance_us * 1000);
+	synchronizer.resetStatistics();
+
 	g_thread_init(NULL);
 	g_type_init();
 	
@@ -89,7 +92,7 @@ BaslerGigEStereoCamera::openCam()
 				    	"packet-resend", ARV_GV_STREAM_PACKET_RESEND_NEVER,
 								    	NULL);
 
-		for(int j = 0; j < STREAMBUFFERSIZE; j++)
+		for(int j = 0; j < STREAMBUFFERSIZE + SHAREDBUFFERSIZE; j++)
 			arv_stream_push_buffer(stream[i], arv_buffer_new(payload, NULL));
 
 		arv_camera_set_acquisition_mode(camera[i], ARV_ACQUISITION_MODE_CONTINUOUS);
@@ -125,6 +128,13 @@ BaslerGigEStereoCamera::closeCam()
 
 	stopCam();
 
+	// Buffers of frames still held outside keep a reference of their stream
+	stereo_frame_handle.reset();
+
+	std::vector<ArvBuffer*> dropped_buffers[2];
+	synchronizer.clear(dropped_buffers);
+	pushBackDroppedBuffers(dropped_buffers);
+
 	// Free cameras and camera streams
 	for (int i=0; i<2; i++)
 	{
@@ -189,61 +199,254 @@ BaslerGigEStereoCamera::grabFrame(cv::Mat &image_left, cv::Mat &image_right, lon
 		return false;
 	}
 
-	boost::posix_time::ptime end_time_timestamp = boost::posix_time::microsec_clock::universal_time();
-	boost::posix_time::time_duration time_diff_timestamp = end_time_timestamp - start_time_timestamp;
-	timestamp_us_ = time_diff_timestamp.total_microseconds();
+	ArvBuffer *frame_buffer[2];
+	bool got_data;
+	if (synchronizer.isEnabled())
+		got_data = popSynchronizedBuffers(frame_buffer, timestamp_us_, timeout_seconds);
+	else
+		got_data = popBuffers(frame_buffer, timestamp_us_, timeout_seconds);
 
-	ArvBuffer *buffer[2];
+	if (got_data)
+	{
+		for(int i = 0; i < 2; i++)
+		{
+			stereo_frame[i].release();
+			stereo_frame[i] = allocateImage();
+			memcpy(stereo_frame[i].data, (unsigned char*) frame_buffer[i]->data, stereo_frame[i].rows * stereo_frame[i].step);
+			arv_stream_push_buffer(stream[i], frame_buffer[i]);
+		}
+		stereo_frame_handle.reset();
+	}
 
-	cv::Mat frame_buffer[2];
-	frame_buffer[LEFT] = createImage();
-	frame_buffer[RIGHT] = createImage();
+	// (else old stereo frame used)
+	image_left = stereo_frame[LEFT];
+	image_right = stereo_frame[RIGHT];
+
+	if(got_data)
+		return true;
 
-	bool got_data[2], empty_queue[2];
-	got_data[0] = false; got_data[1] = false; empty_queue[0] = false; empty_queue[1] = false;
+	std::cerr << "BaslerGigEStereoCamera: grabFrame() timeout" << std::endl;
+	return false;
+}
 
-	// Synchronize grabbing within
-	while((timeout_seconds > 0.0) && !(got_data[0] && got_data[1]) && !empty_queue[0] && !empty_queue[1] )
+
+bool
+BaslerGigEStereoCamera::grabFrameShared(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, FrameHandle& frame_handle, double timeout_seconds)
+{
+	if (!is_open)
+	{
+		std::cerr << "BaslerGigEStereoCamera: grabFrameShared() - camera NOT open" << std::endl;
+		return false;
+	}
+
+	ArvBuffer *frame_buffer[2];
+	bool got_data;
+	if (synchronizer.isEnabled())
+		got_data = popSynchronizedBuffers(frame_buffer, timestamp_us_, timeout_seconds);
+	else
+		got_data = popBuffers(frame_buffer, timestamp_us_, timeout_seconds);
+
+	// The images wrap the buffers, which are kept until the frame handle is released
+	if (got_data)
 	{
+		SharedBuffers *shared_buffers = new SharedBuffers;
 		for(int i = 0; i < 2; i++)
 		{
-			buffer[i] = arv_stream_try_pop_buffer(stream[i]);
-			if (buffer[i] != NULL)
+			shared_buffers->stream[i] = (ArvStream *)g_object_ref(stream[i]);
+			shared_buffers->buffer[i] = frame_buffer[i];
+			stereo_frame[i] = cv::Mat(frame_height, frame_width, mat_type, frame_buffer[i]->data);
+		}
+		stereo_frame_handle = FrameHandle(shared_buffers, &BaslerGigEStereoCamera::pushBackBuffers);
+	}
+
+	// (else old stereo frame used)
+	image_left = stereo_frame[LEFT];
+	image_right = stereo_frame[RIGHT];
+	frame_handle = stereo_frame_handle;
+
+	if(got_data)
+		return true;
+
+	std::cerr << "BaslerGigEStereoCamera: grabFrameShared() timeout" << std::endl;
+	return false;
+}
+
+
+bool
+BaslerGigEStereoCamera::isValidBuffer(ArvBuffer *buffer)
+{
+	return (buffer->status == ARV_BUFFER_STATUS_SUCCESS) && (buffer->size >= (size_t)(frame_width * frame_height));
+}
+
+
+bool
+BaslerGigEStereoCamera::popBuffers(ArvBuffer *frame_buffer[2], long long int& timestamp_us_, double timeout_seconds)
+{
+	boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() +
+															boost::chrono::microseconds((long long)(timeout_seconds * 1000000.0));
+
+	frame_buffer[LEFT] = NULL;
+	frame_buffer[RIGHT] = NULL;
+
+	// Block until a valid buffer of each camera arrives (or the timeout is over)
+	for(int i = 0; i < 2; i++)
+	{
+		while (frame_buffer[i] == NULL)
+		{
+			long long remaining_us = boost::chrono::duration_cast<boost::chrono::microseconds>(deadline - boost::chrono::steady_clock::now()).count();
+			if (remaining_us <= 0)
+				break;
+
+			ArvBuffer *buffer = arv_stream_timeout_pop_buffer(stream[i], (guint64)remaining_us);
+			if (buffer == NULL)
+				break;
+
+			if (do_debugging)
+				debugBuffer(buffer, i);
+
+			if (isValidBuffer(buffer))
+				frame_buffer[i] = buffer;
+			else
+				arv_stream_push_buffer(stream[i], buffer);
+		}
+	}
+
+	if (frame_buffer[LEFT] == NULL || frame_buffer[RIGHT] == NULL)
+	{
+		for(int i = 0; i < 2; i++)
+			if (frame_buffer[i] != NULL)
+				arv_stream_push_buffer(stream[i], frame_buffer[i]);
+		return false;
+	}
+
+	// Newer buffers already waiting => take the newest ones (lowest latency)
+	for(int i = 0; i < 2; i++)
+	{
+		ArvBuffer *buffer;
+		while ((buffer = arv_stream_try_pop_buffer(stream[i])) != NULL)
+		{
+			if (do_debugging)
+				debugBuffer(buffer, i);
+
+			if (isValidBuffer(buffer))
 			{
-				if(buffer[i]->status == ARV_BUFFER_STATUS_SUCCESS)
-				{
-					memcpy(frame_buffer[i].data, (unsigned char*) buffer[i]->data, frame_buffer[i].rows * frame_buffer[i].step);
-					got_data[i] = true;
-				}
+				arv_stream_push_buffer(stream[i], frame_buffer[i]);
+				frame_buffer[i] = buffer;
+			}
+			else
+				arv_stream_push_buffer(stream[i], buffer);
+		}
+	}
 
+	// Timestamp on arrival of the frames
+	timestamp_us_ = getHostTimestampNs() / 1000;
+
+	return true;
+}
+
+
+bool
+BaslerGigEStereoCamera::popSynchronizedBuffers(ArvBuffer *frame_buffer[2], long long int& timestamp_us_, double timeout_seconds)
+{
+	boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() +
+															boost::chrono::microseconds((long long)(timeout_seconds * 1000000.0));
+
+	frame_buffer[LEFT] = NULL;
+	frame_buffer[RIGHT] = NULL;
+
+	std::vector<ArvBuffer*> dropped_buffers[2];
+	bool got_pair = false;
+
+	while (true)
+	{
+		// Add all waiting buffers to the rings (buffers which are not waited for are also taken, else
+		// their device timestamps are not known)
+		for(int i = 0; i < 2; i++)
+		{
+			ArvBuffer *buffer;
+			while ((buffer = arv_stream_try_pop_buffer(stream[i])) != NULL)
+			{
 				if (do_debugging)
-					debugBuffer(buffer[i], i);
+					debugBuffer(buffer, i);
 
-				arv_stream_push_buffer(stream[i], buffer[i]);
+				if (isValidBuffer(buffer))
+					synchronizer.addFrame(i, buffer, (long long)buffer->timestamp_ns, getHostTimestampNs(), dropped_buffers);
+				else
+					arv_stream_push_buffer(stream[i], buffer);
 			}
-			else
-				empty_queue[i] = true;
 		}
 
-		boost::this_thread::sleep(boost::posix_time::microseconds(100));
-		timeout_seconds -= 0.0001f;
+		long long timestamp_ns;
+		got_pair = synchronizer.popNewestPair(frame_buffer[LEFT], frame_buffer[RIGHT], timestamp_ns, dropped_buffers);
+		pushBackDroppedBuffers(dropped_buffers);
+		if (got_pair)
+		{
+			// Timestamp of the exposure (device timestamp mapped to the host clock)
+			timestamp_us_ = timestamp_ns / 1000;
+			break;
+		}
+
+		// Block until the camera which lags behind delivers its next buffer
+		long long remaining_us = boost::chrono::duration_cast<boost::chrono::microseconds>(deadline - boost::chrono::steady_clock::now()).count();
+		if (remaining_us <= 0)
+			break;
+
+		int i = synchronizer.getLaggingCamera();
+		ArvBuffer *buffer = arv_stream_timeout_pop_buffer(stream[i], (guint64)remaining_us);
+		if (buffer == NULL)
+			break;
+
+		if (do_debugging)
+			debugBuffer(buffer, i);
+
+		if (isValidBuffer(buffer))
+			synchronizer.addFrame(i, buffer, (long long)buffer->timestamp_ns, getHostTimestampNs(), dropped_buffers);
+		else
+			arv_stream_push_buffer(stream[i], buffer);
 	}
 
-	// Only if new frame of BOTH cameras successful, use it as new stereo frame (else old one used)
-	if ((got_data[LEFT] && got_data[RIGHT]))
+	// (on timeout, the buffers in the rings wait for their partner)
+	return got_pair;
+}
+
+
+void
+BaslerGigEStereoCamera::pushBackDroppedBuffers(std::vector<ArvBuffer*> dropped_buffers[2])
+{
+	for(int i = 0; i < 2; i++)
 	{
-		stereo_frame[LEFT] = frame_buffer[LEFT];
-		stereo_frame[RIGHT] = frame_buffer[RIGHT];
+		for(unsigned int j = 0; j < dropped_buffers[i].size(); j++)
+			arv_stream_push_buffer(stream[i], dropped_buffers[i][j]);
+		dropped_buffers[i].clear();
 	}
+}
 
-	image_left = stereo_frame[LEFT];
-	image_right = stereo_frame[RIGHT];
 
-	if(timeout_seconds > 0)
-		return true;
+long long
+BaslerGigEStereoCamera::getHostTimestampNs()
+{
+	boost::posix_time::time_duration time_diff_timestamp = boost::posix_time::microsec_clock::universal_time() - start_time_timestamp;
+	return time_diff_timestamp.total_microseconds() * 1000;
+}
 
-	std::cerr << "BaslerGigEStereoCamera: grabFrame() timeout" << std::endl;
-	return false;
+
+StereoSyncStatistics
+BaslerGigEStereoCamera::getSyncStatistics()
+{
+	return synchronizer.getStatistics();
+}
+
+
+void
+BaslerGigEStereoCamera::pushBackBuffers(SharedBuffers *shared_buffers)
+{
+	for(int i = 0; i < 2; i++)
+	{
+		arv_stream_push_buffer(shared_buffers->stream[i], shared_buffers->buffer[i]);
+		g_object_unref(shared_buffers->stream[i]);
+	}
+
+	delete shared_buffers;
 }
 
 
@@ -6,6 +6,14 @@
 //				 "Basler acA1300-30gc" GigE cameras using the aravis library.
 //				 (http://blogs.gnome.org/emmanuel/category/aravis/)
 //				 Therefore it is only usable in linux.
+//				 - Frames are waited for by arv_stream_timeout_pop_buffer()
+//				   (timeout on a monotonic clock)
+//				 - grabFrameShared(): zero-copy, the frames wrap the aravis
+//				   buffers, which are pushed back to the streams when the
+//				   frame handle is released
+//				 - Stereo synchronization (sync_tolerance_us > 0): the buffers
+//				   are paired by their device timestamps (timestamp_ns),
+//				   orphans are pushed back to the streams
 //============================================================================
 
 #ifndef BASLER_GIGE_STEREO_CAMERA_H_
@@ -21,6 +29,7 @@ extern "C" {
 #define PACKETTIMEOUT 2000 		// >= 1000
 #define FRAMERETENTION 10000	// >= 1000
 #define STREAMBUFFERSIZE 8
+#define SHAREDBUFFERSIZE 8		// additional buffers for frames held by grabFrameShared() (e.g. in a TrackingPipeline)
 
 
 namespace tiy
@@ -37,6 +46,19 @@ private:
 	// Camera streams
 	ArvStream *stream[2];
 
+	// Aravis buffers of a stereo frame grabbed by grabFrameShared() (with a reference of their streams)
+	struct SharedBuffers
+	{
+		ArvStream *stream[2];
+		ArvBuffer *buffer[2];
+	};
+
+	// Handle of the buffers wrapped by the actual stereo frame (empty if copied)
+	FrameHandle stereo_frame_handle;
+
+	// Pairs the buffers by their device timestamps (if sync_tolerance_us > 0)
+	StereoSynchronizer<ArvBuffer*> synchronizer;
+
 	// Error counters for debugging
 	int count_success[2];
 	int count_cleared[2];
@@ -52,6 +74,19 @@ private:
 
 	void debugBuffer(ArvBuffer *buffer, int idx);
 
+	// Wait for the next valid buffer of both streams (the newest, if several are waiting) for at most
+	// timeout_seconds, with the timestamp [us] of the stereo frame. Returns FALSE (and no buffers) on timeout.
+	// The buffers have to be pushed back.
+	bool popBuffers(ArvBuffer *frame_buffer[2], long long int& timestamp_us_, double timeout_seconds);
+	// Same with synchronization: the newest pair of buffers with device timestamps within +-sync_tolerance_us
+	bool popSynchronizedBuffers(ArvBuffer *frame_buffer[2], long long int& timestamp_us_, double timeout_seconds);
+	bool isValidBuffer(ArvBuffer *buffer);
+	void pushBackDroppedBuffers(std::vector<ArvBuffer*> dropped_buffers[2]);
+	long long getHostTimestampNs();
+
+	// Deleter of the frame handle: push the buffers back to their streams
+	static void pushBackBuffers(SharedBuffers *shared_buffers);
+
 public:
 
 	BaslerGigEStereoCamera(bool& do_debugging_, std::string& camera_id_left, std::string& camera_id_right,
@@ -68,6 +103,9 @@ public:
 	virtual void stopCam();
 
 	virtual bool grabFrame(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, double timeout_seconds=1.0f);
+	virtual bool grabFrameShared(cv::Mat &image_left, cv::Mat &image_right, long long int& timestamp_us_, FrameHandle& frame_handle, double timeout_seconds=1.0f);
+
+	virtual StereoSyncStatistics getSyncStatistics();
 };
 
 }
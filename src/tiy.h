@@ -9,10 +9,21 @@
 #define TIY_H_
 
 #include "multicastServer/MulticastServer.h"
+#include "multicastServer/PoseMessage.h"
 #include "multicastClient/MulticastClient.h"
+#include "sharedMemoryServer/SharedMemoryServer.h"
+#include "sharedMemoryClient/SharedMemoryClient.h"
 #include "markerTracking/MarkerTracking.h"
+#include "markerTracking/Points2DFileReader.h"
+#include "markerTracking/EpipolarMatcher.h"
+#include "markerTracking/UndistortionMap.h"
+#include "markerTracking/PointSetFit.h"
+#include "markerTracking/PoseFilter.h"
+#include "markerTracking/BlobDetector.h"
+#include "trackingPipeline/TrackingPipeline.h"
 #include "stereoCam/StereoCamera.h"
 #include "stereoCam/OpenCVStereoCamera.h"
+#include "stereoCam/RawFileStereoCamera.h"
 #include "inputDevice/MouseDevice.h"
 #include "inputDevice/KeyboardDevice.h"
 
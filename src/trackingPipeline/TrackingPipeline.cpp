@@ -0,0 +1,440 @@
+//============================================================================
+// Name        : TrackingPipeline.cpp
+// Author      : Andre Gaschler, Andreas Pflaum
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#include "TrackingPipeline.h"
+
+#include <algorithm>
+
+namespace tiy
+{
+
+TrackingPipeline::TrackingPipeline(MarkerTracking& m_track_, StereoCamera *stereo_camera_,
+									Points2DFileReader *points_2D_file_left_, Points2DFileReader *points_2D_file_right_,
+										bool do_record_video_, bool do_debugging_) :
+	m_track(m_track_),
+	stereo_camera(stereo_camera_),
+	points_2D_file_left(points_2D_file_left_),
+	points_2D_file_right(points_2D_file_right_),
+	do_record_video(do_record_video_),
+	do_debugging(do_debugging_),
+	do_use_zero_copy(false),
+	do_stop(false),
+	is_running(false),
+	frame_counter(0)
+{
+}
+
+
+TrackingPipeline::~TrackingPipeline()
+{
+	stop();
+}
+
+
+const char*
+TrackingPipeline::getStageName(Stage stage)
+{
+	switch (stage)
+	{
+		case STAGE_GRAB: return "grab";
+		case STAGE_SEGMENT: return "segment";
+		case STAGE_RECONSTRUCT: return "reconstruct";
+		case STAGE_FIT: return "fit";
+		case STAGE_PUBLISH: return "publish";
+		default: return "unknown";
+	}
+}
+
+
+bool
+TrackingPipeline::start(int queue_capacity)
+{
+	if (is_running)
+	{
+		std::cerr << "TrackingPipeline: start() - already running" << std::endl;
+		return false;
+	}
+
+	if (queue_capacity < 1)
+	{
+		std::cerr << "TrackingPipeline: start() - queue capacity has to be at least 1" << std::endl;
+		return false;
+	}
+
+	// Enough frames to keep every stage busy plus "queue_capacity" waiting frames
+	int num_frames = NUM_STAGES + queue_capacity;
+	frames.assign(num_frames, TrackingFrame());
+	if (stereo_camera)
+		stereo_camera->reserveImages(FRAME_POOL_CAPACITY + 2 * num_frames);
+	for (int f = 0; f < num_frames; f++)
+	{
+		if (stereo_camera)
+		{
+			frames[f].image_left = stereo_camera->createImage();
+			frames[f].image_right = stereo_camera->createImage();
+		}
+		frames[f].RT_template_leftcam.resize(std::max(m_track.num_templates, 0));
+		frames[f].avg_dev.resize(std::max(m_track.num_templates, 0));
+	}
+
+	// The free frame queue holds all frames, the queues between the stages are bounded
+	queues[STAGE_GRAB].reset(new FrameQueue(num_frames));
+	for (int s = STAGE_SEGMENT; s < NUM_STAGES; s++)
+		queues[s].reset(new FrameQueue(queue_capacity));
+
+	for (int f = 0; f < num_frames; f++)
+		queues[STAGE_GRAB]->push(&frames[f]);
+
+	do_stop = false;
+	for (int s = STAGE_GRAB; s < STAGE_PUBLISH; s++)
+		stage_threads.create_thread(boost::bind(&TrackingPipeline::runStage, this, (Stage)s));
+
+	is_running = true;
+
+	if (do_debugging)
+		std::cout << "TrackingPipeline: start() - " << num_frames << " frames, queue capacity " << queue_capacity << std::endl;
+
+	return true;
+}
+
+
+void
+TrackingPipeline::stop()
+{
+	if (!is_running)
+		return;
+
+	do_stop = true;
+	for (int s = 0; s < NUM_STAGES; s++)
+		notifyQueue((Stage)s);
+	stage_threads.join_all();
+	is_running = false;
+}
+
+
+void
+TrackingPipeline::notifyQueue(Stage stage)
+{
+	// (locked once, so the notification cannot get lost between the check and the wait of popFrame()/pushFrame())
+	{
+		boost::mutex::scoped_lock lock(queue_mutexes[stage]);
+	}
+	queue_conditions[stage].notify_all();
+}
+
+
+bool
+TrackingPipeline::popFrame(Stage stage, TrackingFrame *&frame)
+{
+	FrameQueue& queue = *queues[stage];
+	if (!queue.pop(frame))
+	{
+		boost::mutex::scoped_lock lock(queue_mutexes[stage]);
+		while (!queue.pop(frame))
+		{
+			if (do_stop)
+				return false;
+			queue_conditions[stage].wait(lock);
+		}
+	}
+
+	// A producer may wait for the free slot
+	notifyQueue(stage);
+	return true;
+}
+
+
+bool
+TrackingPipeline::pushFrame(Stage stage, TrackingFrame *frame)
+{
+	FrameQueue& queue = *queues[stage];
+	if (!queue.push(frame))
+	{
+		boost::mutex::scoped_lock lock(queue_mutexes[stage]);
+		while (!queue.push(frame))
+		{
+			if (do_stop)
+				return false;
+			queue_conditions[stage].wait(lock);
+		}
+	}
+
+	// The consumer may wait for the frame
+	notifyQueue(stage);
+	return true;
+}
+
+
+void
+TrackingPipeline::addStatistics(PipelineStageStatistics& statistics, const boost::posix_time::ptime& start_time, long long queue_occupancy)
+{
+	long long latency_us = (boost::posix_time::microsec_clock::universal_time() - start_time).total_microseconds();
+
+	boost::mutex::scoped_lock lock(statistics_mutex);
+	statistics.num_frames++;
+	statistics.sum_latency_us += latency_us;
+	statistics.max_latency_us = std::max(statistics.max_latency_us, latency_us);
+	statistics.sum_queue_occupancy += queue_occupancy;
+	statistics.max_queue_occupancy = std::max(statistics.max_queue_occupancy, queue_occupancy);
+}
+
+
+void
+TrackingPipeline::grabFrame(TrackingFrame& frame, bool do_own_images)
+{
+	frame.status = TrackingFrame::FRAME_OK;
+	frame.frame_id = frame_counter++;
+	frame.grab_time = boost::posix_time::microsec_clock::universal_time();
+
+	if (!stereo_camera)
+	{
+		if (frame.frame_id >= points_2D_file_left->getNumFrames() || frame.frame_id >= points_2D_file_right->getNumFrames())
+			frame.status = TrackingFrame::FRAME_INPUT_FINISHED;
+
+		// 2D point files have no timestamps => one frame per camera frame period
+		frame.timestamp_us = (long long int)frame.frame_id * 1000000 / m_track.frame_rate;
+		return;
+	}
+
+	cv::Mat grabbed_left = frame.image_left, grabbed_right = frame.image_right;
+	bool is_grabbed;
+	if (do_use_zero_copy)
+		is_grabbed = stereo_camera->grabFrameShared(grabbed_left, grabbed_right, frame.timestamp_us, frame.frame_handle);
+	else
+		is_grabbed = stereo_camera->grabFrame(grabbed_left, grabbed_right, frame.timestamp_us);
+
+	if (!is_grabbed)
+	{
+		frame.status = TrackingFrame::FRAME_GRAB_FAILED;
+		return;
+	}
+
+	// Cameras returning their internal buffer (overwritten by the next grab) => copy to the frame's own buffer
+	// (not if the frame holds the camera buffers by its frame handle)
+	do_own_images = do_own_images && !frame.frame_handle;
+
+	if (do_own_images && grabbed_left.data != frame.image_left.data)
+		grabbed_left.copyTo(frame.image_left);
+	else
+		frame.image_left = grabbed_left;
+
+	if (do_own_images && grabbed_right.data != frame.image_right.data)
+		grabbed_right.copyTo(frame.image_right);
+	else
+		frame.image_right = grabbed_right;
+
+	if (do_record_video)
+		stereo_camera->recordFrame(frame.timestamp_us);
+}
+
+
+void
+TrackingPipeline::segmentFrame(TrackingFrame& frame)
+{
+	frame.points_2D_left.clear();
+	frame.points_2D_right.clear();
+
+#pragma omp parallel sections
+	{
+#pragma omp section
+		{
+			if (!stereo_camera)
+				points_2D_file_left->get2DPoints(frame.frame_id, &frame.points_2D_left);
+			else
+				m_track.get2DPointsFromImage(frame.image_left, &frame.points_2D_left, 0);
+		}
+#pragma omp section
+		{
+			if (!stereo_camera)
+				points_2D_file_right->get2DPoints(frame.frame_id, &frame.points_2D_right);
+			else
+				m_track.get2DPointsFromImage(frame.image_right, &frame.points_2D_right, 1);
+		}
+	}
+}
+
+
+void
+TrackingPipeline::reconstructFrame(TrackingFrame& frame)
+{
+	frame.points_3D = m_track.get3DPointsFrom2DPoints(frame.points_2D_left, frame.points_2D_right);
+}
+
+
+void
+TrackingPipeline::fitFrame(TrackingFrame& frame)
+{
+	int num_templates = std::max(m_track.num_templates, 0);
+	frame.RT_template_leftcam.resize(num_templates);
+	frame.avg_dev.assign(num_templates, 0);
+
+	for (int t = 0; t < num_templates; t++)
+		frame.RT_template_leftcam[t] = cv::Mat::zeros(4, 4, CV_32F);
+
+	// (all templates in parallel, sharing the edges of the 3D points)
+	m_track.fit3DPointsToObjectTemplates(frame.points_3D, frame.RT_template_leftcam, frame.avg_dev);
+}
+
+
+void
+TrackingPipeline::processStage(Stage stage, TrackingFrame& frame)
+{
+	switch (stage)
+	{
+		case STAGE_GRAB: grabFrame(frame, true); break;
+		case STAGE_SEGMENT: segmentFrame(frame); break;
+		case STAGE_RECONSTRUCT: reconstructFrame(frame); break;
+		case STAGE_FIT: fitFrame(frame); break;
+		default: break;
+	}
+}
+
+
+void
+TrackingPipeline::runStage(Stage stage)
+{
+	FrameQueue& input_queue = *queues[stage];
+
+	while (!do_stop)
+	{
+		TrackingFrame *frame;
+		if (!popFrame(stage, frame))
+			return;
+
+		long long queue_occupancy = (long long)input_queue.read_available();
+		boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+
+		// Frames after the end of the input are only passed on
+		if (frame->status == TrackingFrame::FRAME_OK)
+			processStage(stage, *frame);
+
+		addStatistics(stage_statistics[stage], start_time, queue_occupancy);
+
+		// Bounded queue => wait for the next stage (back pressure up to the grab stage)
+		if (!pushFrame((Stage)(stage + 1), frame))
+			return;
+
+		// Nothing to grab after the end of the input
+		if (stage == STAGE_GRAB && frame->status != TrackingFrame::FRAME_OK)
+			return;
+	}
+}
+
+
+TrackingFrame*
+TrackingPipeline::waitForFrame()
+{
+	if (!is_running)
+	{
+		std::cerr << "TrackingPipeline: waitForFrame() - NOT running" << std::endl;
+		return NULL;
+	}
+
+	FrameQueue& input_queue = *queues[STAGE_PUBLISH];
+	TrackingFrame *frame;
+	if (!popFrame(STAGE_PUBLISH, frame))
+		return NULL;
+
+	// Publishing time is measured until the frame is released
+	long long queue_occupancy = (long long)input_queue.read_available();
+	boost::mutex::scoped_lock lock(statistics_mutex);
+	stage_statistics[STAGE_PUBLISH].sum_queue_occupancy += queue_occupancy;
+	stage_statistics[STAGE_PUBLISH].max_queue_occupancy = std::max(stage_statistics[STAGE_PUBLISH].max_queue_occupancy, queue_occupancy);
+	publish_start_time = boost::posix_time::microsec_clock::universal_time();
+
+	return frame;
+}
+
+
+void
+TrackingPipeline::releaseFrame(TrackingFrame *frame)
+{
+	if (!is_running || !frame)
+		return;
+
+	addStatistics(stage_statistics[STAGE_PUBLISH], publish_start_time, 0);
+	addStatistics(frame_statistics, frame->grab_time, 0);
+
+	// Give the camera buffers back (the images wrap them)
+	if (frame->frame_handle)
+	{
+		frame->image_left.release();
+		frame->image_right.release();
+		frame->frame_handle.reset();
+	}
+
+	// Free frame queue holds all frames => never full (wakes the grab stage)
+	pushFrame(STAGE_GRAB, frame);
+}
+
+
+bool
+TrackingPipeline::processFrame(TrackingFrame& frame)
+{
+	boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+	grabFrame(frame, false);
+	addStatistics(stage_statistics[STAGE_GRAB], start_time, 0);
+
+	if (frame.status != TrackingFrame::FRAME_OK)
+		return false;
+
+	for (int s = STAGE_SEGMENT; s < STAGE_PUBLISH; s++)
+	{
+		start_time = boost::posix_time::microsec_clock::universal_time();
+		processStage((Stage)s, frame);
+		addStatistics(stage_statistics[s], start_time, 0);
+	}
+
+	addStatistics(frame_statistics, frame.grab_time, 0);
+
+	return true;
+}
+
+
+PipelineStageStatistics
+TrackingPipeline::getStageStatistics(Stage stage) const
+{
+	boost::mutex::scoped_lock lock(statistics_mutex);
+	return stage_statistics[stage];
+}
+
+
+PipelineStageStatistics
+TrackingPipeline::getFrameStatistics() const
+{
+	boost::mutex::scoped_lock lock(statistics_mutex);
+	return frame_statistics;
+}
+
+
+void
+TrackingPipeline::resetStatistics()
+{
+	boost::mutex::scoped_lock lock(statistics_mutex);
+	for (int s = 0; s < NUM_STAGES; s++)
+		stage_statistics[s] = PipelineStageStatistics();
+	frame_statistics = PipelineStageStatistics();
+}
+
+
+void
+TrackingPipeline::printStatistics(std::ostream& output) const
+{
+	boost::mutex::scoped_lock lock(statistics_mutex);
+
+	output << "TrackingPipeline (" << (is_running ? "pipelined" : "serial") << ")" << std::endl;
+	for (int s = 0; s < NUM_STAGES; s++)
+	{
+		const PipelineStageStatistics& statistics = stage_statistics[s];
+		output << "  " << getStageName((Stage)s) << ":\tframes = " << statistics.num_frames
+				<< "\tlatency = " << statistics.getMeanLatency() << " (max " << statistics.max_latency_us << ") [us]"
+				<< "\tqueue = " << statistics.getMeanQueueOccupancy() << " (max " << statistics.max_queue_occupancy << ")" << std::endl;
+	}
+	output << "  total:\tframes = " << frame_statistics.num_frames
+			<< "\tlatency = " << frame_statistics.getMeanLatency() << " (max " << frame_statistics.max_latency_us << ") [us]" << std::endl;
+}
+
+}
@@ -0,0 +1,197 @@
+//============================================================================
+// Name        : TrackingPipeline.h
+// Author      : Andre Gaschler, Andreas Pflaum
+// Description : Staged processing of the stereo frames
+//				 (grab -> segment -> reconstruct -> fit -> publish):
+//				 - Pipelined: one thread per stage grab, segment, reconstruct
+//				   and fit, the caller (e.g. the server main loop) is the
+//				   publish stage (waitForFrame() -> publish -> releaseFrame()).
+//				   So frame N+1 is grabbed and segmented while frame N is
+//				   fitted and published.
+//				 - The stages are connected by bounded lock-free single
+//				   producer/single consumer queues of frame pointers, the
+//				   frames are preallocated and recycled. A stage waiting for
+//				   an empty or full queue blocks on the condition variable
+//				   of the queue (signalled by every push and pop, no polling)
+//				 - Zero-copy (setZeroCopy()): the images of a frame wrap the
+//				   camera buffers (StereoCamera::grabFrameShared()) until the
+//				   frame is released
+//				 - Serial: processFrame() runs all stages in the calling thread
+//				 - Per stage statistics: number of frames, latency of the
+//				   stage and occupancy of its input queue (mean and max)
+// Licence	   : see LICENCE.txt
+//============================================================================
+
+#ifndef TRACKING_PIPELINE_H_
+#define TRACKING_PIPELINE_H_
+
+#include "../markerTracking/MarkerTracking.h"
+#include "../markerTracking/Points2DFileReader.h"
+#include "../stereoCam/StereoCamera.h"
+
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include <iostream>
+#include <vector>
+
+namespace tiy
+{
+
+// One stereo frame and all results computed from it
+struct TrackingFrame
+{
+	enum Status { FRAME_OK, FRAME_INPUT_FINISHED, FRAME_GRAB_FAILED };
+
+	Status status;
+
+	// Index of the frame (line of the 2D point files) and camera timestamp
+	int frame_id;
+	long long int timestamp_us;
+
+	cv::Mat image_left, image_right;
+
+	// Camera buffers wrapped by image_left/image_right (zero-copy grabbing, else empty)
+	StereoCamera::FrameHandle frame_handle;
+
+	std::vector<cv::Point2f> points_2D_left, points_2D_right;
+	cv::Mat points_3D;
+
+	// Pose (zero if not found) and average deviation of every template
+	std::vector<cv::Mat> RT_template_leftcam;
+	std::vector<float> avg_dev;
+
+	// Start of grabbing (for the latency of the whole pipeline)
+	boost::posix_time::ptime grab_time;
+
+	TrackingFrame() : status(FRAME_OK), frame_id(0), timestamp_us(0) {};
+};
+
+
+struct PipelineStageStatistics
+{
+	long long num_frames;
+
+	// Processing time of the stage per frame [us]
+	long long sum_latency_us, max_latency_us;
+
+	// Frames waiting in the input queue of the stage (sampled whenever the stage takes a frame)
+	long long sum_queue_occupancy, max_queue_occupancy;
+
+	PipelineStageStatistics() : num_frames(0), sum_latency_us(0), max_latency_us(0), sum_queue_occupancy(0), max_queue_occupancy(0) {};
+
+	double getMeanLatency() const { return num_frames ? (double)sum_latency_us / num_frames : 0.0; }
+	double getMeanQueueOccupancy() const { return num_frames ? (double)sum_queue_occupancy / num_frames : 0.0; }
+};
+
+
+class TrackingPipeline
+{
+
+public:
+
+	enum Stage { STAGE_GRAB, STAGE_SEGMENT, STAGE_RECONSTRUCT, STAGE_FIT, STAGE_PUBLISH, NUM_STAGES };
+
+private:
+
+	typedef boost::lockfree::spsc_queue<TrackingFrame *> FrameQueue;
+
+	MarkerTracking& m_track;
+
+	// Input source: stereo camera/video files or (if stereo_camera is NULL) 2D point files
+	StereoCamera *stereo_camera;
+	Points2DFileReader *points_2D_file_left, *points_2D_file_right;
+
+	bool do_record_video, do_debugging;
+
+	// Grab by StereoCamera::grabFrameShared() instead of copying the frames
+	bool do_use_zero_copy;
+
+	// Preallocated frames (pipelined mode)
+	std::vector<TrackingFrame> frames;
+
+	// Input queue of every stage (queues[STAGE_GRAB]: released, i.e. free frames)
+	boost::scoped_ptr<FrameQueue> queues[NUM_STAGES];
+
+	// Waiting for an empty (consumer) or full (producer) queue (the queues themselves are not locked)
+	boost::mutex queue_mutexes[NUM_STAGES];
+	boost::condition_variable queue_conditions[NUM_STAGES];
+
+	boost::thread_group stage_threads;
+	boost::atomic<bool> do_stop;
+	bool is_running;
+
+	// Next frame index (grab stage)
+	int frame_counter;
+
+	// Statistics (stages and whole pipeline from grabbing to releasing a frame)
+	mutable boost::mutex statistics_mutex;
+	PipelineStageStatistics stage_statistics[NUM_STAGES], frame_statistics;
+	boost::posix_time::ptime publish_start_time;
+
+public:
+
+	// Frames are read from stereo_camera_ or (if stereo_camera_ is NULL) from the 2D point files.
+	// If do_record_video_, every grabbed frame is recorded (stereo_camera_->startRecording() needs to be called before)
+	TrackingPipeline(MarkerTracking& m_track_, StereoCamera *stereo_camera_,
+						Points2DFileReader *points_2D_file_left_, Points2DFileReader *points_2D_file_right_,
+							bool do_record_video_, bool do_debugging_);
+
+	~TrackingPipeline();
+
+	// Zero-copy grabbing (set before start())
+	void setZeroCopy(bool do_use_zero_copy_) { do_use_zero_copy = do_use_zero_copy_; }
+	bool getZeroCopy() const { return do_use_zero_copy; }
+
+	// Start the stage threads with bounded queues of "queue_capacity" frames between the stages
+	bool start(int queue_capacity);
+	// Stop and join the stage threads
+	void stop();
+	bool isRunning() const { return is_running; }
+
+	// Pipelined: next frame processed by all stages (in order of grabbing). Blocks until available,
+	// returns NULL if not running or stopped. The frame has to be given back by releaseFrame() after publishing
+	// (which also gives its camera buffers back in zero-copy mode).
+	TrackingFrame* waitForFrame();
+	void releaseFrame(TrackingFrame *frame);
+
+	// Serial: grab, segment, reconstruct and fit the next frame in the calling thread
+	// (returns FALSE if no frame could be grabbed, see frame.status)
+	bool processFrame(TrackingFrame& frame);
+
+	// Copy of the statistics of one stage and of the whole pipeline (from grabbing to releasing)
+	PipelineStageStatistics getStageStatistics(Stage stage) const;
+	PipelineStageStatistics getFrameStatistics() const;
+	void printStatistics(std::ostream& output) const;
+	void resetStatistics();
+
+	static const char* getStageName(Stage stage);
+
+private:
+
+	// The stages (pipelined: do_own_images => copy frames which share the camera buffer)
+	void grabFrame(TrackingFrame& frame, bool do_own_images);
+	void segmentFrame(TrackingFrame& frame);
+	void reconstructFrame(TrackingFrame& frame);
+	void fitFrame(TrackingFrame& frame);
+
+	// Thread function of one stage: pop from its input queue, process, push to the next queue
+	void runStage(Stage stage);
+	void processStage(Stage stage, TrackingFrame& frame);
+
+	void addStatistics(PipelineStageStatistics& statistics, const boost::posix_time::ptime& start_time, long long queue_occupancy);
+
+	// Pop from / push to the input queue of "stage", blocking while it is empty / full (returns FALSE if stopped)
+	bool popFrame(Stage stage, TrackingFrame *&frame);
+	bool pushFrame(Stage stage, TrackingFrame *frame);
+	// Wake the threads waiting on the queue of "stage"
+	void notifyQueue(Stage stage);
+};
+
+}
+
+#endif // TRACKING_PIPELINE_H_